@@ -0,0 +1,234 @@
+#pragma once
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "CompiledGrammar.h"
+
+class BatchWriteException {};
+
+//*** BUFFEREDWRITER ***
+//
+//
+
+// Collects output in a large buffer and hands it to the file in few, big writes
+class BufferedWriter
+{
+	public:
+		// "-" writes to stdout
+		BufferedWriter(const std::string& path, size_t bufferSize = size_t(4) << 20);
+		virtual ~BufferedWriter();
+
+		BufferedWriter(const BufferedWriter&) = delete;
+		BufferedWriter(BufferedWriter&&) = delete;
+		BufferedWriter& operator=(const BufferedWriter&) = delete;
+		BufferedWriter& operator=(BufferedWriter&&) = delete;
+
+		void Write(const void* pData, size_t size);
+		void Write(const std::string& text) { Write(text.data(), text.size()); }
+		void Write(char character);
+		void Flush();
+
+		unsigned long long GetBytesWritten() const { return m_BytesWritten + m_Size; }
+
+	private:
+		FILE* m_pFile;
+		bool m_IsOwner;
+		std::vector<char> m_Buffer;
+		size_t m_Size{ 0 };
+		unsigned long long m_BytesWritten{ 0 };
+};
+
+inline BufferedWriter::BufferedWriter(const std::string& path, size_t bufferSize)
+	: m_pFile{ path == "-" ? stdout : std::fopen(path.c_str(), "wb") }
+	, m_IsOwner{ path != "-" }
+	, m_Buffer(bufferSize)
+{
+	if (!m_pFile) {
+		throw BatchWriteException{};
+	}
+}
+
+inline BufferedWriter::~BufferedWriter() {
+
+	// Errors can't be reported from here, call Flush first to see them
+	try {
+		Flush();
+	}
+	catch (BatchWriteException) {}
+
+	if (m_IsOwner) {
+		std::fclose(m_pFile);
+	}
+}
+
+inline void BufferedWriter::Write(const void* pData, size_t size) {
+
+	if (m_Size + size > m_Buffer.size()) {
+		Flush();
+		if (size > m_Buffer.size()) {
+			if (std::fwrite(pData, 1, size, m_pFile) != size) {
+				throw BatchWriteException{};
+			}
+			m_BytesWritten += size;
+			return;
+		}
+	}
+
+	std::memcpy(m_Buffer.data() + m_Size, pData, size);
+	m_Size += size;
+}
+
+inline void BufferedWriter::Write(char character) {
+
+	if (m_Size == m_Buffer.size()) {
+		Flush();
+	}
+	m_Buffer[m_Size++] = character;
+}
+
+inline void BufferedWriter::Flush() {
+
+	if (m_Size > 0 && std::fwrite(m_Buffer.data(), 1, m_Size, m_pFile) != m_Size) {
+		throw BatchWriteException{};
+	}
+	m_BytesWritten += m_Size;
+	m_Size = 0;
+	std::fflush(m_pFile);
+}
+
+//*** BATCHWRITER ***
+//
+//
+
+// text:	one generation per line, symbols separated by spaces
+// jsonl:	{"seed":N,"symbols":["...",...]} per line
+// binary:	"SGB1", uint32 symbol count, per symbol [uint32 length][bytes], uint64 first seed, uint64 count,
+//			then per generation [uint32 length][length uint32 symbol IDs]
+enum class BatchFormat {
+	Text,
+	Jsonl,
+	Binary
+};
+
+class BatchWriter
+{
+	public:
+		BatchWriter(BufferedWriter& writer, BatchFormat format, const CompiledGrammar<std::string>& grammar);
+		virtual ~BatchWriter() = default;
+
+		BatchWriter(const BatchWriter&) = delete;
+		BatchWriter(BatchWriter&&) = delete;
+		BatchWriter& operator=(const BatchWriter&) = delete;
+		BatchWriter& operator=(BatchWriter&&) = delete;
+
+		// Only the binary format has a header
+		void WriteHeader(unsigned long long firstSeed, unsigned long long count);
+		void WriteBatch(const SymbolBatch& batch, unsigned long long firstSeed);
+
+	private:
+		BufferedWriter& m_Writer;
+		BatchFormat m_Format;
+		const CompiledGrammar<std::string>& m_Grammar;
+
+		// Every symbol is escaped once up front instead of on every use
+		std::vector<std::string> m_JsonSymbols;
+
+		static std::string EscapeJson(const std::string& text);
+};
+
+inline BatchWriter::BatchWriter(BufferedWriter& writer, BatchFormat format, const CompiledGrammar<std::string>& grammar)
+	: m_Writer{ writer }
+	, m_Format{ format }
+	, m_Grammar{ grammar }
+{
+	if (m_Format == BatchFormat::Jsonl) {
+		for (unsigned int symbol{ 0 }; symbol < grammar.GetSymbolCount(); ++symbol) {
+			m_JsonSymbols.push_back('"' + EscapeJson(grammar.GetSymbol(symbol)) + '"');
+		}
+	}
+}
+
+inline std::string BatchWriter::EscapeJson(const std::string& text) {
+
+	std::string escaped{};
+	for (char character : text) {
+		switch (character) {
+			case '"': escaped += "\\\""; break;
+			case '\\': escaped += "\\\\"; break;
+			case '\n': escaped += "\\n"; break;
+			case '\r': escaped += "\\r"; break;
+			case '\t': escaped += "\\t"; break;
+			default:
+				if (static_cast<unsigned char>(character) < 0x20) {
+					char code[7];
+					std::snprintf(code, sizeof(code), "\\u%04x", static_cast<unsigned int>(character));
+					escaped += code;
+				}
+				else {
+					escaped += character;
+				}
+				break;
+		}
+	}
+	return escaped;
+}
+
+inline void BatchWriter::WriteHeader(unsigned long long firstSeed, unsigned long long count) {
+
+	if (m_Format != BatchFormat::Binary) {
+		return;
+	}
+
+	m_Writer.Write("SGB1", 4);
+	const unsigned int symbolCount{ static_cast<unsigned int>(m_Grammar.GetSymbolCount()) };
+	m_Writer.Write(&symbolCount, sizeof(symbolCount));
+	for (unsigned int symbol{ 0 }; symbol < symbolCount; ++symbol) {
+		const std::string& text{ m_Grammar.GetSymbol(symbol) };
+		const unsigned int length{ static_cast<unsigned int>(text.size()) };
+		m_Writer.Write(&length, sizeof(length));
+		m_Writer.Write(text);
+	}
+	m_Writer.Write(&firstSeed, sizeof(firstSeed));
+	m_Writer.Write(&count, sizeof(count));
+}
+
+inline void BatchWriter::WriteBatch(const SymbolBatch& batch, unsigned long long firstSeed) {
+
+	for (size_t generation{ 0 }; generation + 1 < batch.offsets.size(); ++generation) {
+		const size_t first{ batch.offsets[generation] };
+		const size_t last{ batch.offsets[generation + 1] };
+
+		switch (m_Format) {
+			case BatchFormat::Text:
+				for (size_t index{ first }; index < last; ++index) {
+					if (index != first) {
+						m_Writer.Write(' ');
+					}
+					m_Writer.Write(m_Grammar.GetSymbol(batch.symbols[index]));
+				}
+				m_Writer.Write('\n');
+				break;
+
+			case BatchFormat::Jsonl:
+				m_Writer.Write("{\"seed\":");
+				m_Writer.Write(std::to_string(firstSeed + generation));
+				m_Writer.Write(",\"symbols\":[");
+				for (size_t index{ first }; index < last; ++index) {
+					if (index != first) {
+						m_Writer.Write(',');
+					}
+					m_Writer.Write(m_JsonSymbols[batch.symbols[index]]);
+				}
+				m_Writer.Write("]}\n");
+				break;
+
+			case BatchFormat::Binary: {
+				const unsigned int length{ static_cast<unsigned int>(last - first) };
+				m_Writer.Write(&length, sizeof(length));
+				m_Writer.Write(batch.symbols.data() + first, length * sizeof(unsigned int));
+				break;
+			}
+		}
+	}
+}
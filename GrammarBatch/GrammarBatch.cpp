@@ -0,0 +1,353 @@
+// GrammarBatch.cpp : Generates large seeded batches of a rule and streams them to disk.
+//
+// Usage: GrammarBatch <grammar file> <rule> [--count N] [--seed N] [--threads N] [--depth N]
+//                     [--format text|jsonl|binary] [--output path] [--chunk N] [--workers N]
+//
+// Generation i uses seed + i, so any run can be reproduced or split up by seed range.
+// With --workers the seed range is split over worker processes that each write a shard file,
+// the shards are then merged in seed order into output, plus an index in output.idx.
+// The merged output is byte for byte the same as a single process run.
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <chrono>
+#include <future>
+#include <cstdio>
+#include "Grammar.h"
+#include "BatchWriter.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <spawn.h>
+#include <sys/wait.h>
+extern char** environ;
+#endif
+
+struct BatchOptions {
+	std::string grammarFile;
+	std::string rule;
+	unsigned long long count{ 1000 };
+	unsigned long long seed{ 0 };
+	unsigned int threads{ std::thread::hardware_concurrency() };
+	int maxDepth{ 0 };
+	BatchFormat format{ BatchFormat::Text };
+	std::string output{ "-" };
+	unsigned long long chunk{ 65536 };
+	unsigned int workers{ 0 };
+	bool isHeaderWritten{ true };
+	bool isQuiet{ false };
+};
+
+bool ParseOptions(int argc, char* argv[], BatchOptions& options) {
+
+	for (int arg{ 1 }; arg < argc; ++arg) {
+		const std::string option{ argv[arg] };
+		const bool hasValue{ arg + 1 < argc };
+
+		if (option == "--count" && hasValue) {
+			options.count = std::stoull(argv[++arg]);
+		}
+		else if (option == "--seed" && hasValue) {
+			options.seed = std::stoull(argv[++arg]);
+		}
+		else if (option == "--threads" && hasValue) {
+			options.threads = static_cast<unsigned int>(std::stoul(argv[++arg]));
+		}
+		else if (option == "--depth" && hasValue) {
+			options.maxDepth = std::stoi(argv[++arg]);
+		}
+		else if (option == "--output" && hasValue) {
+			options.output = argv[++arg];
+		}
+		else if (option == "--chunk" && hasValue) {
+			options.chunk = std::max(std::stoull(argv[++arg]), 1ull);
+		}
+		else if (option == "--workers" && hasValue) {
+			options.workers = static_cast<unsigned int>(std::stoul(argv[++arg]));
+		}
+		else if (option == "--no-header") {
+			options.isHeaderWritten = false;
+		}
+		else if (option == "--quiet") {
+			options.isQuiet = true;
+		}
+		else if (option == "--format" && hasValue) {
+			const std::string format{ argv[++arg] };
+			if (format == "text") {
+				options.format = BatchFormat::Text;
+			}
+			else if (format == "jsonl") {
+				options.format = BatchFormat::Jsonl;
+			}
+			else if (format == "binary") {
+				options.format = BatchFormat::Binary;
+			}
+			else {
+				return false;
+			}
+		}
+		else if (options.grammarFile.empty()) {
+			options.grammarFile = option;
+		}
+		else if (options.rule.empty()) {
+			options.rule = option;
+		}
+		else {
+			return false;
+		}
+	}
+	return !options.grammarFile.empty() && !options.rule.empty();
+}
+
+//*** WORKER PROCESSES ***
+//
+//
+
+#if defined(_WIN32)
+using ProcessHandle = HANDLE;
+#else
+using ProcessHandle = pid_t;
+#endif
+
+bool LaunchProcess(const std::vector<std::string>& arguments, ProcessHandle& process) {
+
+#if defined(_WIN32)
+	std::string commandLine{};
+	for (const std::string& argument : arguments) {
+		commandLine += '"' + argument + "\" ";
+	}
+
+	STARTUPINFOA startup{};
+	startup.cb = sizeof(startup);
+	PROCESS_INFORMATION information{};
+	if (!CreateProcessA(nullptr, &commandLine[0], nullptr, nullptr, TRUE, 0, nullptr, nullptr, &startup, &information)) {
+		return false;
+	}
+	CloseHandle(information.hThread);
+	process = information.hProcess;
+	return true;
+#else
+	std::vector<char*> pArguments{};
+	for (const std::string& argument : arguments) {
+		pArguments.push_back(const_cast<char*>(argument.c_str()));
+	}
+	pArguments.push_back(nullptr);
+	return posix_spawnp(&process, pArguments[0], nullptr, nullptr, pArguments.data(), environ) == 0;
+#endif
+}
+
+bool WaitProcess(ProcessHandle process) {
+
+#if defined(_WIN32)
+	DWORD exitCode{ 1 };
+	WaitForSingleObject(process, INFINITE);
+	GetExitCodeProcess(process, &exitCode);
+	CloseHandle(process);
+	return exitCode == 0;
+#else
+	int status{ 0 };
+	return waitpid(process, &status, 0) == process && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+#endif
+}
+
+//*** GENERATION ***
+//
+//
+
+// Streams options.count generations to options.output, returns the symbols generated
+unsigned long long Generate(const BatchOptions& options, const CompiledGrammar<std::string>& grammar, RuleId rule, unsigned long long& bytes) {
+
+	ThreadPool pool{ options.threads };
+	const int maxDepth{ grammar.GetDepth() };
+	unsigned long long symbols{ 0 };
+
+	BufferedWriter file{ options.output };
+	BatchWriter writer{ file, options.format, grammar };
+	if (options.isHeaderWritten) {
+		writer.WriteHeader(options.seed, options.count);
+	}
+
+	// Generate the next chunk while the current one is written
+	auto generate = [&](unsigned long long first) {
+		const unsigned long long count{ std::min(options.chunk, options.count - first) };
+		std::vector<unsigned long long> seeds(count);
+		for (unsigned long long index{ 0 }; index < count; ++index) {
+			seeds[index] = options.seed + first + index;
+		}
+
+		SymbolBatch batch{};
+		grammar.GenerateBatch(pool, rule, seeds.data(), seeds.size(), batch, maxDepth);
+		return batch;
+	};
+
+	std::future<SymbolBatch> next;
+	if (options.count > 0) {
+		next = std::async(std::launch::async, generate, 0ull);
+	}
+	for (unsigned long long first{ 0 }; first < options.count; first += options.chunk) {
+		SymbolBatch batch{ next.get() };
+		if (first + options.chunk < options.count) {
+			next = std::async(std::launch::async, generate, first + options.chunk);
+		}
+
+		writer.WriteBatch(batch, options.seed + first);
+		symbols += batch.symbols.size();
+	}
+
+	file.Flush();
+	bytes = file.GetBytesWritten();
+	return symbols;
+}
+
+// Splits the seed range over worker processes, then merges their shards in seed order
+bool GenerateSharded(const BatchOptions& options, const std::string& program, const CompiledGrammar<std::string>& grammar, unsigned long long& bytes) {
+
+	std::vector<ProcessHandle> processes{};
+	std::vector<std::string> shardFiles{};
+	std::vector<unsigned long long> shardFirsts{};
+	const unsigned int threads{ std::max(options.threads / options.workers, 1u) };
+
+	bool isSucceeded{ true };
+	for (unsigned int worker{ 0 }; worker < options.workers; ++worker) {
+		const unsigned long long first{ options.count * worker / options.workers };
+		const unsigned long long last{ options.count * (worker + 1) / options.workers };
+		shardFiles.push_back(options.output + ".shard" + std::to_string(worker));
+		shardFirsts.push_back(first);
+
+		// A worker is a normal run over its part of the seed range, without the header
+		const std::vector<std::string> arguments{ program, options.grammarFile, options.rule,
+			"--count", std::to_string(last - first), "--seed", std::to_string(options.seed + first),
+			"--threads", std::to_string(threads), "--depth", std::to_string(options.maxDepth),
+			"--format", options.format == BatchFormat::Text ? "text" : options.format == BatchFormat::Jsonl ? "jsonl" : "binary",
+			"--output", shardFiles.back(), "--chunk", std::to_string(options.chunk), "--no-header", "--quiet" };
+
+		ProcessHandle process{};
+		if (!LaunchProcess(arguments, process)) {
+			isSucceeded = false;
+			break;
+		}
+		processes.push_back(process);
+	}
+	for (ProcessHandle process : processes) {
+		isSucceeded &= WaitProcess(process);
+	}
+
+	if (isSucceeded) {
+		BufferedWriter file{ options.output };
+		BatchWriter writer{ file, options.format, grammar };
+		writer.WriteHeader(options.seed, options.count);
+
+		// Index line per shard: first seed, count, byte offset and byte length in output
+		std::ofstream index{ options.output + ".idx" };
+		std::vector<char> buffer(size_t(4) << 20);
+		for (size_t shard{ 0 }; shard < shardFiles.size(); ++shard) {
+			const unsigned long long offset{ file.GetBytesWritten() };
+
+			FILE* pShard{ std::fopen(shardFiles[shard].c_str(), "rb") };
+			if (!pShard) {
+				isSucceeded = false;
+				break;
+			}
+			size_t size{ 0 };
+			while ((size = std::fread(buffer.data(), 1, buffer.size(), pShard)) > 0) {
+				file.Write(buffer.data(), size);
+			}
+			std::fclose(pShard);
+
+			const unsigned long long last{ shard + 1 < shardFirsts.size() ? shardFirsts[shard + 1] : options.count };
+			index << options.seed + shardFirsts[shard] << " " << last - shardFirsts[shard] << " "
+				<< offset << " " << file.GetBytesWritten() - offset << "\n";
+		}
+
+		file.Flush();
+		bytes = file.GetBytesWritten();
+	}
+
+	for (const std::string& shardFile : shardFiles) {
+		std::remove(shardFile.c_str());
+	}
+	return isSucceeded;
+}
+
+//*** MAIN ***
+//
+//
+
+int main(int argc, char* argv[])
+{
+	BatchOptions options{};
+	if (!ParseOptions(argc, argv, options) || (options.workers > 0 && options.output == "-")) {
+		std::cerr << "Usage: GrammarBatch <grammar file> <rule> [--count N] [--seed N] [--threads N] [--depth N]\n"
+			<< "                    [--format text|jsonl|binary] [--output path] [--chunk N] [--workers N]\n"
+			<< "--workers needs an --output file\n";
+		return 1;
+	}
+
+	Grammar<std::string> grammar{};
+	{
+		std::ifstream stream{ options.grammarFile };
+		if (!stream) {
+			std::cerr << "Cannot open " << options.grammarFile << "\n";
+			return 1;
+		}
+		try {
+			grammar.ParseRules(stream);
+		}
+		catch (RuleSyntaxException) {
+			std::cerr << "Syntax error in " << options.grammarFile << "\n";
+			return 1;
+		}
+	}
+
+	if (options.maxDepth > 0) {
+		LNode<std::string>::SetDepth(options.maxDepth);
+	}
+	std::shared_ptr<const CompiledGrammar<std::string>> pGrammar{ grammar.Freeze() };
+
+	RuleId rule{};
+	try {
+		rule = pGrammar->Resolve(options.rule);
+	}
+	catch (Rule404Exception) {
+		std::cerr << "Unknown rule " << options.rule << "\n";
+		return 1;
+	}
+
+	const auto start{ std::chrono::steady_clock::now() };
+	unsigned long long symbols{ 0 };
+	unsigned long long bytes{ 0 };
+
+	try {
+		if (options.workers > 0) {
+			if (!GenerateSharded(options, argv[0], *pGrammar, bytes)) {
+				std::cerr << "A worker process failed\n";
+				return 1;
+			}
+		}
+		else {
+			symbols = Generate(options, *pGrammar, rule, bytes);
+		}
+	}
+	catch (BatchWriteException) {
+		std::cerr << "Cannot write " << options.output << "\n";
+		return 1;
+	}
+
+	if (options.isQuiet) {
+		return 0;
+	}
+
+	const double seconds{ std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() };
+	std::cerr << "Generated " << options.count << " x " << options.rule << " in " << seconds << " s";
+	if (options.workers > 0) {
+		std::cerr << " on " << options.workers << " processes\n";
+	}
+	else {
+		std::cerr << " on " << std::max(options.threads, 1u) << " threads, " << symbols / seconds << " symbols/s\n";
+	}
+	std::cerr << "  " << options.count / seconds << " generations/s, "
+		<< bytes / seconds / (1024.0 * 1024.0) << " MiB/s (" << bytes << " bytes)\n";
+	return 0;
+}
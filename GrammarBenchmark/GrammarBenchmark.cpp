@@ -0,0 +1,257 @@
+// GrammarBenchmark.cpp : Times the generation paths of a grammar, optionally with hardware counters.
+//
+// Usage: GrammarBenchmark <grammar file> <rule> [--iterations N] [--repeats N] [--depth N] [--filter name] [--perf]
+//
+// Every benchmark runs once to warm up, then --repeats times; the fastest run is reported.
+// All numbers are per generated symbol, so paths that emit different amounts compare directly.
+// --perf reads cycles, instructions, L1d and LLC misses and branch misses through perf_event_open
+// around every run, on Linux only.
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <functional>
+#include "Grammar.h"
+#include "PerfCounters.h"
+
+struct BenchmarkOptions {
+	std::string grammarFile;
+	std::string rule;
+	unsigned long long iterations{ 10000 };
+	unsigned int repeats{ 5 };
+	int maxDepth{ 0 };
+	std::string filter;
+	bool isPerfEnabled{ false };
+};
+
+// Runs the given number of generations and returns how many symbols they emitted
+struct Benchmark {
+	std::string name;
+	std::function<unsigned long long(unsigned long long)> run;
+};
+
+struct BenchmarkResult {
+	unsigned long long symbols{ 0 };
+	double seconds{ 0.0 };
+	PerfSample perf{};
+};
+
+bool ParseOptions(int argc, char* argv[], BenchmarkOptions& options) {
+
+	for (int arg{ 1 }; arg < argc; ++arg) {
+		const std::string option{ argv[arg] };
+		const bool hasValue{ arg + 1 < argc };
+
+		if (option == "--iterations" && hasValue) {
+			options.iterations = std::max(std::stoull(argv[++arg]), 1ull);
+		}
+		else if (option == "--repeats" && hasValue) {
+			options.repeats = std::max(static_cast<unsigned int>(std::stoul(argv[++arg])), 1u);
+		}
+		else if (option == "--depth" && hasValue) {
+			options.maxDepth = std::stoi(argv[++arg]);
+		}
+		else if (option == "--filter" && hasValue) {
+			options.filter = argv[++arg];
+		}
+		else if (option == "--perf") {
+			options.isPerfEnabled = true;
+		}
+		else if (options.grammarFile.empty()) {
+			options.grammarFile = option;
+		}
+		else if (options.rule.empty()) {
+			options.rule = option;
+		}
+		else {
+			return false;
+		}
+	}
+	return !options.grammarFile.empty() && !options.rule.empty();
+}
+
+BenchmarkResult RunBenchmark(const Benchmark& benchmark, const BenchmarkOptions& options, PerfCounters* pCounters) {
+
+	benchmark.run(std::max(options.iterations / 10, 1ull));
+
+	BenchmarkResult best{};
+	for (unsigned int repeat{ 0 }; repeat < options.repeats; ++repeat) {
+		BenchmarkResult result{};
+
+		if (pCounters) {
+			pCounters->Start();
+		}
+		const auto start{ std::chrono::steady_clock::now() };
+		result.symbols = benchmark.run(options.iterations);
+		const auto end{ std::chrono::steady_clock::now() };
+		if (pCounters) {
+			result.perf = pCounters->Stop();
+		}
+
+		result.seconds = std::chrono::duration<double>(end - start).count();
+		if (repeat == 0 || result.seconds / double(std::max(result.symbols, 1ull)) < best.seconds / double(std::max(best.symbols, 1ull))) {
+			best = result;
+		}
+	}
+	return best;
+}
+
+void PrintHeader(bool isPerfEnabled) {
+
+	std::cout << std::left << std::setw(10) << "benchmark" << std::right << std::setw(12) << "symbols" << std::setw(12) << "ns/symbol" << std::setw(12) << "Msym/s";
+	if (isPerfEnabled) {
+		for (unsigned int event{ 0 }; event < PerfSample::EventCount; ++event) {
+			std::cout << std::setw(15) << GetPerfEventName(static_cast<PerfEvent>(event));
+		}
+		std::cout << std::setw(8) << "IPC";
+	}
+	std::cout << "\n";
+}
+
+void PrintResult(const std::string& name, const BenchmarkResult& result, bool isPerfEnabled) {
+
+	const double symbols{ double(std::max(result.symbols, 1ull)) };
+	std::cout << std::fixed << std::setprecision(2);
+	std::cout << std::left << std::setw(10) << name << std::right << std::setw(12) << result.symbols
+		<< std::setw(12) << result.seconds * 1e9 / symbols << std::setw(12) << symbols / result.seconds / 1e6;
+
+	if (isPerfEnabled) {
+		for (unsigned int event{ 0 }; event < PerfSample::EventCount; ++event) {
+			if (result.perf.isValid[event]) {
+				std::cout << std::setw(15) << result.perf.values[event] / symbols;
+			}
+			else {
+				std::cout << std::setw(15) << "-";
+			}
+		}
+
+		if (result.perf.IsValid(PerfEvent::Cycles) && result.perf.IsValid(PerfEvent::Instructions) && result.perf.Get(PerfEvent::Cycles) > 0.0) {
+			std::cout << std::setw(8) << result.perf.Get(PerfEvent::Instructions) / result.perf.Get(PerfEvent::Cycles);
+		}
+		else {
+			std::cout << std::setw(8) << "-";
+		}
+	}
+	std::cout << "\n";
+}
+
+int main(int argc, char* argv[])
+{
+	BenchmarkOptions options{};
+	if (!ParseOptions(argc, argv, options)) {
+		std::cerr << "Usage: GrammarBenchmark <grammar file> <rule> [--iterations N] [--repeats N] [--depth N] [--filter name] [--perf]\n";
+		return 1;
+	}
+
+	std::ifstream stream{ options.grammarFile };
+	if (!stream) {
+		std::cerr << "Cannot read " << options.grammarFile << "\n";
+		return 1;
+	}
+
+	if (options.maxDepth > 0) {
+		LNode<std::string>::SetDepth(options.maxDepth);
+	}
+
+	Grammar<std::string> grammar{};
+	std::shared_ptr<const CompiledGrammar<std::string>> pCompiled{};
+	RuleId rule{};
+	try {
+		grammar.ParseRules(stream);
+		pCompiled = grammar.Freeze();
+		rule = grammar.Resolve(options.rule);
+	}
+	catch (RuleSyntaxException) {
+		std::cerr << "Syntax error in " << options.grammarFile << "\n";
+		return 1;
+	}
+	catch (Rule404Exception) {
+		std::cerr << "Unknown rule " << options.rule << "\n";
+		return 1;
+	}
+
+	const CompiledGrammar<std::string>& compiled{ *pCompiled };
+	const int maxDepth{ compiled.GetDepth() };
+
+	std::vector<Benchmark> benchmarks{};
+
+	// Node::Parse over the rule tree, every node a virtual call and a pointer hop away
+	benchmarks.push_back(Benchmark{ "tree", [&](unsigned long long iterations) {
+		unsigned long long symbols{ 0 };
+		std::vector<std::string> result{};
+		for (unsigned long long index{ 0 }; index < iterations; ++index) {
+			result.clear();
+			grammar.GenerateSequence(rule, result);
+			symbols += result.size();
+		}
+		return symbols;
+	} });
+
+	// Flat tables, payloads copied out
+	benchmarks.push_back(Benchmark{ "compiled", [&](unsigned long long iterations) {
+		unsigned long long symbols{ 0 };
+		BlockEngine engine{ 0 };
+		std::vector<std::string> result{};
+		for (unsigned long long index{ 0 }; index < iterations; ++index) {
+			result.clear();
+			compiled.GenerateSequence(rule, result, engine, maxDepth);
+			symbols += result.size();
+		}
+		return symbols;
+	} });
+
+	// Flat tables, payload indices only
+	benchmarks.push_back(Benchmark{ "symbols", [&](unsigned long long iterations) {
+		unsigned long long symbols{ 0 };
+		std::vector<unsigned int> result{};
+		for (unsigned long long index{ 0 }; index < iterations; ++index) {
+			result.clear();
+			Xoshiro128 engine{ index };
+			compiled.GenerateSymbols(rule, result, engine, maxDepth);
+			symbols += result.size();
+		}
+		return symbols;
+	} });
+
+	// Seeded batches, shallow finite rules take the lane walk
+	benchmarks.push_back(Benchmark{ "batch", [&](unsigned long long iterations) {
+		constexpr unsigned long long batchSize{ 256 };
+		unsigned long long symbols{ 0 };
+		std::vector<unsigned long long> seeds(batchSize);
+		SymbolBatch batch{};
+		for (unsigned long long first{ 0 }; first < iterations; first += batchSize) {
+			const unsigned long long count{ std::min(batchSize, iterations - first) };
+			for (unsigned long long index{ 0 }; index < count; ++index) {
+				seeds[index] = first + index;
+			}
+			batch.symbols.clear();
+			batch.offsets.clear();
+			compiled.GenerateBatch(rule, seeds.data(), count, batch, maxDepth);
+			symbols += batch.symbols.size();
+		}
+		return symbols;
+	} });
+
+	std::unique_ptr<PerfCounters> pCounters{};
+	if (options.isPerfEnabled) {
+		pCounters = std::make_unique<PerfCounters>();
+		if (!pCounters->IsAvailable()) {
+			std::cerr << "Hardware counters are not available (perf_event_open failed or not Linux), timing only\n";
+			pCounters.reset();
+			options.isPerfEnabled = false;
+		}
+	}
+
+	std::cout << options.rule << ", " << options.iterations << " generations, best of " << options.repeats << "\n";
+	PrintHeader(options.isPerfEnabled);
+	for (const Benchmark& benchmark : benchmarks) {
+		if (!options.filter.empty() && benchmark.name.find(options.filter) == std::string::npos) {
+			continue;
+		}
+		PrintResult(benchmark.name, RunBenchmark(benchmark, options, pCounters.get()), options.isPerfEnabled);
+	}
+	return 0;
+}
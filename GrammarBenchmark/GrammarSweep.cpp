@@ -0,0 +1,314 @@
+// GrammarSweep.cpp : Sweeps synthetic grammars along one shape axis at a time and measures their cost.
+//
+// Usage: GrammarSweep [--axis name] [--depth N] [--seconds F] [--memory] <generator options>
+//
+// Axes: rules, fan-out, sequence, repetition, depth, forward; all of them without --axis.
+// Every other parameter stays at the generator options given. For every point it reports:
+//		load		ParseRules time, which includes every ChangeRule a forward reference causes
+//		freeze		Freeze time of the whole grammar
+//		heap		bytes the grammar and its compiled tables hold, counted by the global allocator
+//		throughput	symbols per second of the tree walk and of symbol mode, from Root
+// With --memory it reports the Grammar::MemoryUsage breakdown per rule instead of the timings,
+// next to the heap bytes per rule counted by the allocator, as a check on the breakdown.
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <functional>
+#include "SyntheticGrammar.h"
+
+//*** ALLOCATION COUNTING ***
+//
+//
+
+namespace
+{
+	std::atomic<long long> g_HeapBytes{ 0 };
+
+	// Room in front of every block for its size, keeps the alignment of malloc
+	constexpr size_t AllocationHeader{ 16 };
+
+	void* CountedAllocate(size_t size) {
+
+		void* pBlock{ std::malloc(size + AllocationHeader) };
+		if (!pBlock) {
+			return nullptr;
+		}
+		*static_cast<size_t*>(pBlock) = size;
+		g_HeapBytes.fetch_add(static_cast<long long>(size), std::memory_order_relaxed);
+		return static_cast<char*>(pBlock) + AllocationHeader;
+	}
+
+	// GCC inlines this into the replaced operator delete and takes the free for a mismatch with
+	// operator new, but the block did come from malloc in CountedAllocate
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+	void CountedFree(void* pMemory) {
+
+		if (!pMemory) {
+			return;
+		}
+		void* pBlock{ static_cast<char*>(pMemory) - AllocationHeader };
+		g_HeapBytes.fetch_sub(static_cast<long long>(*static_cast<size_t*>(pBlock)), std::memory_order_relaxed);
+		std::free(pBlock);
+	}
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic pop
+#endif
+}
+
+void* operator new(size_t size) {
+
+	void* pMemory{ CountedAllocate(size) };
+	if (!pMemory) {
+		throw std::bad_alloc{};
+	}
+	return pMemory;
+}
+
+void* operator new[](size_t size) {
+	return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+	return CountedAllocate(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+	return CountedAllocate(size);
+}
+
+void operator delete(void* pMemory) noexcept {
+	CountedFree(pMemory);
+}
+
+void operator delete[](void* pMemory) noexcept {
+	CountedFree(pMemory);
+}
+
+void operator delete(void* pMemory, size_t) noexcept {
+	CountedFree(pMemory);
+}
+
+void operator delete[](void* pMemory, size_t) noexcept {
+	CountedFree(pMemory);
+}
+
+void operator delete(void* pMemory, const std::nothrow_t&) noexcept {
+	CountedFree(pMemory);
+}
+
+void operator delete[](void* pMemory, const std::nothrow_t&) noexcept {
+	CountedFree(pMemory);
+}
+
+//*** SWEEP ***
+//
+//
+
+struct SweepAxis {
+	std::string name;
+	std::vector<double> values;
+	std::function<void(SyntheticGrammarOptions&, int&, double)> apply;
+};
+
+struct SweepPoint {
+	SyntheticGrammarInfo info{};
+	double loadSeconds{ 0.0 };
+	double freezeSeconds{ 0.0 };
+	long long grammarBytes{ 0 };
+	long long compiledBytes{ 0 };
+	GrammarMemoryUsage usage{};
+	double treeSymbolsPerSecond{ 0.0 };
+	double compiledSymbolsPerSecond{ 0.0 };
+	double symbolsPerGeneration{ 0.0 };
+};
+
+double Elapsed(std::chrono::steady_clock::time_point start) {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Generates for about the given time, returns symbols per second and the mean output size
+template<typename Generate>
+double MeasureThroughput(Generate generate, double seconds, double& symbolsPerGeneration) {
+
+	unsigned long long generations{ 0 };
+	unsigned long long symbols{ 0 };
+	const auto start{ std::chrono::steady_clock::now() };
+	double elapsed{ 0.0 };
+	do {
+		symbols += generate(generations++);
+		elapsed = Elapsed(start);
+	}
+	while (elapsed < seconds);
+
+	symbolsPerGeneration = double(symbols) / double(generations);
+	return double(symbols) / elapsed;
+}
+
+SweepPoint MeasurePoint(const SyntheticGrammarOptions& options, int maxDepth, double seconds, bool isMemoryOnly) {
+
+	SweepPoint point{};
+	std::stringstream text{};
+	point.info = WriteSyntheticGrammar(options, text);
+
+	LNode<std::string>::SetDepth(maxDepth);
+
+	const long long heapBefore{ g_HeapBytes.load() };
+	Grammar<std::string> grammar{};
+
+	auto start{ std::chrono::steady_clock::now() };
+	grammar.ParseRules(text);
+	point.loadSeconds = Elapsed(start);
+	point.grammarBytes = g_HeapBytes.load() - heapBefore;
+
+	start = std::chrono::steady_clock::now();
+	std::shared_ptr<const CompiledGrammar<std::string>> pCompiled{ grammar.Freeze() };
+	point.freezeSeconds = Elapsed(start);
+	point.compiledBytes = g_HeapBytes.load() - heapBefore - point.grammarBytes;
+
+	point.usage = grammar.MemoryUsage();
+	if (isMemoryOnly) {
+		return point;
+	}
+
+	const RuleId root{ grammar.Resolve(point.info.root) };
+	std::vector<std::string> sequence{};
+	point.treeSymbolsPerSecond = MeasureThroughput([&](unsigned long long) {
+		sequence.clear();
+		grammar.GenerateSequence(root, sequence);
+		return sequence.size();
+	}, seconds, point.symbolsPerGeneration);
+
+	std::vector<unsigned int> symbols{};
+	point.compiledSymbolsPerSecond = MeasureThroughput([&](unsigned long long generation) {
+		symbols.clear();
+		Xoshiro128 engine{ generation };
+		pCompiled->GenerateSymbols(root, symbols, engine, maxDepth);
+		return symbols.size();
+	}, seconds, point.symbolsPerGeneration);
+
+	return point;
+}
+
+void PrintHeader() {
+
+	std::cout << std::left << std::setw(12) << "axis" << std::right << std::setw(10) << "value" << std::setw(9) << "rules" << std::setw(9) << "fwd%"
+		<< std::setw(11) << "load ms" << std::setw(11) << "freeze ms" << std::setw(12) << "grammar KB" << std::setw(12) << "compiled KB"
+		<< std::setw(10) << "B/rule" << std::setw(12) << "tree Msym/s" << std::setw(12) << "comp Msym/s" << std::setw(11) << "sym/gen" << "\n";
+}
+
+void PrintMemoryHeader() {
+
+	std::cout << std::left << std::setw(12) << "axis" << std::right << std::setw(10) << "value" << std::setw(9) << "rules"
+		<< std::setw(9) << "nodes" << std::setw(10) << "children" << std::setw(9) << "table" << std::setw(9) << "names" << std::setw(10) << "payloads"
+		<< std::setw(10) << "compiler" << std::setw(10) << "compiled" << std::setw(9) << "total" << std::setw(9) << "heap" << "   (bytes per rule)\n";
+}
+
+void PrintMemoryPoint(const std::string& axis, double value, const SweepPoint& point) {
+
+	const double rules{ double(std::max(point.info.ruleCount, 1u)) };
+	const GrammarMemoryUsage& usage{ point.usage };
+
+	std::cout << std::fixed << std::left << std::setw(12) << axis << std::right << std::setprecision(2) << std::setw(10) << value
+		<< std::setw(9) << point.info.ruleCount << std::setprecision(0)
+		<< std::setw(9) << usage.nodes / rules << std::setw(10) << usage.children / rules << std::setw(9) << usage.ruleTable / rules
+		<< std::setw(9) << usage.ruleNames / rules << std::setw(10) << usage.payloads / rules << std::setw(10) << usage.compiler / rules
+		<< std::setw(10) << usage.compiled / rules << std::setw(9) << usage.GetTotal() / rules
+		<< std::setw(9) << (point.grammarBytes + point.compiledBytes) / rules << "\n";
+}
+
+void PrintPoint(const std::string& axis, double value, const SweepPoint& point) {
+
+	const double rules{ double(std::max(point.info.ruleCount, 1u)) };
+	const double forward{ point.info.references == 0 ? 0.0 : 100.0 * point.info.forwardReferences / point.info.references };
+
+	std::cout << std::fixed << std::left << std::setw(12) << axis << std::right << std::setprecision(2) << std::setw(10) << value
+		<< std::setw(9) << point.info.ruleCount << std::setprecision(1) << std::setw(9) << forward
+		<< std::setprecision(2) << std::setw(11) << point.loadSeconds * 1e3 << std::setw(11) << point.freezeSeconds * 1e3
+		<< std::setprecision(1) << std::setw(12) << point.grammarBytes / 1024.0 << std::setw(12) << point.compiledBytes / 1024.0
+		<< std::setprecision(0) << std::setw(10) << (point.grammarBytes + point.compiledBytes) / rules
+		<< std::setprecision(2) << std::setw(12) << point.treeSymbolsPerSecond / 1e6 << std::setw(12) << point.compiledSymbolsPerSecond / 1e6
+		<< std::setprecision(1) << std::setw(11) << point.symbolsPerGeneration << "\n";
+}
+
+int main(int argc, char* argv[])
+{
+	SyntheticGrammarOptions base{};
+	std::string axisName{};
+	int baseDepth{ 8 };
+	double seconds{ 0.2 };
+	bool isMemoryOnly{ false };
+
+	for (int arg{ 1 }; arg < argc; ++arg) {
+		const std::string option{ argv[arg] };
+		if (option == "--axis" && arg + 1 < argc) {
+			axisName = argv[++arg];
+		}
+		else if (option == "--depth" && arg + 1 < argc) {
+			baseDepth = std::stoi(argv[++arg]);
+		}
+		else if (option == "--seconds" && arg + 1 < argc) {
+			seconds = std::stod(argv[++arg]);
+		}
+		else if (option == "--memory") {
+			isMemoryOnly = true;
+		}
+		else if (!ParseSyntheticGrammarOption(argc, argv, arg, base)) {
+			std::cerr << "Usage: GrammarSweep [--axis rules|fan-out|sequence|repetition|depth|forward] [--depth N] [--seconds F] [--memory]\n"
+				"        " SYNTHETIC_GRAMMAR_USAGE "\n";
+			return 1;
+		}
+	}
+
+	const std::vector<SweepAxis> axes{
+		{ "rules", { 100, 1000, 10000, 30000 }, [](SyntheticGrammarOptions& options, int&, double value) { options.ruleCount = static_cast<unsigned int>(value); } },
+		{ "fan-out", { 2, 4, 8, 16, 32 }, [](SyntheticGrammarOptions& options, int&, double value) { options.fanOut = static_cast<unsigned int>(value); } },
+		{ "sequence", { 2, 3, 4, 6, 8 }, [](SyntheticGrammarOptions& options, int&, double value) { options.sequenceLength = static_cast<unsigned int>(value); } },
+		{ "repetition", { 0.1, 0.3, 0.5, 0.7, 0.9 }, [](SyntheticGrammarOptions& options, int&, double value) { options.repetitionChance = static_cast<float>(value); } },
+		{ "depth", { 2, 4, 8, 16, 32 }, [](SyntheticGrammarOptions&, int& depth, double value) { depth = static_cast<int>(value); } },
+		{ "forward", { 0.0, 0.1, 0.25, 0.5, 1.0 }, [](SyntheticGrammarOptions& options, int&, double value) { options.forwardShare = static_cast<float>(value); } }
+	};
+
+	bool isAxisFound{ axisName.empty() };
+	if (isMemoryOnly) {
+		PrintMemoryHeader();
+	}
+	else {
+		PrintHeader();
+	}
+
+	for (const SweepAxis& axis : axes) {
+		if (!axisName.empty() && axis.name != axisName) {
+			continue;
+		}
+		isAxisFound = true;
+
+		for (double value : axis.values) {
+			SyntheticGrammarOptions options{ base };
+			int maxDepth{ baseDepth };
+			axis.apply(options, maxDepth, value);
+			const SweepPoint point{ MeasurePoint(options, maxDepth, seconds, isMemoryOnly) };
+			if (isMemoryOnly) {
+				PrintMemoryPoint(axis.name, value, point);
+			}
+			else {
+				PrintPoint(axis.name, value, point);
+			}
+		}
+	}
+
+	if (!isAxisFound) {
+		std::cerr << "Unknown axis " << axisName << "\n";
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,51 @@
+// GrammarSynth.cpp : Writes a random grammar with the given shape, for scaling benchmarks.
+//
+// Usage: GrammarSynth [--output path] [--rules N] [--fan-out N] [--sequence N] [--repetition-share F]
+//                     [--repetition-chance F] [--recursion-share F] [--terminal-share F] [--forward F]
+//                     [--terminals N] [--max-size F] [--seed N]
+//
+// The same options and seed give the same grammar on every platform. Generate from Root;
+// recursive rules stop at the LNode depth of whoever loads the grammar.
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include "SyntheticGrammar.h"
+
+int main(int argc, char* argv[])
+{
+	SyntheticGrammarOptions options{};
+	std::string output{ "-" };
+
+	for (int arg{ 1 }; arg < argc; ++arg) {
+		const std::string option{ argv[arg] };
+		if (option == "--output" && arg + 1 < argc) {
+			output = argv[++arg];
+		}
+		else if (!ParseSyntheticGrammarOption(argc, argv, arg, options)) {
+			std::cerr << "Usage: GrammarSynth [--output path] " SYNTHETIC_GRAMMAR_USAGE "\n";
+			return 1;
+		}
+	}
+
+	std::ofstream file{};
+	if (output != "-") {
+		file.open(output, std::ios::binary | std::ios::trunc);
+		if (!file) {
+			std::cerr << "Cannot write " << output << "\n";
+			return 1;
+		}
+	}
+	std::ostream& stream{ output == "-" ? std::cout : file };
+
+	stream << "// GrammarSynth --rules " << options.ruleCount << " --fan-out " << options.fanOut << " --sequence " << options.sequenceLength
+		<< " --repetition-share " << options.repetitionShare << " --repetition-chance " << options.repetitionChance
+		<< " --recursion-share " << options.recursionShare << " --terminal-share " << options.terminalShare
+		<< " --forward " << options.forwardShare << " --terminals " << options.terminalCount << " --max-size " << options.maxExpectedSize
+		<< " --seed " << options.seed << "\n";
+	const SyntheticGrammarInfo info{ WriteSyntheticGrammar(options, stream) };
+
+	std::cerr << info.ruleCount << " rules, " << info.references << " rule references, " << info.forwardReferences << " forward, root " << info.root
+		<< " emits about " << info.expectedSize << " symbols per pass\n";
+	return 0;
+}
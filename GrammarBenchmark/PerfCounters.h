@@ -0,0 +1,172 @@
+#pragma once
+#include <string>
+#include <cstdint>
+
+#if defined(__linux__)
+#include <cstring>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+//*** PERFCOUNTERS ***
+//
+//
+
+enum class PerfEvent : unsigned int {
+	Cycles,
+	Instructions,
+	L1DataMisses,
+	LastLevelMisses,
+	BranchMisses,
+	Count
+};
+
+inline const char* GetPerfEventName(PerfEvent event) {
+
+	switch (event) {
+		case PerfEvent::Cycles:
+			return "cycles";
+		case PerfEvent::Instructions:
+			return "instructions";
+		case PerfEvent::L1DataMisses:
+			return "L1d misses";
+		case PerfEvent::LastLevelMisses:
+			return "LLC misses";
+		case PerfEvent::BranchMisses:
+			return "branch misses";
+		default:
+			return "";
+	}
+}
+
+struct PerfSample {
+	static constexpr unsigned int EventCount{ static_cast<unsigned int>(PerfEvent::Count) };
+
+	double values[EventCount]{};
+	bool isValid[EventCount]{};
+
+	bool IsValid(PerfEvent event) const { return isValid[static_cast<unsigned int>(event)]; }
+	double Get(PerfEvent event) const { return values[static_cast<unsigned int>(event)]; }
+};
+
+// Hardware counters of the calling thread in user space, read through perf_event_open.
+// Events the CPU or kernel does not offer are left out, on other platforms none are available.
+class PerfCounters
+{
+	public:
+		PerfCounters();
+		virtual ~PerfCounters();
+
+		PerfCounters(const PerfCounters&) = delete;
+		PerfCounters(PerfCounters&&) = delete;
+		PerfCounters& operator=(const PerfCounters&) = delete;
+		PerfCounters& operator=(PerfCounters&&) = delete;
+
+		bool IsAvailable() const;
+
+		void Start();
+		// Counts since Start, scaled up when the kernel had to multiplex the counters
+		PerfSample Stop();
+
+	private:
+		int m_Descriptors[PerfSample::EventCount];
+};
+
+#if defined(__linux__)
+
+inline PerfCounters::PerfCounters() {
+
+	const uint64_t cacheL1DataReadMiss{ PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) };
+	const uint32_t types[PerfSample::EventCount]{ PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE };
+	const uint64_t configs[PerfSample::EventCount]{ PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, cacheL1DataReadMiss, PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES };
+
+	// Every event is opened on its own, so one missing event does not take the others down
+	for (unsigned int event{ 0 }; event < PerfSample::EventCount; ++event) {
+		perf_event_attr attributes{};
+		std::memset(&attributes, 0, sizeof(attributes));
+		attributes.size = sizeof(attributes);
+		attributes.type = types[event];
+		attributes.config = configs[event];
+		attributes.disabled = 1;
+		attributes.exclude_kernel = 1;
+		attributes.exclude_hv = 1;
+		attributes.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+		m_Descriptors[event] = static_cast<int>(syscall(__NR_perf_event_open, &attributes, 0, -1, -1, 0));
+	}
+}
+
+inline PerfCounters::~PerfCounters() {
+
+	for (int descriptor : m_Descriptors) {
+		if (descriptor >= 0) {
+			close(descriptor);
+		}
+	}
+}
+
+inline bool PerfCounters::IsAvailable() const {
+
+	for (int descriptor : m_Descriptors) {
+		if (descriptor >= 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+inline void PerfCounters::Start() {
+
+	for (int descriptor : m_Descriptors) {
+		if (descriptor >= 0) {
+			ioctl(descriptor, PERF_EVENT_IOC_RESET, 0);
+			ioctl(descriptor, PERF_EVENT_IOC_ENABLE, 0);
+		}
+	}
+}
+
+inline PerfSample PerfCounters::Stop() {
+
+	for (int descriptor : m_Descriptors) {
+		if (descriptor >= 0) {
+			ioctl(descriptor, PERF_EVENT_IOC_DISABLE, 0);
+		}
+	}
+
+	PerfSample sample{};
+	for (unsigned int event{ 0 }; event < PerfSample::EventCount; ++event) {
+		// value, time enabled, time running
+		uint64_t data[3]{};
+		if (m_Descriptors[event] < 0 || read(m_Descriptors[event], data, sizeof(data)) != static_cast<ssize_t>(sizeof(data)) || data[2] == 0) {
+			continue;
+		}
+		sample.values[event] = double(data[0]) * double(data[1]) / double(data[2]);
+		sample.isValid[event] = true;
+	}
+	return sample;
+}
+
+#else
+
+inline PerfCounters::PerfCounters() {
+
+	for (int& descriptor : m_Descriptors) {
+		descriptor = -1;
+	}
+}
+
+inline PerfCounters::~PerfCounters() {}
+
+inline bool PerfCounters::IsAvailable() const {
+	return false;
+}
+
+inline void PerfCounters::Start() {}
+
+inline PerfSample PerfCounters::Stop() {
+	return PerfSample{};
+}
+
+#endif
@@ -0,0 +1,238 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <ostream>
+#include <sstream>
+#include <algorithm>
+#include "Grammar.h"
+
+//*** SYNTHETICGRAMMAR ***
+//
+//
+
+struct SyntheticGrammarOptions {
+	unsigned int ruleCount{ 1000 };
+	unsigned int fanOut{ 4 };				// Options per select rule
+	unsigned int sequenceLength{ 4 };		// Elements per sequence and recursive rule
+	float repetitionShare{ 0.1f };			// Share of repetition rules
+	float repetitionChance{ 0.3f };			// Chance to repeat once more, on every repetition rule
+	float recursionShare{ 0.02f };			// Share of recursive LNode rules
+	float terminalShare{ 0.3f };			// Share of references that name a terminal
+	float forwardShare{ 0.1f };				// Share of references to a rule defined further down
+	unsigned int terminalCount{ 256 };
+	float maxExpectedSize{ 4096.f };		// Cap on the expected output of a rule, recursion not counted
+	unsigned long long seed{ 0 };
+};
+
+struct SyntheticGrammarInfo {
+	std::string root;
+	unsigned int ruleCount{ 0 };
+	unsigned int references{ 0 };
+	unsigned int forwardReferences{ 0 };
+	float expectedSize{ 0.f };				// Of Root, one pass through every recursive rule
+};
+
+// Writes a random grammar in the rule file syntax, the same for a seed on every platform.
+// Rules get a hidden rank and only reference lower ranks, so apart from the LNode rules that
+// reference themselves no rule can reach itself and every generation stays finite. Nested
+// sequences grow the output exponentially with the rank depth, so the largest references of a
+// rule become terminals until its expected output is under the cap.
+// Rules are written in rank order; the forward share of them is moved to the top in reverse
+// rank order, which makes their references forward references. The last rule, Root, selects
+// among the highest ranked rules.
+inline SyntheticGrammarInfo WriteSyntheticGrammar(const SyntheticGrammarOptions& options, std::ostream& stream) {
+
+	// Rule references point at a lower rank, terminals are referenced by number
+	struct Reference {
+		bool isRule;
+		unsigned int index;
+	};
+
+	Xoshiro128 engine{ options.seed };
+	const unsigned int ruleCount{ std::max(options.ruleCount, 1u) };
+	const unsigned int terminalCount{ std::max(options.terminalCount, 1u) };
+	const float repetitionChance{ std::min(std::max(options.repetitionChance, 0.f), 0.99f) };
+
+	auto chance = [&](float share) { return UniformFloat(engine) < share; };
+	auto weight = [&]() { return 0.1f + 0.9f * UniformFloat(engine); };
+	auto terminal = [&]() { return Reference{ false, UniformInt(engine, terminalCount) }; };
+
+	// Rank order first, placement comes after, so the forward share does not change the rules
+	std::vector<std::string> bodies(ruleCount);
+	std::vector<std::vector<unsigned int>> ruleReferences(ruleCount);
+	std::vector<float> expectedSizes(ruleCount);
+
+	auto sizeOf = [&](const Reference& reference) { return reference.isRule ? expectedSizes[reference.index] : 1.f; };
+	auto nameOf = [&](const Reference& reference) { return (reference.isRule ? "R" : "t") + std::to_string(reference.index); };
+
+	// Sum of the references times the factor, after trimming the largest ones down to the cap
+	auto trim = [&](std::vector<Reference>& references, float factor) {
+		while (true) {
+			float sum{ 0.f };
+			Reference* pLargest{ nullptr };
+			for (Reference& reference : references) {
+				sum += sizeOf(reference);
+				if (reference.isRule && (!pLargest || sizeOf(reference) > sizeOf(*pLargest))) {
+					pLargest = &reference;
+				}
+			}
+			if (sum * factor <= options.maxExpectedSize || !pLargest) {
+				return sum * factor;
+			}
+			*pLargest = terminal();
+		}
+	};
+
+	for (unsigned int rank{ 0 }; rank < ruleCount; ++rank) {
+		const std::string name{ "R" + std::to_string(rank) };
+
+		auto draw = [&](unsigned int count) {
+			std::vector<Reference> references{};
+			for (unsigned int index{ 0 }; index < count; ++index) {
+				references.push_back(rank == 0 || chance(options.terminalShare) ? terminal() : Reference{ true, UniformInt(engine, rank) });
+			}
+			return references;
+		};
+
+		std::ostringstream body{};
+		std::vector<Reference> references{};
+		const float kind{ UniformFloat(engine) };
+
+		if (kind < options.recursionShare) {
+			// Fallback -> self & others, the fallback is the rule name as a terminal
+			references = draw(std::max(options.sequenceLength, 2u) - 1);
+			expectedSizes[rank] = trim(references, 1.f) + 1.f;
+			body << name << LND_DEL << name;
+			for (const Reference& reference : references) {
+				body << SEQ_DEL << nameOf(reference);
+			}
+		}
+		else if (kind < options.recursionShare + options.repetitionShare) {
+			references = draw(1);
+			expectedSizes[rank] = trim(references, 1.f / (1.f - repetitionChance));
+			body << nameOf(references[0]) << REP_DEL << repetitionChance;
+		}
+		else if (UniformFloat(engine) < 0.5f) {
+			// A single option has no delimiter, it would read as an alias
+			references = draw(std::max(options.fanOut, 2u));
+			float weightsSum{ 0.f };
+			float weightedSize{ 0.f };
+			for (size_t option{ 0 }; option < references.size(); ++option) {
+				const float optionWeight{ weight() };
+				weightsSum += optionWeight;
+				weightedSize += optionWeight * sizeOf(references[option]);
+				body << (option > 0 ? SEL_DEL : "") << optionWeight << " " << nameOf(references[option]);
+			}
+			expectedSizes[rank] = weightedSize / weightsSum;
+		}
+		else {
+			references = draw(std::max(options.sequenceLength, 2u));
+			expectedSizes[rank] = trim(references, 1.f);
+			for (size_t element{ 0 }; element < references.size(); ++element) {
+				body << (element > 0 ? SEQ_DEL : "") << nameOf(references[element]);
+			}
+		}
+
+		for (const Reference& reference : references) {
+			if (reference.isRule) {
+				ruleReferences[rank].push_back(reference.index);
+			}
+		}
+		bodies[rank] = body.str();
+	}
+
+	std::vector<unsigned int> order{};
+	std::vector<bool> isMoved(ruleCount);
+	for (unsigned int rank{ ruleCount }; rank-- > 0;) {
+		isMoved[rank] = chance(options.forwardShare);
+		if (isMoved[rank]) {
+			order.push_back(rank);
+		}
+	}
+	for (unsigned int rank{ 0 }; rank < ruleCount; ++rank) {
+		if (!isMoved[rank]) {
+			order.push_back(rank);
+		}
+	}
+
+	SyntheticGrammarInfo info{};
+	info.root = "Root";
+	info.ruleCount = ruleCount + 1;
+
+	std::vector<unsigned int> positions(ruleCount);
+	for (unsigned int position{ 0 }; position < ruleCount; ++position) {
+		positions[order[position]] = position;
+	}
+
+	for (unsigned int rank : order) {
+		stream << "R" << rank << DEF_DEL << bodies[rank] << "\n";
+		for (unsigned int target : ruleReferences[rank]) {
+			++info.references;
+			info.forwardReferences += positions[target] > positions[rank];
+		}
+	}
+
+	// Root picks one of the top rules, or R0 twice when there is only one
+	stream << info.root << DEF_DEL;
+	const unsigned int rootOptions{ std::max(std::min(options.fanOut, ruleCount), 2u) };
+	for (unsigned int option{ 0 }; option < rootOptions; ++option) {
+		const unsigned int rank{ option < ruleCount ? ruleCount - 1 - option : 0 };
+		stream << (option > 0 ? SEL_DEL : "") << "1 R" << rank;
+		info.expectedSize += expectedSizes[rank] / float(rootOptions);
+	}
+	stream << "\n";
+	return info;
+}
+
+// Consumes one of the generator options at argv[arg], returns false when it is not one of them
+inline bool ParseSyntheticGrammarOption(int argc, char* argv[], int& arg, SyntheticGrammarOptions& options) {
+
+	const std::string option{ argv[arg] };
+	if (arg + 1 >= argc) {
+		return false;
+	}
+
+	const char* value{ argv[arg + 1] };
+	if (option == "--rules") {
+		options.ruleCount = static_cast<unsigned int>(std::stoul(value));
+	}
+	else if (option == "--fan-out") {
+		options.fanOut = static_cast<unsigned int>(std::stoul(value));
+	}
+	else if (option == "--sequence") {
+		options.sequenceLength = static_cast<unsigned int>(std::stoul(value));
+	}
+	else if (option == "--repetition-share") {
+		options.repetitionShare = std::stof(value);
+	}
+	else if (option == "--repetition-chance") {
+		options.repetitionChance = std::stof(value);
+	}
+	else if (option == "--recursion-share") {
+		options.recursionShare = std::stof(value);
+	}
+	else if (option == "--terminal-share") {
+		options.terminalShare = std::stof(value);
+	}
+	else if (option == "--forward") {
+		options.forwardShare = std::stof(value);
+	}
+	else if (option == "--terminals") {
+		options.terminalCount = static_cast<unsigned int>(std::stoul(value));
+	}
+	else if (option == "--max-size") {
+		options.maxExpectedSize = std::stof(value);
+	}
+	else if (option == "--seed") {
+		options.seed = std::stoull(value);
+	}
+	else {
+		return false;
+	}
+
+	++arg;
+	return true;
+}
+
+#define SYNTHETIC_GRAMMAR_USAGE "[--rules N] [--fan-out N] [--sequence N] [--repetition-share F] [--repetition-chance F]\n" \
+	"        [--recursion-share F] [--terminal-share F] [--forward F] [--terminals N] [--max-size F] [--seed N]"
@@ -0,0 +1,150 @@
+// DaemonBenchmark.cpp : Measures throughput and latency of a running GrammarDaemon.
+//
+// Usage: DaemonBenchmark <socket> <rule> [--clients N] [--requests N] [--count N] [--depth N]
+//
+// Every client holds its own connection and sends its requests back to back.
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include "DaemonProtocol.h"
+
+struct ClientResult {
+	std::vector<double> latencies;
+	unsigned long long symbols{ 0 };
+	bool isFailed{ false };
+};
+
+bool ResolveRule(SocketHandle handle, const std::string& name, unsigned int& rule) {
+
+	DaemonRequest request{ DaemonOp::Resolve, 0, 0, 0, 0, 0, static_cast<unsigned int>(name.size()) };
+	DaemonResponse response{};
+	if (!WriteAll(handle, &request, sizeof(request)) || !WriteAll(handle, name.data(), name.size())
+		|| !ReadAll(handle, &response, sizeof(response)) || response.status != DaemonStatus::Ok) {
+		return false;
+	}
+
+	rule = response.count;
+	return true;
+}
+
+void RunClient(const std::string& socketPath, unsigned int rule, unsigned int clientIndex, unsigned int requests, unsigned int count, int maxDepth, ClientResult& result) {
+
+	SocketHandle handle{ ConnectSocket(socketPath) };
+	if (handle == INVALID_SOCKET_HANDLE) {
+		result.isFailed = true;
+		return;
+	}
+
+	std::vector<unsigned int> buffer;
+	for (unsigned int index{ 0 }; index < requests; ++index) {
+		const unsigned long long seed{ (static_cast<unsigned long long>(clientIndex) << 32) + static_cast<unsigned long long>(index) * count };
+		DaemonRequest request{ DaemonOp::Generate, index, rule, count, seed, maxDepth, 0 };
+		DaemonResponse response{};
+
+		const auto start{ std::chrono::steady_clock::now() };
+		if (!WriteAll(handle, &request, sizeof(request)) || !ReadAll(handle, &response, sizeof(response)) || response.status != DaemonStatus::Ok) {
+			result.isFailed = true;
+			break;
+		}
+		buffer.resize(response.count + 1 + response.symbolCount);
+		if (!ReadAll(handle, buffer.data(), buffer.size() * sizeof(unsigned int))) {
+			result.isFailed = true;
+			break;
+		}
+		const auto end{ std::chrono::steady_clock::now() };
+
+		result.latencies.push_back(std::chrono::duration<double, std::micro>(end - start).count());
+		result.symbols += response.symbolCount;
+	}
+	CloseSocket(handle);
+}
+
+double Percentile(const std::vector<double>& sorted, double fraction) {
+
+	if (sorted.empty()) {
+		return 0.0;
+	}
+	size_t index{ static_cast<size_t>(fraction * (sorted.size() - 1) + 0.5) };
+	return sorted[index];
+}
+
+int main(int argc, char* argv[])
+{
+	std::string socketPath;
+	std::string ruleName;
+	unsigned int clients{ 8 };
+	unsigned int requests{ 1000 };
+	unsigned int count{ 16 };
+	int maxDepth{ 0 };
+
+	for (int arg{ 1 }; arg < argc; ++arg) {
+		std::string option{ argv[arg] };
+		if (option == "--clients" && arg + 1 < argc) {
+			clients = static_cast<unsigned int>(std::stoul(argv[++arg]));
+		}
+		else if (option == "--requests" && arg + 1 < argc) {
+			requests = static_cast<unsigned int>(std::stoul(argv[++arg]));
+		}
+		else if (option == "--count" && arg + 1 < argc) {
+			count = static_cast<unsigned int>(std::stoul(argv[++arg]));
+		}
+		else if (option == "--depth" && arg + 1 < argc) {
+			maxDepth = std::stoi(argv[++arg]);
+		}
+		else if (socketPath.empty()) {
+			socketPath = option;
+		}
+		else {
+			ruleName = option;
+		}
+	}
+
+	if (socketPath.empty() || ruleName.empty()) {
+		std::cerr << "Usage: DaemonBenchmark <socket> <rule> [--clients N] [--requests N] [--count N] [--depth N]\n";
+		return 1;
+	}
+
+	StartSockets();
+	unsigned int rule{ 0 };
+	{
+		SocketHandle handle{ ConnectSocket(socketPath) };
+		if (handle == INVALID_SOCKET_HANDLE || !ResolveRule(handle, ruleName, rule)) {
+			std::cerr << "Cannot resolve " << ruleName << " on " << socketPath << "\n";
+			return 1;
+		}
+		CloseSocket(handle);
+	}
+
+	std::vector<ClientResult> results(clients);
+	std::vector<std::thread> threads;
+	const auto start{ std::chrono::steady_clock::now() };
+	for (unsigned int client{ 0 }; client < clients; ++client) {
+		threads.emplace_back(RunClient, socketPath, rule, client, requests, count, maxDepth, std::ref(results[client]));
+	}
+	for (std::thread& thread : threads) {
+		thread.join();
+	}
+	const double seconds{ std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() };
+
+	std::vector<double> latencies;
+	unsigned long long symbols{ 0 };
+	for (const ClientResult& result : results) {
+		if (result.isFailed) {
+			std::cerr << "A client lost its connection\n";
+		}
+		latencies.insert(latencies.end(), result.latencies.begin(), result.latencies.end());
+		symbols += result.symbols;
+	}
+	std::sort(latencies.begin(), latencies.end());
+
+	const double generations{ double(latencies.size()) * count };
+	std::cout << "Requests:     " << latencies.size() << " in " << seconds << " s\n";
+	std::cout << "Throughput:   " << latencies.size() / seconds << " requests/s, " << generations / seconds << " generations/s, " << symbols / seconds << " symbols/s\n";
+	std::cout << "Latency (us): p50 " << Percentile(latencies, 0.5) << ", p99 " << Percentile(latencies, 0.99) << ", p999 " << Percentile(latencies, 0.999)
+		<< ", max " << (latencies.empty() ? 0.0 : latencies.back()) << "\n";
+	return 0;
+}
@@ -0,0 +1,158 @@
+#pragma once
+#include <string>
+#include <cstring>
+
+#if defined(_WIN32)
+#include <winsock2.h>
+#include <afunix.h>
+#pragma comment(lib, "Ws2_32.lib")
+#else
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+// Binary protocol of the generation daemon, all fields are little endian.
+//
+// Every request starts with a DaemonRequest:
+//		resolve:	followed by nameLength bytes of rule name, answered with the rule in count
+//		symbols:	answered with symbolCount entries of [uint32 length][bytes]
+//		generate:	count generations of rule with seeds seed, seed + 1, ...
+//					answered with count + 1 uint32 offsets and symbolCount uint32 symbols
+//
+// Names longer than DaemonMaxNameLength and counts above DaemonMaxCount are answered with
+// BadRequest, a name that is too long also closes the connection.
+
+enum class DaemonOp : unsigned int {
+	Resolve = 1,
+	Symbols = 2,
+	Generate = 3
+};
+
+enum class DaemonStatus : int {
+	Ok = 0,
+	UnknownRule = 1,
+	BadRequest = 2,
+	Internal = 3		// The request failed inside the daemon, for example out of memory
+};
+
+constexpr unsigned int DaemonMaxNameLength{ 1024 };
+constexpr unsigned int DaemonMaxCount{ 65536 };
+
+struct DaemonRequest {
+	DaemonOp op;
+	unsigned int id;
+	unsigned int rule;
+	unsigned int count;
+	unsigned long long seed;
+	int maxDepth;			// 0 uses the depth the grammar was frozen with
+	unsigned int nameLength;
+};
+
+struct DaemonResponse {
+	unsigned int id;
+	DaemonStatus status;
+	unsigned int count;
+	unsigned int symbolCount;
+};
+
+//*** SOCKETS ***
+//
+//
+
+#if defined(_WIN32)
+using SocketHandle = SOCKET;
+#define INVALID_SOCKET_HANDLE INVALID_SOCKET
+#define SEND_FLAGS 0
+#else
+using SocketHandle = int;
+#define INVALID_SOCKET_HANDLE -1
+#define SEND_FLAGS MSG_NOSIGNAL
+#endif
+
+inline void StartSockets() {
+#if defined(_WIN32)
+	WSADATA data{};
+	WSAStartup(MAKEWORD(2, 2), &data);
+#endif
+}
+
+inline void CloseSocket(SocketHandle handle) {
+#if defined(_WIN32)
+	closesocket(handle);
+#else
+	close(handle);
+#endif
+}
+
+inline bool ReadAll(SocketHandle handle, void* pBuffer, size_t size) {
+
+	char* pBytes{ static_cast<char*>(pBuffer) };
+	while (size > 0) {
+		int received{ int(recv(handle, pBytes, int(size), 0)) };
+		if (received <= 0) {
+			return false;
+		}
+		pBytes += received;
+		size -= size_t(received);
+	}
+	return true;
+}
+
+inline bool WriteAll(SocketHandle handle, const void* pBuffer, size_t size) {
+
+	const char* pBytes{ static_cast<const char*>(pBuffer) };
+	while (size > 0) {
+		int sent{ int(send(handle, pBytes, int(size), SEND_FLAGS)) };
+		if (sent <= 0) {
+			return false;
+		}
+		pBytes += sent;
+		size -= size_t(sent);
+	}
+	return true;
+}
+
+inline sockaddr_un SocketAddress(const std::string& path) {
+
+	sockaddr_un address{};
+	address.sun_family = AF_UNIX;
+	std::strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+	return address;
+}
+
+inline SocketHandle ListenSocket(const std::string& path) {
+
+	SocketHandle handle{ socket(AF_UNIX, SOCK_STREAM, 0) };
+	if (handle == INVALID_SOCKET_HANDLE) {
+		return INVALID_SOCKET_HANDLE;
+	}
+
+#if defined(_WIN32)
+	DeleteFileA(path.c_str());
+#else
+	unlink(path.c_str());
+#endif
+
+	sockaddr_un address{ SocketAddress(path) };
+	if (bind(handle, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(handle, SOMAXCONN) != 0) {
+		CloseSocket(handle);
+		return INVALID_SOCKET_HANDLE;
+	}
+	return handle;
+}
+
+inline SocketHandle ConnectSocket(const std::string& path) {
+
+	SocketHandle handle{ socket(AF_UNIX, SOCK_STREAM, 0) };
+	if (handle == INVALID_SOCKET_HANDLE) {
+		return INVALID_SOCKET_HANDLE;
+	}
+
+	sockaddr_un address{ SocketAddress(path) };
+	if (connect(handle, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+		CloseSocket(handle);
+		return INVALID_SOCKET_HANDLE;
+	}
+	return handle;
+}
@@ -0,0 +1,338 @@
+// GrammarDaemon.cpp : Serves generations of compiled grammars over a local socket.
+//
+// Usage: GrammarDaemon <socket> <grammar file>... [--depth N] [--threads N] [--window-us N] [--max-batch N]
+//
+// Generate requests that arrive within the batching window are grouped per rule and depth,
+// generated as one batch on the thread pool and split back into their responses.
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <thread>
+#include <mutex>
+#include <future>
+#include <chrono>
+#include <condition_variable>
+#include "Grammar.h"
+#include "DaemonProtocol.h"
+
+//*** BATCHER ***
+//
+//
+
+struct PendingGeneration {
+	RuleId rule;
+	unsigned long long seed;
+	unsigned int count;
+	int maxDepth;
+	std::promise<SymbolBatch> result;
+};
+
+class GenerationBatcher
+{
+	public:
+		GenerationBatcher(std::shared_ptr<const CompiledGrammar<std::string>> pGrammar, unsigned int threadCount, std::chrono::microseconds window, size_t maxBatch);
+		virtual ~GenerationBatcher();
+
+		GenerationBatcher(const GenerationBatcher&) = delete;
+		GenerationBatcher(GenerationBatcher&&) = delete;
+		GenerationBatcher& operator=(const GenerationBatcher&) = delete;
+		GenerationBatcher& operator=(GenerationBatcher&&) = delete;
+
+		std::future<SymbolBatch> Submit(RuleId rule, unsigned long long seed, unsigned int count, int maxDepth);
+
+	private:
+		std::shared_ptr<const CompiledGrammar<std::string>> m_pGrammar;
+		ThreadPool m_Pool;
+		std::chrono::microseconds m_Window;
+		size_t m_MaxBatch;
+
+		std::deque<PendingGeneration> m_Pending;
+		size_t m_PendingCount{ 0 };
+		std::mutex m_Mutex;
+		std::condition_variable m_Condition;
+		bool m_IsStopping{ false };
+		std::thread m_Dispatcher;
+
+		void Dispatch();
+		void Generate(std::vector<PendingGeneration*>& group);
+};
+
+GenerationBatcher::GenerationBatcher(std::shared_ptr<const CompiledGrammar<std::string>> pGrammar, unsigned int threadCount, std::chrono::microseconds window, size_t maxBatch)
+	: m_pGrammar{ pGrammar }
+	, m_Pool{ threadCount }
+	, m_Window{ window }
+	, m_MaxBatch{ maxBatch }
+	, m_Dispatcher{ &GenerationBatcher::Dispatch, this }
+{}
+
+GenerationBatcher::~GenerationBatcher() {
+
+	{
+		std::lock_guard<std::mutex> lock{ m_Mutex };
+		m_IsStopping = true;
+	}
+	m_Condition.notify_all();
+	m_Dispatcher.join();
+}
+
+std::future<SymbolBatch> GenerationBatcher::Submit(RuleId rule, unsigned long long seed, unsigned int count, int maxDepth) {
+
+	std::future<SymbolBatch> future;
+	{
+		std::lock_guard<std::mutex> lock{ m_Mutex };
+		m_Pending.push_back(PendingGeneration{ rule, seed, count, maxDepth, std::promise<SymbolBatch>{} });
+		future = m_Pending.back().result.get_future();
+		m_PendingCount += count;
+	}
+	m_Condition.notify_all();
+	return future;
+}
+
+void GenerationBatcher::Dispatch() {
+
+	while (true) {
+		std::deque<PendingGeneration> batch;
+		{
+			// Wait for a first request, then give others the window to join it
+			std::unique_lock<std::mutex> lock{ m_Mutex };
+			m_Condition.wait(lock, [this]() { return m_IsStopping || !m_Pending.empty(); });
+			if (m_Pending.empty()) {
+				return;
+			}
+
+			const auto deadline{ std::chrono::steady_clock::now() + m_Window };
+			m_Condition.wait_until(lock, deadline, [this]() { return m_IsStopping || m_PendingCount >= m_MaxBatch; });
+
+			batch.swap(m_Pending);
+			m_PendingCount = 0;
+		}
+
+		// Group requests for the same rule and depth into one generation batch
+		std::map<std::pair<unsigned int, int>, std::vector<PendingGeneration*>> groups;
+		for (PendingGeneration& pending : batch) {
+			groups[{ pending.rule.index, pending.maxDepth }].push_back(&pending);
+		}
+		for (auto& group : groups) {
+			Generate(group.second);
+		}
+	}
+}
+
+void GenerationBatcher::Generate(std::vector<PendingGeneration*>& group) {
+
+	std::vector<unsigned long long> seeds;
+	for (PendingGeneration* pPending : group) {
+		for (unsigned int index{ 0 }; index < pPending->count; ++index) {
+			seeds.push_back(pPending->seed + index);
+		}
+	}
+
+	SymbolBatch batch;
+	try {
+		m_pGrammar->GenerateBatch(m_Pool, group.front()->rule, seeds.data(), seeds.size(), batch, group.front()->maxDepth);
+	}
+	catch (...) {
+		for (PendingGeneration* pPending : group) {
+			pPending->result.set_exception(std::current_exception());
+		}
+		return;
+	}
+
+	// Hand every request its own slice of the batch
+	size_t generation{ 0 };
+	for (PendingGeneration* pPending : group) {
+		SymbolBatch result;
+		const size_t first{ batch.offsets[generation] };
+		const size_t last{ batch.offsets[generation + pPending->count] };
+		result.symbols.assign(batch.symbols.begin() + first, batch.symbols.begin() + last);
+		for (unsigned int index{ 0 }; index <= pPending->count; ++index) {
+			result.offsets.push_back(batch.offsets[generation + index] - first);
+		}
+		generation += pPending->count;
+
+		pPending->result.set_value(std::move(result));
+	}
+}
+
+//*** CONNECTIONS ***
+//
+//
+
+bool SendResponse(SocketHandle client, unsigned int id, DaemonStatus status) {
+
+	DaemonResponse response{ id, status, 0, 0 };
+	return WriteAll(client, &response, sizeof(response));
+}
+
+bool HandleResolve(SocketHandle client, const DaemonRequest& request, const CompiledGrammar<std::string>& grammar) {
+
+	// The name isn't read, the connection can't be used anymore
+	if (request.nameLength > DaemonMaxNameLength) {
+		SendResponse(client, request.id, DaemonStatus::BadRequest);
+		return false;
+	}
+
+	std::string name(request.nameLength, '\0');
+	if (!ReadAll(client, &name[0], name.size())) {
+		return false;
+	}
+
+	try {
+		DaemonResponse response{ request.id, DaemonStatus::Ok, grammar.Resolve(name).index, 0 };
+		return WriteAll(client, &response, sizeof(response));
+	}
+	catch (Rule404Exception) {
+		return SendResponse(client, request.id, DaemonStatus::UnknownRule);
+	}
+}
+
+bool HandleSymbols(SocketHandle client, const DaemonRequest& request, const CompiledGrammar<std::string>& grammar) {
+
+	std::string buffer;
+	for (unsigned int symbol{ 0 }; symbol < grammar.GetSymbolCount(); ++symbol) {
+		const std::string& data{ grammar.GetSymbol(symbol) };
+		unsigned int length{ static_cast<unsigned int>(data.size()) };
+		buffer.append(reinterpret_cast<const char*>(&length), sizeof(length));
+		buffer.append(data);
+	}
+
+	DaemonResponse response{ request.id, DaemonStatus::Ok, 0, static_cast<unsigned int>(grammar.GetSymbolCount()) };
+	return WriteAll(client, &response, sizeof(response)) && WriteAll(client, buffer.data(), buffer.size());
+}
+
+bool HandleGenerate(SocketHandle client, const DaemonRequest& request, const CompiledGrammar<std::string>& grammar, GenerationBatcher& batcher) {
+
+	if (request.count > DaemonMaxCount) {
+		return SendResponse(client, request.id, DaemonStatus::BadRequest);
+	}
+
+	const int maxDepth{ request.maxDepth > 0 ? request.maxDepth : grammar.GetDepth() };
+
+	SymbolBatch batch;
+	try {
+		batch = batcher.Submit(RuleId{ request.rule }, request.seed, request.count, maxDepth).get();
+	}
+	catch (Rule404Exception) {
+		return SendResponse(client, request.id, DaemonStatus::UnknownRule);
+	}
+	// Only this request failed, the daemon and its other clients carry on
+	catch (...) {
+		return SendResponse(client, request.id, DaemonStatus::Internal);
+	}
+
+	std::vector<unsigned int> offsets(batch.offsets.begin(), batch.offsets.end());
+	DaemonResponse response{ request.id, DaemonStatus::Ok, request.count, static_cast<unsigned int>(batch.symbols.size()) };
+	return WriteAll(client, &response, sizeof(response))
+		&& WriteAll(client, offsets.data(), offsets.size() * sizeof(unsigned int))
+		&& WriteAll(client, batch.symbols.data(), batch.symbols.size() * sizeof(unsigned int));
+}
+
+void HandleClient(SocketHandle client, std::shared_ptr<const CompiledGrammar<std::string>> pGrammar, GenerationBatcher& batcher) {
+
+	DaemonRequest request{};
+	bool isConnected{ true };
+	while (isConnected && ReadAll(client, &request, sizeof(request))) {
+		switch (request.op) {
+			case DaemonOp::Resolve:
+				isConnected = HandleResolve(client, request, *pGrammar);
+				break;
+			case DaemonOp::Symbols:
+				isConnected = HandleSymbols(client, request, *pGrammar);
+				break;
+			case DaemonOp::Generate:
+				isConnected = HandleGenerate(client, request, *pGrammar, batcher);
+				break;
+			default:
+				SendResponse(client, request.id, DaemonStatus::BadRequest);
+				isConnected = false;
+				break;
+		}
+	}
+	CloseSocket(client);
+}
+
+//*** MAIN ***
+//
+//
+
+int main(int argc, char* argv[])
+{
+	std::string socketPath;
+	std::vector<std::string> grammarFiles;
+	int maxDepth{ 0 };
+	unsigned int threadCount{ std::thread::hardware_concurrency() };
+	long long window{ 200 };
+	size_t maxBatch{ 4096 };
+
+	for (int arg{ 1 }; arg < argc; ++arg) {
+		std::string option{ argv[arg] };
+		if (option == "--depth" && arg + 1 < argc) {
+			maxDepth = std::stoi(argv[++arg]);
+		}
+		else if (option == "--threads" && arg + 1 < argc) {
+			threadCount = static_cast<unsigned int>(std::stoul(argv[++arg]));
+		}
+		else if (option == "--window-us" && arg + 1 < argc) {
+			window = std::stoll(argv[++arg]);
+		}
+		else if (option == "--max-batch" && arg + 1 < argc) {
+			maxBatch = std::stoull(argv[++arg]);
+		}
+		else if (socketPath.empty()) {
+			socketPath = option;
+		}
+		else {
+			grammarFiles.push_back(option);
+		}
+	}
+
+	if (socketPath.empty() || grammarFiles.empty()) {
+		std::cerr << "Usage: GrammarDaemon <socket> <grammar file>... [--depth N] [--threads N] [--window-us N] [--max-batch N]\n";
+		return 1;
+	}
+
+	// Load every grammar file into one grammar, rules may refer across files
+	Grammar<std::string> grammar{};
+	for (const std::string& file : grammarFiles) {
+		std::ifstream stream{ file };
+		if (!stream) {
+			std::cerr << "Cannot open " << file << "\n";
+			return 1;
+		}
+
+		try {
+			grammar.ParseRules(stream);
+		}
+		catch (RuleSyntaxException) {
+			std::cerr << "Syntax error in " << file << "\n";
+			return 1;
+		}
+	}
+
+	if (maxDepth > 0) {
+		LNode<std::string>::SetDepth(maxDepth);
+	}
+	std::shared_ptr<const CompiledGrammar<std::string>> pGrammar{ grammar.Freeze() };
+
+	StartSockets();
+	SocketHandle server{ ListenSocket(socketPath) };
+	if (server == INVALID_SOCKET_HANDLE) {
+		std::cerr << "Cannot listen on " << socketPath << "\n";
+		return 1;
+	}
+
+	GenerationBatcher batcher{ pGrammar, threadCount, std::chrono::microseconds{ window }, maxBatch };
+	std::cout << "Serving " << pGrammar->GetSymbolCount() << " symbols on " << socketPath << "\n";
+
+	while (true) {
+		SocketHandle client{ accept(server, nullptr, nullptr) };
+		if (client == INVALID_SOCKET_HANDLE) {
+			continue;
+		}
+		std::thread{ HandleClient, client, pGrammar, std::ref(batcher) }.detach();
+	}
+}
@@ -8,13 +8,14 @@
 
 Application::Application() 
 	: m_Fern{ new Grammar<std::function<void()>>}
+	, m_Tree{ new Grammar<std::function<void()>>}
 {
 
 	m_Fern->AddLeaveNode("F", [&]() {
 		endPos.x = currentPos.x + segmentLength * cosf(currentAngle);
 		endPos.y = currentPos.y - segmentLength * sinf(currentAngle);
 
-		ENGINE->DrawLine(currentPos, endPos);
+		m_Segments.push_back(Segment{ currentPos, endPos, 1.0f });
 		currentPos = endPos;
 	});
 
@@ -27,28 +28,62 @@ Application::Application()
 	});
 
 	m_Fern->AddLeaveNode("[", [&]() {
-		savedPos.push_back(currentPos);
-		savedAngle.push_back(currentAngle);
+		m_Saved.Push(TurtleState{ currentPos, currentAngle });
 	});
 
 	m_Fern->AddLeaveNode("]", [&]() {
-		currentPos = *(savedPos.end() - 1);
-		currentAngle = *(savedAngle.end() - 1);
-		savedPos.pop_back();
-		savedAngle.pop_back();
+		const TurtleState& saved{ m_Saved.Pop() };
+		currentPos = saved.position;
+		currentAngle = saved.angle;
 	});
 
 	m_Fern->AddLeaveNode("X", [&]() {});
 
 	m_Fern->ParseRule("X", "X -> F & + & [ & [ & X & ] & - & X & ] & - & F & [ & - & F & X & ] & + & X");
 	m_Fern->ParseRule("F", "F -> F & F");
+
+	m_Tree->AddLeaveNode("F", [&]() { m_Turtle.Forward(); });
+	m_Tree->AddLeaveNode("+", [&]() { m_Turtle.TurnLeft(); });
+	m_Tree->AddLeaveNode("-", [&]() { m_Turtle.TurnRight(); });
+	m_Tree->AddLeaveNode("^", [&]() { m_Turtle.PitchUp(); });
+	m_Tree->AddLeaveNode("v", [&]() { m_Turtle.PitchDown(); });
+	m_Tree->AddLeaveNode("<", [&]() { m_Turtle.RollLeft(); });
+	m_Tree->AddLeaveNode(">", [&]() { m_Turtle.RollRight(); });
+	m_Tree->AddLeaveNode("[", [&]() { m_Turtle.Push(); });
+	m_Tree->AddLeaveNode("]", [&]() { m_Turtle.Pop(); });
+	m_Tree->AddLeaveNode("A", [&]() {});
+
+	m_Tree->ParseRule("Branch", "[ & v & v & A & ]");
+	m_Tree->ParseRule("A", "A -> F & Branch & > & Branch & > & + & Branch");
+	m_Tree->ParseRule("F", "F -> F & F");
 }
 
 Application::~Application() {
+	m_Exporter.Cancel();
+	if (m_ExportThread.joinable()) {
+		m_ExportThread.join();
+	}
 
+	delete m_Fern;
+	delete m_Tree;
 }
 
 void Application::Update(float elapsedSec) {
+	const bool isTogglePressed{ (GetAsyncKeyState('T') & 0x8000) != 0 };
+	if (isTogglePressed && !m_WasTogglePressed) {
+		m_Is3D = !m_Is3D;
+		m_GeneratedDepth = -1;
+	}
+	m_WasTogglePressed = isTogglePressed;
+
+	const bool isExportPressed{ (GetAsyncKeyState('E') & 0x8000) != 0 };
+	if (isExportPressed && !m_WasExportPressed && !m_IsExporting) {
+		StartExport();
+	}
+	m_WasExportPressed = isExportPressed;
+
+	m_ViewAngle += m_ViewSpeed * elapsedSec;
+
 	m_DepthTimer += elapsedSec;
 	if (m_DepthTimer > m_MaxDepthTimer) {
 		m_Depth++;
@@ -56,28 +91,108 @@ void Application::Update(float elapsedSec) {
 		m_DepthTimer -= m_MaxDepthTimer;
 	}
 
+	if (m_GeneratedDepth != m_Depth) {
+		Generate();
+	}
 }
 
-void Application::Paint() {
+void Application::Generate() {
 
-		ENGINE->ClearBackground();
+		if (m_Is3D) {
+			Generate3D();
+			return;
+		}
 
 		// Generate action vector
 		LNode< std::function<void()>>::SetDepth(m_Depth);
 		result = m_Fern->GenerateSequence("X");
 
 		// Set variables
-		savedPos.clear();
-		savedAngle.clear();
+		m_Saved.ReserveNesting(m_Fern->GetMaxNesting("X", "[", "]"));
+		m_Saved.Clear();
+		m_Segments.clear();
 		segmentLength = ENGINE->GetHeight() * 0.37f / powf(2.0f, float(m_Depth));
 		currentAngle = PI / 2;
 		currentPos = Vector2D{ ENGINE->GetWidth() / 2, ENGINE->GetHeight() };
 		endPos = Vector2D{ 0,0 };
 	
-	
 		for (auto action : result) {
 			action();
 		}
 
-		ENGINE->DrawString("Depth: " + std::to_string(m_Depth));
+		m_Index.Build(m_Segments, 16.0f);
+		m_GeneratedDepth = m_Depth;
+}
+
+void Application::Generate3D() {
+
+		LNode< std::function<void()>>::SetDepth(m_Depth);
+		result = m_Tree->GenerateSequence("A");
+		m_Turtle.ReserveNesting(m_Tree->GetMaxNesting("A", "[", "]"));
+
+		// The tree stands on the origin, the view puts it on screen
+		m_Segments.clear();
+		m_Index.Build(m_Segments, 16.0f);
+		m_Turtle.Reset(Vector3{ 0, 0, 0 }, ENGINE->GetHeight() * 0.8f / powf(2.0f, float(m_Depth)));
+
+		for (auto action : result) {
+			action();
+		}
+
+		m_GeneratedDepth = m_Depth;
+}
+
+void Application::Paint() {
+
+		ENGINE->ClearBackground();
+
+		if (m_Is3D) {
+			Paint3D();
+			return;
+		}
+
+		for (const Segment& segment : m_Segments) {
+			ENGINE->DrawLine(segment.start, segment.end);
+		}
+
+		// A marker in the middle of the window, as a player would test for touching the plant
+		const Vector2D middle{ ENGINE->GetWidth() / 2, ENGINE->GetHeight() / 2 };
+		ENGINE->DrawLine(Vector2D{ middle.x - 5, middle.y }, Vector2D{ middle.x + 5, middle.y });
+		ENGINE->DrawLine(Vector2D{ middle.x, middle.y - 5 }, Vector2D{ middle.x, middle.y + 5 });
+
+		ENGINE->DrawString("Depth: " + std::to_string(m_Depth) + (m_Index.IsNear(middle, 5.0f) ? ", touching the plant" : "") + (m_IsExporting ? ", exporting" : ""));
+}
+
+void Application::Paint3D() {
+
+		// Turned around the trunk, flipped so up is up on screen and moved to the bottom middle
+		const Matrix view{ Matrix::Translation(ENGINE->GetWidth() / 2, ENGINE->GetHeight(), 0) * Matrix::Scale(1, -1, 1) * Matrix::RotationY(m_ViewAngle) };
+
+		m_Turtle.GetPoints().Transform(view, m_Projected);
+
+		for (size_t index{ 0 }; index + 1 < m_Projected.GetCount(); index += 2) {
+			ENGINE->DrawLine(Vector2D{ m_Projected.x[index], m_Projected.y[index] }, Vector2D{ m_Projected.x[index + 1], m_Projected.y[index + 1] });
+		}
+
+		ENGINE->DrawString("Depth: " + std::to_string(m_Depth) + ", 3D" + (m_IsExporting ? ", exporting" : ""));
+}
+
+void Application::StartExport() {
+
+		if (m_ExportThread.joinable()) {
+			m_ExportThread.join();
+		}
+
+		m_Exporter.Reset();
+		m_IsExporting = true;
+		m_ExportThread = std::thread{ [this]() {
+			try {
+				m_Exporter.Export(m_ExportDepth, "fern.svg", "fern.lseg");
+			}
+			catch (ExportException) {}
+			catch (ExportCancelledException) {}
+			// Nothing may leave the thread, a failed export must not close the window
+			catch (...) {}
+			m_IsExporting = false;
+		} };
 }
\ No newline at end of file
@@ -5,7 +5,13 @@
 #include "Math.h"
 #include <vector>
 #include "Grammar.h"
+#include "SegmentIndex.h"
+#include "Turtle3D.h"
+#include "StateStack.h"
+#include "PlantExporter.h"
 #include <functional>
+#include <thread>
+#include <atomic>
 
 class Application final{
 
@@ -31,11 +37,41 @@ class Application final{
 		float m_DepthTimer{ 0.0f };
 		float m_MaxDepthTimer{ 1.5f };
 
-		std::vector<Vector2D> savedPos{};
-		std::vector<float> savedAngle{ 0 };
+		struct TurtleState {
+			Vector2D position{ 0, 0 };
+			float angle{ 0.0f };
+		};
+		StateStack<TurtleState> m_Saved{};
+
+		// The plant of the current depth, made when the depth changes instead of every frame
+		void Generate();
+		void Generate3D();
+		void Paint3D();
+
+		int m_GeneratedDepth{ -1 };
+		std::vector<Segment> m_Segments{};
+		SegmentIndex m_Index{};
 
 		float segmentLength{ };
 		float currentAngle{};
 		Vector2D currentPos{0,0 };
 		Vector2D endPos{ 0,0};
+
+		// The tree is grown in 3D and turned around its trunk, T switches between it and the fern
+		Grammar<std::function<void()>> * m_Tree;
+		Turtle3D m_Turtle{ 22.5f * TO_RADIANS, 137.5f * TO_RADIANS };
+		Vector3Array m_Projected{};
+		float m_ViewAngle{ 0.0f };
+		float m_ViewSpeed{ 0.5f };
+		bool m_Is3D{ false };
+		bool m_WasTogglePressed{ false };
+
+		// E writes the fern at the export depth to fern.svg and fern.lseg, on a thread of its own
+		void StartExport();
+
+		PlantExporter m_Exporter{};
+		std::thread m_ExportThread{};
+		std::atomic<bool> m_IsExporting{ false };
+		bool m_WasExportPressed{ false };
+		int m_ExportDepth{ 14 };
 };
\ No newline at end of file
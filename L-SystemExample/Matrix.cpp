@@ -1,11 +1,80 @@
 #include "Math.h"
+#include <math.h>
 
-Vector3 Matrix::Transform(const Vector3& vector) {
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define MATRIX_SSE
+#include <xmmintrin.h>
+#endif
+
+Vector3 Matrix::Transform(const Vector3& vector) const {
 	Vector3 result{0,0,0};
 	result.x = data[0].x * vector.x + data[0].y * vector.y + data[0].z * vector.z + data[0].w * vector.w;
 	result.y = data[1].x * vector.x + data[1].y * vector.y + data[1].z * vector.z + data[1].w * vector.w;
 	result.z = data[2].x * vector.x + data[2].y * vector.y + data[2].z * vector.z + data[2].w * vector.w;
 	result.w = data[3].x * vector.x + data[3].y * vector.y + data[3].z * vector.z + data[3].w * vector.w;
 
+	return result;
+}
+
+Matrix Matrix::operator*(const Matrix& other) const {
+
+	Matrix result{};
+#if defined(MATRIX_SSE)
+	// Row i of the product is the rows of other, weighted by row i of this
+	const __m128 rows[4]{ _mm_loadu_ps(&other.data[0].x), _mm_loadu_ps(&other.data[1].x), _mm_loadu_ps(&other.data[2].x), _mm_loadu_ps(&other.data[3].x) };
+	for (int row{ 0 }; row < 4; ++row) {
+		__m128 sum{ _mm_mul_ps(_mm_set1_ps(data[row].x), rows[0]) };
+		sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(data[row].y), rows[1]));
+		sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(data[row].z), rows[2]));
+		sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(data[row].w), rows[3]));
+		_mm_storeu_ps(&result.data[row].x, sum);
+	}
+#else
+	for (int row{ 0 }; row < 4; ++row) {
+		const Vector3& left{ data[row] };
+		Vector3& sum{ result.data[row] };
+		sum.x = left.x * other.data[0].x + left.y * other.data[1].x + left.z * other.data[2].x + left.w * other.data[3].x;
+		sum.y = left.x * other.data[0].y + left.y * other.data[1].y + left.z * other.data[2].y + left.w * other.data[3].y;
+		sum.z = left.x * other.data[0].z + left.y * other.data[1].z + left.z * other.data[2].z + left.w * other.data[3].z;
+		sum.w = left.x * other.data[0].w + left.y * other.data[1].w + left.z * other.data[2].w + left.w * other.data[3].w;
+	}
+#endif
+	return result;
+}
+
+Matrix Matrix::RotationX(float angle) {
+	Matrix result{};
+	result.data[1] = Vector3{ 0, cosf(angle), -sinf(angle), 0 };
+	result.data[2] = Vector3{ 0, sinf(angle), cosf(angle), 0 };
+	return result;
+}
+
+Matrix Matrix::RotationY(float angle) {
+	Matrix result{};
+	result.data[0] = Vector3{ cosf(angle), 0, sinf(angle), 0 };
+	result.data[2] = Vector3{ -sinf(angle), 0, cosf(angle), 0 };
+	return result;
+}
+
+Matrix Matrix::RotationZ(float angle) {
+	Matrix result{};
+	result.data[0] = Vector3{ cosf(angle), -sinf(angle), 0, 0 };
+	result.data[1] = Vector3{ sinf(angle), cosf(angle), 0, 0 };
+	return result;
+}
+
+Matrix Matrix::Translation(float x, float y, float z) {
+	Matrix result{};
+	result.data[0].w = x;
+	result.data[1].w = y;
+	result.data[2].w = z;
+	return result;
+}
+
+Matrix Matrix::Scale(float x, float y, float z) {
+	Matrix result{};
+	result.data[0].x = x;
+	result.data[1].y = y;
+	result.data[2].z = z;
 	return result;
 }
\ No newline at end of file
@@ -8,5 +8,13 @@ struct Matrix {
 		{0,0,0,1},
 	};
 
-	Vector3 Transform(const Vector3& vector);
+	Vector3 Transform(const Vector3& vector) const;
+
+	Matrix operator*(const Matrix& other) const;
+
+	static Matrix RotationX(float angle);
+	static Matrix RotationY(float angle);
+	static Matrix RotationZ(float angle);
+	static Matrix Translation(float x, float y, float z);
+	static Matrix Scale(float x, float y, float z);
 };
\ No newline at end of file
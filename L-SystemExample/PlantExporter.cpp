@@ -0,0 +1,78 @@
+#include "PlantExporter.h"
+#include <memory>
+
+//*** PLANTTURTLE ***
+//
+//
+
+void PlantTurtle::Forward() {
+
+	const Vector2D end{ state.position.x + segmentLength * cosf(state.angle), state.position.y - segmentLength * sinf(state.angle) };
+	const Segment segment{ state.position, end, 1.0f };
+	for (SegmentExporter* pExporter : exporters) {
+		pExporter->Add(segment);
+	}
+
+	state.position = end;
+	++segmentCount;
+}
+
+void PlantTurtle::Turn(float direction) {
+	state.angle += direction * turnAngle;
+}
+
+void PlantTurtle::Push() {
+	saved.Push(state);
+}
+
+void PlantTurtle::Pop() {
+	state = saved.Pop();
+}
+
+//*** PLANTEXPORTER ***
+//
+//
+
+PlantExporter::PlantExporter() {
+
+	m_Grammar.AddLeaveNode("F", [](PlantTurtle& turtle) { turtle.Forward(); });
+	m_Grammar.AddLeaveNode("-", [](PlantTurtle& turtle) { turtle.Turn(-1.0f); });
+	m_Grammar.AddLeaveNode("+", [](PlantTurtle& turtle) { turtle.Turn(1.0f); });
+	m_Grammar.AddLeaveNode("[", [](PlantTurtle& turtle) { turtle.Push(); });
+	m_Grammar.AddLeaveNode("]", [](PlantTurtle& turtle) { turtle.Pop(); });
+	m_Grammar.AddLeaveNode("X", [](PlantTurtle&) {});
+
+	m_Grammar.ParseRule("X", "X -> F & + & [ & [ & X & ] & - & X & ] & - & F & [ & - & F & X & ] & + & X");
+	m_Grammar.ParseRule("F", "F -> F & F");
+}
+
+unsigned long long PlantExporter::Export(int depth, const std::string& svgPath, const std::string& segmentPath) {
+
+	std::unique_ptr<SvgExporter> pSvg{ svgPath.empty() ? nullptr : new SvgExporter{ svgPath } };
+	std::unique_ptr<SegmentFileExporter> pSegments{ segmentPath.empty() ? nullptr : new SegmentFileExporter{ segmentPath } };
+
+	PlantTurtle turtle{};
+	turtle.state.angle = PI / 2;
+	if (pSvg) {
+		turtle.exporters.push_back(pSvg.get());
+	}
+	if (pSegments) {
+		turtle.exporters.push_back(pSegments.get());
+	}
+
+	// The depth belongs to the action type, the window's own grammar keeps its depth
+	LNode<PlantAction>::SetDepth(depth);
+	turtle.saved.ReserveNesting(m_Grammar.GetMaxNesting("X", "[", "]"));
+
+	m_Grammar.GenerateSequence("X", [&](const PlantAction& action) {
+		if (m_IsCancelled.load(std::memory_order_relaxed)) {
+			throw ExportCancelledException{};
+		}
+		action(turtle);
+	});
+
+	for (SegmentExporter* pExporter : turtle.exporters) {
+		pExporter->Finish();
+	}
+	return turtle.segmentCount;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "Math.h"
+#include "Grammar.h"
+#include "StateStack.h"
+#include "SegmentExport.h"
+#include <atomic>
+#include <functional>
+#include <string>
+#include <vector>
+
+//*** PLANTEXPORTER ***
+//
+//
+
+class ExportCancelledException {};
+
+// Turtle of an export. The grammar actions work on it instead of on the application, so an export
+// can run next to the window, and every segment goes straight to the exporters.
+struct PlantTurtle {
+	struct State {
+		Vector2D position{ 0, 0 };
+		float angle{ 0.0f };
+	};
+
+	State state{};
+	StateStack<State> saved{};
+	float segmentLength{ 1.0f };
+	float turnAngle{ 25.0f * TO_RADIANS };
+	std::vector<SegmentExporter*> exporters{};
+	unsigned long long segmentCount{ 0 };
+
+	void Forward();
+	void Turn(float direction);
+	void Push();
+	void Pop();
+};
+
+using PlantAction = std::function<void(PlantTurtle&)>;
+
+// Draws the fern of the window straight into files. The grammar is walked as a stream and every
+// segment is written as soon as the turtle draws it, so memory stays the same at any depth.
+class PlantExporter final {
+
+	public:
+		PlantExporter();
+		~PlantExporter() = default;
+
+		PlantExporter(const PlantExporter& ref) = delete;
+		PlantExporter(PlantExporter&& ref) = delete;
+		PlantExporter& operator=(const PlantExporter& ref) = delete;
+		PlantExporter& operator=(PlantExporter&& ref) = delete;
+
+		// An empty path skips that format. Returns the number of segments written.
+		unsigned long long Export(int depth, const std::string& svgPath, const std::string& segmentPath);
+		// Makes a running export throw ExportCancelledException, from any thread. A cancel stays
+		// in effect until Reset, so one that comes before the export starts isn't lost.
+		void Cancel() { m_IsCancelled = true; }
+		void Reset() { m_IsCancelled = false; }
+
+	private:
+		Grammar<PlantAction> m_Grammar;
+		std::atomic<bool> m_IsCancelled{ false };
+};
@@ -0,0 +1,259 @@
+#include "SegmentExport.h"
+#include <cstring>
+#include <algorithm>
+
+namespace {
+	constexpr size_t ViewBoxLength{ 63 };	// Four numbers of 15 characters and the spaces between
+
+	bool Seek(FILE* pFile, unsigned long long position, int origin) {
+#if defined(_WIN32)
+		return _fseeki64(pFile, static_cast<long long>(position), origin) == 0;
+#else
+		return fseeko(pFile, static_cast<off_t>(position), origin) == 0;
+#endif
+	}
+
+	// Rounded to hundredths without trailing zeros, much faster than printf for millions of numbers
+	char* FormatNumber(float value, char* pOut) {
+		long long hundredths{ static_cast<long long>(std::llround(double(value) * 100.0)) };
+		if (hundredths < 0) {
+			*pOut++ = '-';
+			hundredths = -hundredths;
+		}
+
+		char digits[24];
+		int count{ 0 };
+		long long whole{ hundredths / 100 };
+		do {
+			digits[count++] = char('0' + whole % 10);
+			whole /= 10;
+		} while (whole > 0);
+		while (count > 0) {
+			*pOut++ = digits[--count];
+		}
+
+		const int fraction{ int(hundredths % 100) };
+		if (fraction != 0) {
+			*pOut++ = '.';
+			*pOut++ = char('0' + fraction / 10);
+			if (fraction % 10 != 0) {
+				*pOut++ = char('0' + fraction % 10);
+			}
+		}
+		return pOut;
+	}
+
+	template<typename Value>
+	void Append(char*& pOut, const Value& value) {
+		std::memcpy(pOut, &value, sizeof(Value));
+		pOut += sizeof(Value);
+	}
+}
+
+//*** BUFFEREDFILE ***
+//
+//
+
+BufferedFile::BufferedFile(const std::string& path, size_t bufferSize)
+	: m_pFile{ std::fopen(path.c_str(), "wb") }
+	, m_Buffer(bufferSize)
+{
+	if (!m_pFile) {
+		throw ExportException{};
+	}
+}
+
+BufferedFile::~BufferedFile() {
+
+	// Errors can't be reported from here, call Flush first to see them
+	try {
+		Flush();
+	}
+	catch (ExportException) {}
+
+	std::fclose(m_pFile);
+}
+
+void BufferedFile::Write(const void* pData, size_t size) {
+
+	if (m_Size + size > m_Buffer.size()) {
+		Flush();
+		if (size > m_Buffer.size()) {
+			if (std::fwrite(pData, 1, size, m_pFile) != size) {
+				throw ExportException{};
+			}
+			m_BytesWritten += size;
+			return;
+		}
+	}
+
+	std::memcpy(m_Buffer.data() + m_Size, pData, size);
+	m_Size += size;
+}
+
+void BufferedFile::Patch(unsigned long long position, const void* pData, size_t size) {
+
+	Flush();
+	if (!Seek(m_pFile, position, SEEK_SET) || std::fwrite(pData, 1, size, m_pFile) != size || !Seek(m_pFile, 0, SEEK_END)) {
+		throw ExportException{};
+	}
+}
+
+void BufferedFile::Flush() {
+
+	if (m_Size > 0 && std::fwrite(m_Buffer.data(), 1, m_Size, m_pFile) != m_Size) {
+		throw ExportException{};
+	}
+	m_BytesWritten += m_Size;
+	m_Size = 0;
+	std::fflush(m_pFile);
+}
+
+//*** SVGEXPORTER ***
+//
+//
+
+SvgExporter::SvgExporter(const std::string& path)
+	: m_File{ path }
+{
+	m_File.Write(std::string{ "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<svg xmlns=\"http://www.w3.org/2000/svg\" viewBox=\"" });
+	m_ViewBoxPosition = m_File.GetPosition();
+	m_File.Write(std::string(ViewBoxLength, ' '));
+	m_File.Write(std::string{ "\" fill=\"none\" stroke=\"black\" stroke-width=\"1\" stroke-linecap=\"round\" stroke-linejoin=\"round\">\n" });
+}
+
+void SvgExporter::Add(const Segment& segment) {
+
+	const float radius{ 0.5f * segment.width };
+	m_Left = std::min(m_Left, std::min(segment.start.x, segment.end.x) - radius);
+	m_Top = std::min(m_Top, std::min(segment.start.y, segment.end.y) - radius);
+	m_Right = std::max(m_Right, std::max(segment.start.x, segment.end.x) + radius);
+	m_Bottom = std::max(m_Bottom, std::max(segment.start.y, segment.end.y) + radius);
+
+	const bool isContinued{ m_IsInPolyline && segment.width == m_Last.width && segment.start.x == m_Last.end.x && segment.start.y == m_Last.end.y };
+	if (!isContinued) {
+		if (m_IsInPolyline) {
+			m_File.Write(std::string{ "\"/>\n" });
+		}
+
+		m_File.Write(std::string{ "<polyline" });
+		if (segment.width != 1.0f) {
+			char text[32];
+			const int length{ std::snprintf(text, sizeof(text), " stroke-width=\"%g\"", segment.width) };
+			m_File.Write(text, size_t(length));
+		}
+		m_File.Write(std::string{ " points=\"" });
+		WritePoint(segment.start);
+		m_IsInPolyline = true;
+	}
+
+	m_File.Write(" ", 1);
+	WritePoint(segment.end);
+	m_Last = segment;
+}
+
+void SvgExporter::Finish() {
+
+	if (m_IsInPolyline) {
+		m_File.Write(std::string{ "\"/>\n" });
+		m_IsInPolyline = false;
+	}
+	m_File.Write(std::string{ "</svg>\n" });
+
+	// Nothing drawn leaves an empty box at the origin
+	if (m_Left > m_Right) {
+		m_Left = m_Top = m_Right = m_Bottom = 0.0f;
+	}
+	char viewBox[ViewBoxLength + 1];
+	std::snprintf(viewBox, sizeof(viewBox), "%15.2f %15.2f %15.2f %15.2f", m_Left, m_Top, m_Right - m_Left, m_Bottom - m_Top);
+	m_File.Patch(m_ViewBoxPosition, viewBox, ViewBoxLength);
+	m_File.Flush();
+}
+
+void SvgExporter::WritePoint(const Vector2D& point) {
+	char text[64];
+	char* pOut{ FormatNumber(point.x, text) };
+	*pOut++ = ',';
+	pOut = FormatNumber(point.y, pOut);
+	m_File.Write(text, size_t(pOut - text));
+}
+
+//*** SEGMENTFILEEXPORTER ***
+//
+//
+
+SegmentFileExporter::SegmentFileExporter(const std::string& path, unsigned int chunkSize)
+	: m_File{ path }
+	, m_ChunkSize{ std::max(chunkSize, 1u) }
+{
+	// Counts and the index position are filled in by Finish
+	WriteHeader(0);
+}
+
+void SegmentFileExporter::Add(const Segment& segment) {
+
+	const float radius{ 0.5f * segment.width };
+	const float left{ std::min(segment.start.x, segment.end.x) - radius };
+	const float top{ std::min(segment.start.y, segment.end.y) - radius };
+	const float right{ std::max(segment.start.x, segment.end.x) + radius };
+	const float bottom{ std::max(segment.start.y, segment.end.y) + radius };
+
+	if (m_Chunks.empty() || m_Chunks.back().count == m_ChunkSize) {
+		m_Chunks.push_back(Chunk{ m_SegmentCount, 0, left, top, right, bottom });
+	}
+	Chunk& chunk{ m_Chunks.back() };
+	++chunk.count;
+	chunk.left = std::min(chunk.left, left);
+	chunk.top = std::min(chunk.top, top);
+	chunk.right = std::max(chunk.right, right);
+	chunk.bottom = std::max(chunk.bottom, bottom);
+
+	char record[SegmentBytes];
+	char* pOut{ record };
+	Append(pOut, segment.start.x);
+	Append(pOut, segment.start.y);
+	Append(pOut, segment.end.x);
+	Append(pOut, segment.end.y);
+	Append(pOut, segment.width);
+	m_File.Write(record, SegmentBytes);
+	++m_SegmentCount;
+}
+
+void SegmentFileExporter::Finish() {
+
+	const uint64_t indexPosition{ m_File.GetPosition() };
+	for (const Chunk& chunk : m_Chunks) {
+		char record[ChunkBytes];
+		char* pOut{ record };
+		Append(pOut, chunk.firstSegment);
+		Append(pOut, chunk.count);
+		Append(pOut, chunk.left);
+		Append(pOut, chunk.top);
+		Append(pOut, chunk.right);
+		Append(pOut, chunk.bottom);
+		m_File.Write(record, ChunkBytes);
+	}
+
+	WriteHeader(indexPosition);
+	m_File.Flush();
+}
+
+void SegmentFileExporter::WriteHeader(uint64_t indexPosition) {
+
+	char header[HeaderBytes];
+	char* pOut{ header };
+	std::memcpy(pOut, "LSEG", 4);
+	pOut += 4;
+	Append(pOut, uint32_t(Version));
+	Append(pOut, m_SegmentCount);
+	Append(pOut, indexPosition);
+	Append(pOut, uint32_t(m_ChunkSize));
+	Append(pOut, uint32_t(m_Chunks.size()));
+
+	if (indexPosition == 0) {
+		m_File.Write(header, HeaderBytes);
+	}
+	else {
+		m_File.Patch(0, header, HeaderBytes);
+	}
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+#include "SegmentIndex.h"
+#include <cmath>
+#include <cstdio>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+//*** SEGMENTEXPORT ***
+//
+//
+
+class ExportException {};
+
+// Collects output in a large buffer and hands it to the file in few, big writes
+class BufferedFile final {
+
+	public:
+		BufferedFile(const std::string& path, size_t bufferSize = size_t(4) << 20);
+		~BufferedFile();
+
+		BufferedFile(const BufferedFile& ref) = delete;
+		BufferedFile(BufferedFile&& ref) = delete;
+		BufferedFile& operator=(const BufferedFile& ref) = delete;
+		BufferedFile& operator=(BufferedFile&& ref) = delete;
+
+		void Write(const void* pData, size_t size);
+		void Write(const std::string& text) { Write(text.data(), text.size()); }
+		// Overwrites bytes written earlier, for headers that are only known at the end
+		void Patch(unsigned long long position, const void* pData, size_t size);
+		void Flush();
+
+		unsigned long long GetPosition() const { return m_BytesWritten + m_Size; }
+
+	private:
+		FILE* m_pFile;
+		std::vector<char> m_Buffer;
+		size_t m_Size{ 0 };
+		unsigned long long m_BytesWritten{ 0 };
+};
+
+// Receives segments as the turtle draws them
+class SegmentExporter {
+
+	public:
+		SegmentExporter() = default;
+		virtual ~SegmentExporter() = default;
+
+		SegmentExporter(const SegmentExporter& ref) = delete;
+		SegmentExporter(SegmentExporter&& ref) = delete;
+		SegmentExporter& operator=(const SegmentExporter& ref) = delete;
+		SegmentExporter& operator=(SegmentExporter&& ref) = delete;
+
+		virtual void Add(const Segment& segment) = 0;
+		// Completes the file, nothing can be added after
+		virtual void Finish() = 0;
+};
+
+// Writes an SVG with one polyline per run of connected segments of the same width. The view box
+// is only known at the end, it is written as padding first and filled in by Finish.
+class SvgExporter final : public SegmentExporter {
+
+	public:
+		SvgExporter(const std::string& path);
+		virtual ~SvgExporter() = default;
+
+		SvgExporter(const SvgExporter& ref) = delete;
+		SvgExporter(SvgExporter&& ref) = delete;
+		SvgExporter& operator=(const SvgExporter& ref) = delete;
+		SvgExporter& operator=(SvgExporter&& ref) = delete;
+
+		virtual void Add(const Segment& segment) override;
+		virtual void Finish() override;
+
+	private:
+		BufferedFile m_File;
+		unsigned long long m_ViewBoxPosition{ 0 };
+		bool m_IsInPolyline{ false };
+		Segment m_Last{ { 0, 0 }, { 0, 0 }, 0.0f };
+		float m_Left{ INFINITY };
+		float m_Top{ INFINITY };
+		float m_Right{ -INFINITY };
+		float m_Bottom{ -INFINITY };
+
+		void WritePoint(const Vector2D& point);
+};
+
+// Writes segments in a compact binary file, little endian:
+//   header   "LSEG", uint32 version, uint64 segment count, uint64 index position, uint32 segments
+//            per chunk, uint32 chunk count (32 bytes)
+//   segments float start x, start y, end x, end y, width (20 bytes each), in drawing order
+//   index    per chunk of segments: uint64 first segment, uint32 count, float left, top, right,
+//            bottom of everything drawn in it, widths included (28 bytes each)
+// A reader can go through the index to load only the chunks that overlap a region.
+class SegmentFileExporter final : public SegmentExporter {
+
+	public:
+		SegmentFileExporter(const std::string& path, unsigned int chunkSize = 65536);
+		virtual ~SegmentFileExporter() = default;
+
+		SegmentFileExporter(const SegmentFileExporter& ref) = delete;
+		SegmentFileExporter(SegmentFileExporter&& ref) = delete;
+		SegmentFileExporter& operator=(const SegmentFileExporter& ref) = delete;
+		SegmentFileExporter& operator=(SegmentFileExporter&& ref) = delete;
+
+		virtual void Add(const Segment& segment) override;
+		virtual void Finish() override;
+
+		static constexpr uint32_t Version{ 1 };
+		static constexpr size_t HeaderBytes{ 32 };
+		static constexpr size_t SegmentBytes{ 20 };
+		static constexpr size_t ChunkBytes{ 28 };
+
+	private:
+		struct Chunk {
+			uint64_t firstSegment;
+			uint32_t count;
+			float left, top, right, bottom;
+		};
+
+		BufferedFile m_File;
+		const unsigned int m_ChunkSize;
+		uint64_t m_SegmentCount{ 0 };
+		std::vector<Chunk> m_Chunks{};
+
+		void WriteHeader(uint64_t indexPosition);
+};
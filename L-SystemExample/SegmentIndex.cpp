@@ -0,0 +1,173 @@
+#include "SegmentIndex.h"
+#include <cmath>
+#include <algorithm>
+
+namespace {
+	constexpr int MaxCells{ 1 << 16 };
+
+	float PointSegmentDistanceSquared(float pointX, float pointY, float startX, float startY, float endX, float endY) {
+		const float directionX{ endX - startX };
+		const float directionY{ endY - startY };
+		const float lengthSquared{ directionX * directionX + directionY * directionY };
+
+		float share{ 0.0f };
+		if (lengthSquared > 0.0f) {
+			share = std::min(std::max(((pointX - startX) * directionX + (pointY - startY) * directionY) / lengthSquared, 0.0f), 1.0f);
+		}
+		const float offsetX{ startX + share * directionX - pointX };
+		const float offsetY{ startY + share * directionY - pointY };
+		return offsetX * offsetX + offsetY * offsetY;
+	}
+
+	// Sign of the turn from a to b to c
+	float Orientation(float aX, float aY, float bX, float bY, float cX, float cY) {
+		return (bX - aX) * (cY - aY) - (bY - aY) * (cX - aX);
+	}
+
+	// Zero when the segments cross, else the smallest endpoint to segment distance
+	float SegmentDistanceSquared(float aX, float aY, float bX, float bY, float cX, float cY, float dX, float dY) {
+		const float abc{ Orientation(aX, aY, bX, bY, cX, cY) };
+		const float abd{ Orientation(aX, aY, bX, bY, dX, dY) };
+		const float cda{ Orientation(cX, cY, dX, dY, aX, aY) };
+		const float cdb{ Orientation(cX, cY, dX, dY, bX, bY) };
+		if (((abc > 0.0f && abd < 0.0f) || (abc < 0.0f && abd > 0.0f)) && ((cda > 0.0f && cdb < 0.0f) || (cda < 0.0f && cdb > 0.0f))) {
+			return 0.0f;
+		}
+
+		return std::min(
+			std::min(PointSegmentDistanceSquared(aX, aY, cX, cY, dX, dY), PointSegmentDistanceSquared(bX, bY, cX, cY, dX, dY)),
+			std::min(PointSegmentDistanceSquared(cX, cY, aX, aY, bX, bY), PointSegmentDistanceSquared(dX, dY, aX, aY, bX, bY)));
+	}
+}
+
+void SegmentIndex::Build(const std::vector<Segment>& segments, float cellSize) {
+
+	m_CellStarts.clear();
+	m_Entries.clear();
+	m_Columns = 0;
+	m_Rows = 0;
+	m_MaxRadius = 0.0f;
+	if (segments.empty()) {
+		return;
+	}
+
+	float right{ -INFINITY };
+	float bottom{ -INFINITY };
+	m_Left = INFINITY;
+	m_Top = INFINITY;
+	for (const Segment& segment : segments) {
+		const float radius{ 0.5f * segment.width };
+		m_Left = std::min(m_Left, std::min(segment.start.x, segment.end.x) - radius);
+		m_Top = std::min(m_Top, std::min(segment.start.y, segment.end.y) - radius);
+		right = std::max(right, std::max(segment.start.x, segment.end.x) + radius);
+		bottom = std::max(bottom, std::max(segment.start.y, segment.end.y) + radius);
+		m_MaxRadius = std::max(m_MaxRadius, radius);
+	}
+
+	m_CellSize = std::max(cellSize, 1e-3f);
+	while (true) {
+		m_Columns = int((right - m_Left) / m_CellSize) + 1;
+		m_Rows = int((bottom - m_Top) / m_CellSize) + 1;
+		if (double(m_Columns) * double(m_Rows) <= double(MaxCells)) {
+			break;
+		}
+		m_CellSize *= 2.0f;
+	}
+
+	// Counting sort into the cells: count, prefix sum, then fill
+	std::vector<unsigned int> counts(size_t(m_Columns) * size_t(m_Rows) + 1, 0);
+	auto forEachCell = [&](const Segment& segment, auto function) {
+		const float radius{ 0.5f * segment.width };
+		int firstColumn, firstRow, lastColumn, lastRow;
+		GetCells(std::min(segment.start.x, segment.end.x) - radius, std::min(segment.start.y, segment.end.y) - radius,
+			std::max(segment.start.x, segment.end.x) + radius, std::max(segment.start.y, segment.end.y) + radius,
+			firstColumn, firstRow, lastColumn, lastRow);
+
+		for (int row{ firstRow }; row <= lastRow; ++row) {
+			for (int column{ firstColumn }; column <= lastColumn; ++column) {
+				function(size_t(row) * size_t(m_Columns) + size_t(column));
+			}
+		}
+	};
+
+	for (const Segment& segment : segments) {
+		forEachCell(segment, [&](size_t cell) { ++counts[cell + 1]; });
+	}
+	for (size_t cell{ 1 }; cell < counts.size(); ++cell) {
+		counts[cell] += counts[cell - 1];
+	}
+	m_CellStarts = counts;
+	m_Entries.resize(counts.back());
+
+	for (const Segment& segment : segments) {
+		const Entry entry{ segment.start.x, segment.start.y, segment.end.x, segment.end.y, 0.5f * segment.width };
+		forEachCell(segment, [&](size_t cell) { m_Entries[counts[cell]++] = entry; });
+	}
+}
+
+bool SegmentIndex::IsNear(const Vector2D& point, float radius) const {
+
+	int firstColumn, firstRow, lastColumn, lastRow;
+	if (!GetCells(point.x - radius - m_MaxRadius, point.y - radius - m_MaxRadius, point.x + radius + m_MaxRadius, point.y + radius + m_MaxRadius,
+		firstColumn, firstRow, lastColumn, lastRow)) {
+		return false;
+	}
+
+	// The cells of a row are stored one after the other, so each row is a single run of entries
+	for (int row{ firstRow }; row <= lastRow; ++row) {
+		const size_t rowStart{ size_t(row) * size_t(m_Columns) };
+		for (size_t entry{ m_CellStarts[rowStart + firstColumn] }; entry < m_CellStarts[rowStart + lastColumn + 1]; ++entry) {
+			const Entry& segment{ m_Entries[entry] };
+			const float reach{ radius + segment.radius };
+			if (PointSegmentDistanceSquared(point.x, point.y, segment.startX, segment.startY, segment.endX, segment.endY) <= reach * reach) {
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+bool SegmentIndex::Crosses(const Vector2D& start, const Vector2D& end) const {
+
+	int firstColumn, firstRow, lastColumn, lastRow;
+	if (!GetCells(std::min(start.x, end.x) - m_MaxRadius, std::min(start.y, end.y) - m_MaxRadius, std::max(start.x, end.x) + m_MaxRadius, std::max(start.y, end.y) + m_MaxRadius,
+		firstColumn, firstRow, lastColumn, lastRow)) {
+		return false;
+	}
+
+	for (int row{ firstRow }; row <= lastRow; ++row) {
+		const size_t rowStart{ size_t(row) * size_t(m_Columns) };
+		for (size_t entry{ m_CellStarts[rowStart + firstColumn] }; entry < m_CellStarts[rowStart + lastColumn + 1]; ++entry) {
+			const Entry& segment{ m_Entries[entry] };
+			if (SegmentDistanceSquared(start.x, start.y, end.x, end.y, segment.startX, segment.startY, segment.endX, segment.endY) <= segment.radius * segment.radius) {
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+void SegmentIndex::QueryNear(const Vector2D* points, size_t count, float radius, bool* results) const {
+	for (size_t index{ 0 }; index < count; ++index) {
+		results[index] = IsNear(points[index], radius);
+	}
+}
+
+void SegmentIndex::QueryCrossings(const Vector2D* starts, const Vector2D* ends, size_t count, bool* results) const {
+	for (size_t index{ 0 }; index < count; ++index) {
+		results[index] = Crosses(starts[index], ends[index]);
+	}
+}
+
+bool SegmentIndex::GetCells(float left, float top, float right, float bottom, int& firstColumn, int& firstRow, int& lastColumn, int& lastRow) const {
+
+	if (m_Columns == 0 || right < m_Left || bottom < m_Top || left > m_Left + m_Columns * m_CellSize || top > m_Top + m_Rows * m_CellSize) {
+		return false;
+	}
+
+	firstColumn = std::max(int(std::floor((left - m_Left) / m_CellSize)), 0);
+	firstRow = std::max(int(std::floor((top - m_Top) / m_CellSize)), 0);
+	lastColumn = std::min(int(std::floor((right - m_Left) / m_CellSize)), m_Columns - 1);
+	lastRow = std::min(int(std::floor((bottom - m_Top) / m_CellSize)), m_Rows - 1);
+	return true;
+}
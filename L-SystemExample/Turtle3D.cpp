@@ -0,0 +1,42 @@
+#include "Turtle3D.h"
+
+Turtle3D::Turtle3D(float turnAngle, float rollAngle) {
+	// Heading is the x axis of the frame, left the y axis and up the z axis
+	m_Rotations[TurnLeftRotation] = Matrix::RotationZ(turnAngle);
+	m_Rotations[TurnRightRotation] = Matrix::RotationZ(-turnAngle);
+	m_Rotations[PitchUpRotation] = Matrix::RotationY(-turnAngle);
+	m_Rotations[PitchDownRotation] = Matrix::RotationY(turnAngle);
+	m_Rotations[RollLeftRotation] = Matrix::RotationX(-rollAngle);
+	m_Rotations[RollRightRotation] = Matrix::RotationX(rollAngle);
+}
+
+void Turtle3D::Reset(const Vector3& position, float segmentLength) {
+
+	m_Frame.data[0] = Vector3{ 0, -1, 0, position.x };
+	m_Frame.data[1] = Vector3{ 1, 0, 0, position.y };
+	m_Frame.data[2] = Vector3{ 0, 0, 1, position.z };
+	m_Frame.data[3] = Vector3{ 0, 0, 0, 1 };
+	m_SegmentLength = segmentLength;
+
+	m_Stack.Clear();
+	m_Points.Clear();
+}
+
+void Turtle3D::Forward() {
+
+	const Vector3 start{ m_Frame.data[0].w, m_Frame.data[1].w, m_Frame.data[2].w };
+	for (Vector3& row : m_Frame.data) {
+		row.w += row.x * m_SegmentLength;
+	}
+
+	m_Points.Append(start);
+	m_Points.Append(Vector3{ m_Frame.data[0].w, m_Frame.data[1].w, m_Frame.data[2].w });
+}
+
+void Turtle3D::Push() {
+	m_Stack.Push(m_Frame);
+}
+
+void Turtle3D::Pop() {
+	m_Frame = m_Stack.Pop();
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "Math.h"
+#include "VectorArrays.h"
+#include "StateStack.h"
+
+//*** TURTLE3D ***
+//
+//
+
+// Turtle that moves through space. Its frame is a matrix with the heading, left and up axis as
+// the first three columns and the position as the last one, so every turn is a single multiply
+// with one of a few rotations made up front. Branches are saved on a stack that is allocated once
+// for the deepest nesting expected. Every step forward adds its start and end point to a buffer,
+// ready to be transformed in one batch.
+class Turtle3D final {
+
+	public:
+		Turtle3D(float turnAngle, float rollAngle);
+		~Turtle3D() = default;
+
+		Turtle3D(const Turtle3D& ref) = delete;
+		Turtle3D(Turtle3D&& ref) = delete;
+		Turtle3D& operator=(const Turtle3D& ref) = delete;
+		Turtle3D& operator=(Turtle3D&& ref) = delete;
+
+		// Back to the position, heading up the y axis, without saved branches or points
+		void Reset(const Vector3& position, float segmentLength);
+		// Room for branches nested as deep as the grammar's GetMaxNesting
+		void ReserveNesting(int nesting) { m_Stack.ReserveNesting(nesting); }
+
+		void Forward();
+		void TurnLeft() { Rotate(m_Rotations[TurnLeftRotation]); }
+		void TurnRight() { Rotate(m_Rotations[TurnRightRotation]); }
+		void PitchUp() { Rotate(m_Rotations[PitchUpRotation]); }
+		void PitchDown() { Rotate(m_Rotations[PitchDownRotation]); }
+		void RollLeft() { Rotate(m_Rotations[RollLeftRotation]); }
+		void RollRight() { Rotate(m_Rotations[RollRightRotation]); }
+		void Push();
+		void Pop();
+
+		// Start and end point of every step forward, one after the other
+		const Vector3Array& GetPoints() const { return m_Points; }
+
+	private:
+		enum Rotation {
+			TurnLeftRotation,
+			TurnRightRotation,
+			PitchUpRotation,
+			PitchDownRotation,
+			RollLeftRotation,
+			RollRightRotation,
+			RotationCount
+		};
+
+		Matrix m_Frame{};
+		Matrix m_Rotations[RotationCount]{};
+		float m_SegmentLength{ 1.0f };
+
+		StateStack<Matrix> m_Stack{};
+		Vector3Array m_Points{};
+
+		// Turns around an axis of the turtle itself
+		void Rotate(const Matrix& rotation) { m_Frame = m_Frame * rotation; }
+};
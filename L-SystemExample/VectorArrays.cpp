@@ -0,0 +1,287 @@
+#include "VectorArrays.h"
+#include <cmath>
+#include <cassert>
+#include <algorithm>
+
+#if defined(__AVX__)
+#define VECTOR_AVX
+#include <immintrin.h>
+#endif
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define VECTOR_SSE
+#include <xmmintrin.h>
+#endif
+
+namespace {
+	constexpr float MinLengthSquared{ 1e-24f };
+
+	// The kernels are written once against these lanes and run widest first, each width picking up
+	// where the one before stopped
+#if defined(VECTOR_AVX)
+	struct AvxLanes {
+		__m256 value;
+
+		static constexpr size_t Count{ 8 };
+		static AvxLanes Set(float value) { return AvxLanes{ _mm256_set1_ps(value) }; }
+		static AvxLanes Load(const float* pValues) { return AvxLanes{ _mm256_loadu_ps(pValues) }; }
+		void Store(float* pValues) const { _mm256_storeu_ps(pValues, value); }
+
+		AvxLanes operator+(const AvxLanes& other) const { return AvxLanes{ _mm256_add_ps(value, other.value) }; }
+		AvxLanes operator*(const AvxLanes& other) const { return AvxLanes{ _mm256_mul_ps(value, other.value) }; }
+
+		// One over the square root, zero for lengths too short to have a direction
+		AvxLanes InverseLength() const {
+			const __m256 minLengthSquared{ _mm256_set1_ps(MinLengthSquared) };
+			const __m256 isLong{ _mm256_cmp_ps(value, minLengthSquared, _CMP_GT_OQ) };
+			return AvxLanes{ _mm256_and_ps(isLong, _mm256_div_ps(_mm256_set1_ps(1.0f), _mm256_sqrt_ps(_mm256_max_ps(value, minLengthSquared)))) };
+		}
+	};
+#endif
+
+#if defined(VECTOR_SSE)
+	struct SseLanes {
+		__m128 value;
+
+		static constexpr size_t Count{ 4 };
+		static SseLanes Set(float value) { return SseLanes{ _mm_set1_ps(value) }; }
+		static SseLanes Load(const float* pValues) { return SseLanes{ _mm_loadu_ps(pValues) }; }
+		void Store(float* pValues) const { _mm_storeu_ps(pValues, value); }
+
+		SseLanes operator+(const SseLanes& other) const { return SseLanes{ _mm_add_ps(value, other.value) }; }
+		SseLanes operator*(const SseLanes& other) const { return SseLanes{ _mm_mul_ps(value, other.value) }; }
+
+		SseLanes InverseLength() const {
+			const __m128 minLengthSquared{ _mm_set1_ps(MinLengthSquared) };
+			const __m128 isLong{ _mm_cmpgt_ps(value, minLengthSquared) };
+			return SseLanes{ _mm_and_ps(isLong, _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(_mm_max_ps(value, minLengthSquared)))) };
+		}
+	};
+#endif
+
+	struct ScalarLanes {
+		float value;
+
+		static constexpr size_t Count{ 1 };
+		static ScalarLanes Set(float value) { return ScalarLanes{ value }; }
+		static ScalarLanes Load(const float* pValues) { return ScalarLanes{ *pValues }; }
+		void Store(float* pValues) const { *pValues = value; }
+
+		ScalarLanes operator+(const ScalarLanes& other) const { return ScalarLanes{ value + other.value }; }
+		ScalarLanes operator*(const ScalarLanes& other) const { return ScalarLanes{ value * other.value }; }
+
+		ScalarLanes InverseLength() const { return ScalarLanes{ value > MinLengthSquared ? 1.0f / std::sqrt(value) : 0.0f }; }
+	};
+
+	// Runs the kernel over all values, widest lanes first
+	template<template<typename> class Kernel, typename... Arguments>
+	void Run(size_t count, const Arguments&... arguments) {
+		size_t index{ 0 };
+#if defined(VECTOR_AVX)
+		index = Kernel<AvxLanes>::Run(index, count, arguments...);
+#endif
+#if defined(VECTOR_SSE)
+		index = Kernel<SseLanes>::Run(index, count, arguments...);
+#endif
+		Kernel<ScalarLanes>::Run(index, count, arguments...);
+	}
+
+	template<typename Lanes>
+	struct Transform2D {
+		static size_t Run(size_t index, size_t count, const Matrix& matrix, const float* pX, const float* pY, float* pResultX, float* pResultY) {
+			const Lanes m00{ Lanes::Set(matrix.data[0].x) }, m01{ Lanes::Set(matrix.data[0].y) }, m03{ Lanes::Set(matrix.data[0].w) };
+			const Lanes m10{ Lanes::Set(matrix.data[1].x) }, m11{ Lanes::Set(matrix.data[1].y) }, m13{ Lanes::Set(matrix.data[1].w) };
+			for (; index + Lanes::Count <= count; index += Lanes::Count) {
+				const Lanes x{ Lanes::Load(pX + index) };
+				const Lanes y{ Lanes::Load(pY + index) };
+				(m00 * x + m01 * y + m03).Store(pResultX + index);
+				(m10 * x + m11 * y + m13).Store(pResultY + index);
+			}
+			return index;
+		}
+	};
+
+	template<typename Lanes>
+	struct Transform3D {
+		static size_t Run(size_t index, size_t count, const Matrix& matrix, const float* pX, const float* pY, const float* pZ, float* pResultX, float* pResultY, float* pResultZ) {
+			const Lanes m00{ Lanes::Set(matrix.data[0].x) }, m01{ Lanes::Set(matrix.data[0].y) }, m02{ Lanes::Set(matrix.data[0].z) }, m03{ Lanes::Set(matrix.data[0].w) };
+			const Lanes m10{ Lanes::Set(matrix.data[1].x) }, m11{ Lanes::Set(matrix.data[1].y) }, m12{ Lanes::Set(matrix.data[1].z) }, m13{ Lanes::Set(matrix.data[1].w) };
+			const Lanes m20{ Lanes::Set(matrix.data[2].x) }, m21{ Lanes::Set(matrix.data[2].y) }, m22{ Lanes::Set(matrix.data[2].z) }, m23{ Lanes::Set(matrix.data[2].w) };
+			for (; index + Lanes::Count <= count; index += Lanes::Count) {
+				const Lanes x{ Lanes::Load(pX + index) };
+				const Lanes y{ Lanes::Load(pY + index) };
+				const Lanes z{ Lanes::Load(pZ + index) };
+				(m00 * x + m01 * y + m02 * z + m03).Store(pResultX + index);
+				(m10 * x + m11 * y + m12 * z + m13).Store(pResultY + index);
+				(m20 * x + m21 * y + m22 * z + m23).Store(pResultZ + index);
+			}
+			return index;
+		}
+	};
+
+	// values + offset, in place
+	template<typename Lanes>
+	struct AddOffset {
+		static size_t Run(size_t index, size_t count, float* pValues, float offset) {
+			const Lanes offsets{ Lanes::Set(offset) };
+			for (; index + Lanes::Count <= count; index += Lanes::Count) {
+				(Lanes::Load(pValues + index) + offsets).Store(pValues + index);
+			}
+			return index;
+		}
+	};
+
+	// values + others, in place
+	template<typename Lanes>
+	struct AddValues {
+		static size_t Run(size_t index, size_t count, float* pValues, const float* pOthers) {
+			for (; index + Lanes::Count <= count; index += Lanes::Count) {
+				(Lanes::Load(pValues + index) + Lanes::Load(pOthers + index)).Store(pValues + index);
+			}
+			return index;
+		}
+	};
+
+	template<typename Lanes>
+	struct ScaleValues {
+		static size_t Run(size_t index, size_t count, float* pValues, float scale) {
+			const Lanes scales{ Lanes::Set(scale) };
+			for (; index + Lanes::Count <= count; index += Lanes::Count) {
+				(Lanes::Load(pValues + index) * scales).Store(pValues + index);
+			}
+			return index;
+		}
+	};
+
+	template<typename Lanes>
+	struct Normalize2D {
+		static size_t Run(size_t index, size_t count, float* pX, float* pY) {
+			for (; index + Lanes::Count <= count; index += Lanes::Count) {
+				const Lanes x{ Lanes::Load(pX + index) };
+				const Lanes y{ Lanes::Load(pY + index) };
+				const Lanes inverse{ (x * x + y * y).InverseLength() };
+				(x * inverse).Store(pX + index);
+				(y * inverse).Store(pY + index);
+			}
+			return index;
+		}
+	};
+
+	template<typename Lanes>
+	struct Normalize3D {
+		static size_t Run(size_t index, size_t count, float* pX, float* pY, float* pZ) {
+			for (; index + Lanes::Count <= count; index += Lanes::Count) {
+				const Lanes x{ Lanes::Load(pX + index) };
+				const Lanes y{ Lanes::Load(pY + index) };
+				const Lanes z{ Lanes::Load(pZ + index) };
+				const Lanes inverse{ (x * x + y * y + z * z).InverseLength() };
+				(x * inverse).Store(pX + index);
+				(y * inverse).Store(pY + index);
+				(z * inverse).Store(pZ + index);
+			}
+			return index;
+		}
+	};
+}
+
+void Vector2DArray::Append(const Vector2D& point) {
+	x.push_back(point.x);
+	y.push_back(point.y);
+}
+
+void Vector2DArray::Reserve(size_t count) {
+	x.reserve(count);
+	y.reserve(count);
+}
+
+void Vector2DArray::Resize(size_t count) {
+	x.resize(count);
+	y.resize(count);
+}
+
+void Vector2DArray::Clear() {
+	x.clear();
+	y.clear();
+}
+
+void Vector2DArray::Transform(const Matrix& matrix, Vector2DArray& result) const {
+	result.Resize(GetCount());
+	Run<Transform2D>(GetCount(), matrix, x.data(), y.data(), result.x.data(), result.y.data());
+}
+
+void Vector2DArray::Add(const Vector2D& offset) {
+	Run<AddOffset>(GetCount(), x.data(), offset.x);
+	Run<AddOffset>(GetCount(), y.data(), offset.y);
+}
+
+void Vector2DArray::Add(const Vector2DArray& other) {
+
+	// Release builds never read past the end of the shorter array
+	assert(other.GetCount() == GetCount());
+	const size_t count{ std::min(GetCount(), other.GetCount()) };
+	Run<AddValues>(count, x.data(), other.x.data());
+	Run<AddValues>(count, y.data(), other.y.data());
+}
+
+void Vector2DArray::Scale(float scale) {
+	Run<ScaleValues>(GetCount(), x.data(), scale);
+	Run<ScaleValues>(GetCount(), y.data(), scale);
+}
+
+void Vector2DArray::Normalize() {
+	Run<Normalize2D>(GetCount(), x.data(), y.data());
+}
+
+void Vector3Array::Append(const Vector3& point) {
+	x.push_back(point.x);
+	y.push_back(point.y);
+	z.push_back(point.z);
+}
+
+void Vector3Array::Reserve(size_t count) {
+	x.reserve(count);
+	y.reserve(count);
+	z.reserve(count);
+}
+
+void Vector3Array::Resize(size_t count) {
+	x.resize(count);
+	y.resize(count);
+	z.resize(count);
+}
+
+void Vector3Array::Clear() {
+	x.clear();
+	y.clear();
+	z.clear();
+}
+
+void Vector3Array::Transform(const Matrix& matrix, Vector3Array& result) const {
+	result.Resize(GetCount());
+	Run<Transform3D>(GetCount(), matrix, x.data(), y.data(), z.data(), result.x.data(), result.y.data(), result.z.data());
+}
+
+void Vector3Array::Add(const Vector3& offset) {
+	Run<AddOffset>(GetCount(), x.data(), offset.x);
+	Run<AddOffset>(GetCount(), y.data(), offset.y);
+	Run<AddOffset>(GetCount(), z.data(), offset.z);
+}
+
+void Vector3Array::Add(const Vector3Array& other) {
+
+	assert(other.GetCount() == GetCount());
+	const size_t count{ std::min(GetCount(), other.GetCount()) };
+	Run<AddValues>(count, x.data(), other.x.data());
+	Run<AddValues>(count, y.data(), other.y.data());
+	Run<AddValues>(count, z.data(), other.z.data());
+}
+
+void Vector3Array::Scale(float scale) {
+	Run<ScaleValues>(GetCount(), x.data(), scale);
+	Run<ScaleValues>(GetCount(), y.data(), scale);
+	Run<ScaleValues>(GetCount(), z.data(), scale);
+}
+
+void Vector3Array::Normalize() {
+	Run<Normalize3D>(GetCount(), x.data(), y.data(), z.data());
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "Math.h"
+#include <vector>
+#include <cstddef>
+
+//*** VECTORARRAYS ***
+//
+//
+
+// Points stored as one array per coordinate instead of one struct per point. A point takes only
+// the floats it uses, and the operations below work on eight points at a time with AVX, four with
+// SSE and one at a time for whatever is left.
+struct Vector2DArray {
+	std::vector<float> x{};
+	std::vector<float> y{};
+
+	void Append(const Vector2D& point);
+	Vector2D Get(size_t index) const { return Vector2D{ x[index], y[index] }; }
+
+	void Reserve(size_t count);
+	void Resize(size_t count);
+	void Clear();
+	size_t GetCount() const { return x.size(); }
+
+	// Every point through the matrix, in the xy plane. The result may be this array itself.
+	void Transform(const Matrix& matrix, Vector2DArray& result) const;
+	void Add(const Vector2D& offset);
+	// Both arrays must hold the same number of points
+	void Add(const Vector2DArray& other);
+	void Scale(float scale);
+	// Zero length vectors stay zero
+	void Normalize();
+};
+
+struct Vector3Array {
+	std::vector<float> x{};
+	std::vector<float> y{};
+	std::vector<float> z{};
+
+	void Append(const Vector3& point);
+	Vector3 Get(size_t index) const { return Vector3{ x[index], y[index], z[index] }; }
+
+	void Reserve(size_t count);
+	void Resize(size_t count);
+	void Clear();
+	size_t GetCount() const { return x.size(); }
+
+	// Every point through the matrix. The result may be this array itself.
+	void Transform(const Matrix& matrix, Vector3Array& result) const;
+	void Add(const Vector3& offset);
+	// Both arrays must hold the same number of points
+	void Add(const Vector3Array& other);
+	void Scale(float scale);
+	// Zero length vectors stay zero
+	void Normalize();
+};
@@ -3,13 +3,12 @@
 #include <math.h>
 #include <cassert>
 
-Vector2D::Vector2D(float x, float y, float w) {
+Vector2D::Vector2D(float x, float y) {
 	this->x = x;
 	this->y = y;
-	this->w = w;
 }
 
-float Vector2D::Magnitude() {
+float Vector2D::Magnitude() const {
 	return sqrtf(x * x + y * y);
 }
 
@@ -19,13 +18,28 @@ void Vector2D::Normalize() {
 	y /= magnitude;
 }
 
-Vector2D Vector2D::operator+(const Vector2D& other) {
-	return{ this->x + other.x, this->y + other.y, this->w };
+Vector2D Vector2D::operator+(const Vector2D& other) const {
+	return{ this->x + other.x, this->y + other.y };
+}
+
+Vector2D Vector2D::operator-(const Vector2D& other) const {
+	return{ this->x - other.x, this->y - other.y };
+}
+
+Vector2D Vector2D::operator*(float scale) const {
+	return{ this->x * scale, this->y * scale };
 }
 
-void Vector2D::operator*=(const float& scale) {
+Vector2D& Vector2D::operator+=(const Vector2D& other) {
+	this->x += other.x;
+	this->y += other.y;
+	return *this;
+}
+
+Vector2D& Vector2D::operator*=(float scale) {
 	this->x *= scale;
 	this->y *= scale;
+	return *this;
 }
 
 Vector3::Vector3(float x, float y, float z, float w) {
@@ -47,6 +61,26 @@ Vector3 Vector3::Cross(const Vector3& v1, const Vector3& v2) {
 	};
 }
 
-Vector3 Vector3::operator-(const Vector3 other) {
-	return Vector3{ x - other.x, y - other.y, z - other.z };
+float Vector3::Magnitude() const {
+	return sqrtf(x * x + y * y + z * z);
+}
+
+void Vector3::Normalize() {
+	const float magnitude = Magnitude();
+	x /= magnitude;
+	y /= magnitude;
+	z /= magnitude;
+}
+
+// Points and vectors combine the way their w says, a point plus a vector stays a point
+Vector3 Vector3::operator+(const Vector3& other) const {
+	return Vector3{ x + other.x, y + other.y, z + other.z, w + other.w };
+}
+
+Vector3 Vector3::operator-(const Vector3& other) const {
+	return Vector3{ x - other.x, y - other.y, z - other.z, w - other.w };
+}
+
+Vector3 Vector3::operator*(float scale) const {
+	return Vector3{ x * scale, y * scale, z * scale, w };
 }
\ No newline at end of file
@@ -14,7 +14,7 @@ Application::Application()
 		endPos.x = currentPos.x + segmentLength * cosf(currentAngle);
 		endPos.y = currentPos.y - segmentLength * sinf(currentAngle);
 
-		ENGINE->DrawLine(currentPos, endPos, riverWidth);
+		m_Segments.push_back(Segment{ currentPos, endPos, riverWidth });
 		currentPos = endPos;
 	});
 
@@ -27,18 +27,14 @@ Application::Application()
 	});
 
 	m_Fern->AddLeaveNode("[", [&]() {
-		savedPos.push_back(currentPos);
-		savedAngle.push_back(currentAngle);
-		savedWidth.push_back(riverWidth);
+		m_Saved.Push(TurtleState{ currentPos, currentAngle, riverWidth });
 	});
 
 	m_Fern->AddLeaveNode("]", [&]() {
-		currentPos = *(savedPos.end() - 1);
-		currentAngle = *(savedAngle.end() - 1);
-		riverWidth = *(savedWidth.end() - 1);
-		savedPos.pop_back();
-		savedAngle.pop_back();
-		savedWidth.pop_back();
+		const TurtleState& saved{ m_Saved.Pop() };
+		currentPos = saved.position;
+		currentAngle = saved.angle;
+		riverWidth = saved.width;
 	});
 
 	m_Fern->AddLeaveNode(">", [&]() {
@@ -58,6 +54,7 @@ Application::Application()
 	m_Fern->ParseRule("X", "X -> X & Segment # 0.7");
 
 	LNode< std::function<void()>>::SetDepth(10);
+	m_Saved.ReserveNesting(m_Fern->GetMaxNesting("X", "[", "]"));
 }
 
 Application::~Application() {
@@ -65,30 +62,97 @@ Application::~Application() {
 }
 
 void Application::Update(float elapsedSec) {
+	const bool isTogglePressed{ (GetAsyncKeyState('M') & 0x8000) != 0 };
+	if (isTogglePressed && !m_WasTogglePressed) {
+		m_IsWorldMode = !m_IsWorldMode;
+	}
+	m_WasTogglePressed = isTogglePressed;
+
+	if (m_IsWorldMode) {
+		UpdateWorld(elapsedSec);
+		return;
+	}
+
 	m_DepthTimer += elapsedSec;
 	if (m_DepthTimer > m_MaxDepthTimer) {
 		m_DepthTimer -= m_MaxDepthTimer;
 
 		// Generate new action vector
 		result = m_Fern->GenerateSequence("X");
+		BuildStrip();
 	}
 }
 
-void Application::Paint() {
-
-		ENGINE->ClearBackground();
+void Application::BuildStrip() {
 
 		// Set variables
-		savedPos.clear();
-		savedAngle.clear();
+		m_Saved.Clear();
+		m_Segments.clear();
 		segmentLength = 10.0f;
 		currentAngle = 0;
 		riverWidth = 25.0f;
 		currentPos = Vector2D{ 0, ENGINE->GetHeight()/2 };
 		endPos = Vector2D{ 0,0 };
-	
-	
+
 		for (auto action : result) {
 			action();
 		}
+
+		m_Strip.clear();
+		m_Tessellator.Tessellate(m_Segments, m_Strip);
+}
+
+void Application::Paint() {
+
+		if (m_IsWorldMode) {
+			PaintWorld();
+			return;
+		}
+
+		ENGINE->ClearBackground();
+		ENGINE->DrawTriangleStrip(m_Strip.data(), m_Strip.size());
+}
+
+void Application::UpdateWorld(float elapsedSec) {
+
+	// Arrow keys move the camera, without them it drifts downstream
+	float moveX{ 1.0f };
+	float moveY{ 0.0f };
+	if (GetAsyncKeyState(VK_LEFT) & 0x8000) moveX = -2.0f;
+	if (GetAsyncKeyState(VK_RIGHT) & 0x8000) moveX = 2.0f;
+	if (GetAsyncKeyState(VK_UP) & 0x8000) moveY = -2.0f;
+	if (GetAsyncKeyState(VK_DOWN) & 0x8000) moveY = 2.0f;
+
+	m_CameraX += double(moveX * m_CameraSpeed * elapsedSec);
+	m_CameraY += double(moveY * m_CameraSpeed * elapsedSec);
+	m_World.Update(m_CameraX, m_CameraY, ENGINE->GetWidth(), ENGINE->GetHeight());
+}
+
+void Application::PaintWorld() {
+
+	ENGINE->ClearBackground();
+
+	m_VisibleTiles.clear();
+	m_World.GetVisibleTiles(m_VisibleTiles);
+
+	for (const std::shared_ptr<const RiverTile>& pTile : m_VisibleTiles) {
+		// Offsets in double, segments are relative to their tile
+		const float originX{ float(double(pTile->coordinate.x) * RiverWorld::TileSize - m_CameraX) };
+		const float originY{ float(double(pTile->coordinate.y) * RiverWorld::TileSize - m_CameraY) };
+
+		ENGINE->DrawTriangleStrip(pTile->strip.data(), pTile->strip.size(), originX, originY);
+	}
+
+	// A marker in the middle of the view, the way a player would test for water
+	const float middleX{ ENGINE->GetWidth() / 2 };
+	const float middleY{ ENGINE->GetHeight() / 2 };
+	const WorldPosition middle{ m_CameraX + middleX, m_CameraY + middleY };
+	bool isInRiver{ false };
+	m_World.QueryNearRiver(&middle, 1, 0.0f, &isInRiver);
+
+	ENGINE->DrawLine(Vector2D{ middleX - 5, middleY }, Vector2D{ middleX + 5, middleY });
+	ENGINE->DrawLine(Vector2D{ middleX, middleY - 5 }, Vector2D{ middleX, middleY + 5 });
+
+	ENGINE->DrawString("Tiles: " + std::to_string(m_World.GetTileCount()) + ", generating: " + std::to_string(m_World.GetPendingCount())
+		+ (isInRiver ? ", in the river" : ""));
 }
\ No newline at end of file
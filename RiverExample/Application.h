@@ -5,6 +5,9 @@
 #include "Math.h"
 #include <vector>
 #include "Grammar.h"
+#include "RiverWorld.h"
+#include "StrokeTessellator.h"
+#include "StateStack.h"
 #include <functional>
 
 class Application final{
@@ -31,13 +34,35 @@ class Application final{
 		float m_DepthTimer{ 0.0f };
 		float m_MaxDepthTimer{ 1.5f };
 
-		std::vector<Vector2D> savedPos{};
-		std::vector<float> savedAngle{ };
-		std::vector<float> savedWidth{ };
+		struct TurtleState {
+			Vector2D position{ 0, 0 };
+			float angle{ 0.0f };
+			float width{ 0.0f };
+		};
+		StateStack<TurtleState> m_Saved{};
 
 		float segmentLength{ };
 		float currentAngle{};
 		float riverWidth{};
 		Vector2D currentPos{0,0 };
 		Vector2D endPos{ 0,0};
+
+		// Runs the actions of the last generation and turns the river into one strip
+		void BuildStrip();
+
+		std::vector<Segment> m_Segments{};
+		std::vector<StrokeVertex> m_Strip{};
+		StrokeTessellator m_Tessellator{};
+
+		// World mode, M switches to it and back
+		void UpdateWorld(float elapsedSec);
+		void PaintWorld();
+
+		RiverWorld m_World{ 20230122 };
+		std::vector<std::shared_ptr<const RiverTile>> m_VisibleTiles{};
+		bool m_IsWorldMode{ false };
+		bool m_WasTogglePressed{ false };
+		double m_CameraX{ 0.0 };
+		double m_CameraY{ 0.0 };
+		float m_CameraSpeed{ 200.0f };
 };
\ No newline at end of file
@@ -4,7 +4,9 @@
 #include "framework.h"
 #include "GameEngine.h"
 #include "Application.h"
+#include "StrokeTessellator.h"
 #include <sstream>
+#include <utility>
 
 HINSTANCE Engine::m_Instance{};
 Engine* Engine::m_pEngine{ nullptr };
@@ -203,6 +205,49 @@ void Engine::DrawLine(const Vector2D& start, const Vector2D& end, float width) {
     DeleteObject(blackPen);     // delete black Pen 
 }
 
+void Engine::DrawTriangleStrip(const StrokeVertex* pVertices, size_t count, float offsetX, float offsetY) {
+
+    // Every triangle is one polygon of a single PolyPolygon call, so the strip takes one brush.
+    // All are turned the same way, overlaps would cancel out under the winding rule otherwise.
+    m_StripPoints.clear();
+    m_StripCounts.clear();
+    for (size_t index{ 2 }; index < count; ++index) {
+        POINT first{ LONG(pVertices[index - 2].x + offsetX), LONG(pVertices[index - 2].y + offsetY) };
+        POINT second{ LONG(pVertices[index - 1].x + offsetX), LONG(pVertices[index - 1].y + offsetY) };
+        POINT third{ LONG(pVertices[index].x + offsetX), LONG(pVertices[index].y + offsetY) };
+
+        // Degenerate links between polylines have no area, neither have slivers under a pixel
+        const LONG area{ (second.x - first.x) * (third.y - first.y) - (second.y - first.y) * (third.x - first.x) };
+        if (area == 0) {
+            continue;
+        }
+        if (area < 0) {
+            std::swap(second, third);
+        }
+
+        m_StripPoints.push_back(first);
+        m_StripPoints.push_back(second);
+        m_StripPoints.push_back(third);
+        m_StripCounts.push_back(3);
+    }
+
+    if (m_StripCounts.empty()) {
+        return;
+    }
+
+    HBRUSH hNewBrush = CreateSolidBrush(RGB(0, 128, 255));
+    HBRUSH hOldBrush = (HBRUSH)SelectObject(m_DrawDC, hNewBrush);
+    HPEN hOldPen = (HPEN)SelectObject(m_DrawDC, GetStockObject(NULL_PEN));
+    const int oldFillMode = SetPolyFillMode(m_DrawDC, WINDING);
+
+    PolyPolygon(m_DrawDC, m_StripPoints.data(), m_StripCounts.data(), int(m_StripCounts.size()));
+
+    SetPolyFillMode(m_DrawDC, oldFillMode);
+    SelectObject(m_DrawDC, hOldPen);
+    SelectObject(m_DrawDC, hOldBrush);
+    DeleteObject(hNewBrush);
+}
+
 void Engine::ClearBackground() {
     HBRUSH hOldBrush, hNewBrush = CreateSolidBrush(RGB(50,100,50));
     HPEN hOldPen, hNewPen = CreatePen(PS_SOLID, 1, RGB(255, 255, 255));
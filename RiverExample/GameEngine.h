@@ -3,10 +3,12 @@
 #include "resource.h"
 #include "Math.h"
 #include <string>
+#include <vector>
 #include <chrono>
 #include <ctime> 
 
 class Application;
+struct StrokeVertex;
 
 class Engine final{
 
@@ -29,6 +31,7 @@ class Engine final{
 		float GetHeight();
 
 		void DrawLine(const Vector2D& start, const Vector2D& end, float width = 1.0f);
+		void DrawTriangleStrip(const StrokeVertex* pVertices, size_t count, float offsetX = 0.0f, float offsetY = 0.0f);
 		void ClearBackground();
 		void DrawString(const std::string& text, RECT position = RECT{0,0,500,500});
 
@@ -50,6 +53,10 @@ class Engine final{
 		const int FPS = 200;
 
 		float m_ElapsedSec;
+
+		// Triangles of the last strip, kept to save allocations between draws
+		std::vector<POINT> m_StripPoints;
+		std::vector<INT> m_StripCounts;
 		std::chrono::steady_clock::time_point m_CurrentTime = std::chrono::high_resolution_clock::now();
 		bool m_IsRunning;
 };
@@ -27,10 +27,17 @@ class Grammar
 		Grammar& operator=(Grammar&&) = delete;
 
 		std::vector<Data> GenerateSequence(std::string rule);
+		// Streams the sequence instead of collecting it, for sequences too long to hold
+		void GenerateSequence(const std::string& ruleName, const Visitor<Data>& visit);
 
 		void ParseRule(const std::string& name, const std::string& rule);
 		void AddLeaveNode(const std::string& name, const Data& data);
 
+		// Deepest nesting of the open leaf in what the rule can generate at the current LNode depth,
+		// so turtle stacks can be sized before drawing. UnboundedNesting when a repeat nests deeper
+		// every time, the caller picks a size itself then.
+		int GetMaxNesting(const std::string& ruleName, const std::string& open, const std::string& close) const;
+
 	private:
 		std::unordered_map<std::string,std::shared_ptr<Node<Data>>> m_pRules;
 
@@ -56,15 +63,43 @@ Grammar<Data>::Grammar()
 template<typename Data>
 std::vector<Data> Grammar<Data>::GenerateSequence(std::string ruleName) {
 
-	if (m_pRules.find(ruleName) == m_pRules.end()) {
+	// Only looked up, so several threads can generate from the same grammar
+	const auto rule{ m_pRules.find(ruleName) };
+	if (rule == m_pRules.end()) {
 		throw Rule404Exception{};
 	}
 
 	std::vector<Data> result{};
-	m_pRules[ruleName]->Parse(result, 0);
+	rule->second->Parse(result, 0);
 	return result;
 }
 
+template<typename Data>
+void Grammar<Data>::GenerateSequence(const std::string& ruleName, const Visitor<Data>& visit) {
+
+	const auto rule{ m_pRules.find(ruleName) };
+	if (rule == m_pRules.end()) {
+		throw Rule404Exception{};
+	}
+
+	rule->second->Parse(visit, 0);
+}
+
+template<typename Data>
+int Grammar<Data>::GetMaxNesting(const std::string& ruleName, const std::string& open, const std::string& close) const {
+
+	const auto rule{ m_pRules.find(ruleName) };
+	const auto openRule{ m_pRules.find(open) };
+	const auto closeRule{ m_pRules.find(close) };
+	if (rule == m_pRules.end() || openRule == m_pRules.end() || closeRule == m_pRules.end()) {
+		throw Rule404Exception{};
+	}
+
+	NestingCache<Data> cache{ openRule->second.get(), closeRule->second.get() };
+	const Nesting nesting{ rule->second->Measure(cache, 0) };
+	return nesting.unbounded ? UnboundedNesting : nesting.deepest;
+}
+
 template<typename Data>
 void Grammar<Data>::AddSingleRule(const std::string& name, const std::string& rule) {
 
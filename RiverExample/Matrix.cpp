@@ -1,6 +1,6 @@
 #include "Math.h"
 
-Vector3 Matrix::Transform(const Vector3& vector) {
+Vector3 Matrix::Transform(const Vector3& vector) const {
 	Vector3 result{0,0,0};
 	result.x = data[0].x * vector.x + data[0].y * vector.y + data[0].z * vector.z + data[0].w * vector.w;
 	result.y = data[1].x * vector.x + data[1].y * vector.y + data[1].z * vector.z + data[1].w * vector.w;
@@ -8,5 +8,5 @@ struct Matrix {
 		{0,0,0,1},
 	};
 
-	Vector3 Transform(const Vector3& vector);
+	Vector3 Transform(const Vector3& vector) const;
 };
\ No newline at end of file
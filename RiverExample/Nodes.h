@@ -2,12 +2,47 @@
 #include <vector>
 #include <string>
 #include <algorithm>
+#include <map>
 #include <random>
+#include <functional>
+#include "Random.h"
+
+// Fixed default seed, the examples draw the same shapes on every run and platform.
+// One engine per thread, a thread can reseed it without affecting generation elsewhere.
+inline std::mt19937& GrammarEngine() {
+	thread_local std::mt19937 engine{};
+	return engine;
+}
 
 //*** NODE ***
 //
 //
 
+template<typename Data>
+using Visitor = std::function<void(const Data&)>;
+
+// Bracket nesting of what a node can generate, relative to the level it starts at
+struct Nesting {
+	int change;		// Level at the end
+	int deepest;	// Highest level on the way
+	bool unbounded;	// A repeat can nest deeper each time, deepest is only its first pass then
+};
+
+// What Grammar::GetMaxNesting returns when the nesting has no bound
+constexpr int UnboundedNesting{ -1 };
+
+template<typename Data>
+class Node;
+
+// Brackets to measure and the result of every node at every LNode depth measured so far,
+// so each is measured once and the walk stays within nodes times depths
+template<typename Data>
+struct NestingCache {
+	const Node<Data>* pOpen;
+	const Node<Data>* pClose;
+	std::map<std::pair<const Node<Data>*, int>, Nesting> results{};
+};
+
 template<typename Data>
 class Node {
 	public:
@@ -19,13 +54,39 @@ class Node {
 		Node& operator=(const Node&) = delete;
 		Node& operator=(Node&&) = delete;
 
-		virtual void Parse(std::vector<Data>& result, int depth) = 0;
+		// Appends what the visitor walk generates, so both ways draw the same elements
+		void Parse(std::vector<Data>& result, int depth);
+		// Hands every element to visit as it is generated
+		virtual void Parse(const Visitor<Data>& visit, int depth) = 0;
 		virtual void SwapDependingNode(Node<Data>* oldNode, Node<Data>* newNode) = 0;
+		// Walks the same LNode depths as Parse, taking the deepest choice wherever chance decides.
+		// Measure looks the node up in the cache first, nodes measure their children through it.
+		Nesting Measure(NestingCache<Data>& cache, int depth) const;
+		virtual Nesting MeasureNesting(NestingCache<Data>& cache, int depth) const = 0;
 };
 
 template<typename Data>
 Node<Data>::Node() {};
 
+template<typename Data>
+void Node<Data>::Parse(std::vector<Data>& result, int depth) {
+	Parse([&result](const Data& value) { result.push_back(value); }, depth);
+}
+
+template<typename Data>
+Nesting Node<Data>::Measure(NestingCache<Data>& cache, int depth) const {
+
+	const auto key{ std::make_pair(this, depth) };
+	const auto found{ cache.results.find(key) };
+	if (found != cache.results.end()) {
+		return found->second;
+	}
+
+	const Nesting nesting{ MeasureNesting(cache, depth) };
+	cache.results.emplace(key, nesting);
+	return nesting;
+}
+
 //*** LEAFNODE ***
 //
 //
@@ -42,8 +103,9 @@ class LeafNode : public Node<Data>
 		LeafNode& operator=(const LeafNode&) = delete;
 		LeafNode& operator=(LeafNode&&) = delete;
 
-		virtual void Parse(std::vector<Data>& result, int depth) override;
+		virtual void Parse(const Visitor<Data>& visit, int depth) override;
 		virtual void SwapDependingNode(Node<Data>* oldNode, Node<Data>* newNode) override;
+		virtual Nesting MeasureNesting(NestingCache<Data>& cache, int depth) const override;
 
 	private:
 		Data m_Value;
@@ -55,9 +117,8 @@ LeafNode<Data>::LeafNode(Data value)
 {}
 
 template<typename Data>
-void LeafNode<Data>::Parse(std::vector<Data>& result, int depth) {
-
-	result.push_back(m_Value);
+void LeafNode<Data>::Parse(const Visitor<Data>& visit, int) {
+	visit(m_Value);
 }
 
 template<typename Data>
@@ -65,6 +126,17 @@ void LeafNode<Data>::SwapDependingNode(Node<Data>* oldNode, Node<Data>* newNode)
 	// No node dependencies
 }
 
+template<typename Data>
+Nesting LeafNode<Data>::MeasureNesting(NestingCache<Data>& cache, int depth) const {
+	if (this == cache.pOpen) {
+		return Nesting{ 1, 1, false };
+	}
+	if (this == cache.pClose) {
+		return Nesting{ -1, 0, false };
+	}
+	return Nesting{ 0, 0, false };
+}
+
 //*** SELECTNODE ***
 //
 //
@@ -81,8 +153,9 @@ class SelectNode : public Node<Data>
 		SelectNode& operator=(const SelectNode&) = delete;
 		SelectNode& operator=(SelectNode&&) = delete;
 
-		virtual void Parse(std::vector<Data>& result, int depth) override;
+		virtual void Parse(const Visitor<Data>& visit, int depth) override;
 		virtual void SwapDependingNode(Node<Data>* oldNode, Node<Data>* newNode) override;
+		virtual Nesting MeasureNesting(NestingCache<Data>& cache, int depth) const override;
 		void AddOption(Node<Data>* option, float weight);
 
 	private:
@@ -96,11 +169,11 @@ template<typename Data>
 SelectNode<Data>::SelectNode() {};
 
 template<typename Data>
-void SelectNode<Data>::Parse(std::vector<Data>& result, int depth) {
+void SelectNode<Data>::Parse(const Visitor<Data>& visit, int depth) {
 
 	if (m_pOptions.size() > 0) {
 		int index{ WeightedRandom() };
-		m_pOptions[index].first->Parse(result, depth);
+		m_pOptions[index].first->Parse(visit, depth);
 	}
 }
 
@@ -113,6 +186,23 @@ void SelectNode<Data>::SwapDependingNode(Node<Data>* oldNode, Node<Data>* newNod
 	}
 }
 
+template<typename Data>
+Nesting SelectNode<Data>::MeasureNesting(NestingCache<Data>& cache, int depth) const {
+
+	if (m_pOptions.empty()) {
+		return Nesting{ 0, 0, false };
+	}
+
+	Nesting nesting{ m_pOptions.front().first->Measure(cache, depth) };
+	for (auto option{ m_pOptions.begin() + 1 }; option != m_pOptions.end(); ++option) {
+		const Nesting optionNesting{ option->first->Measure(cache, depth) };
+		nesting.change = std::max(nesting.change, optionNesting.change);
+		nesting.deepest = std::max(nesting.deepest, optionNesting.deepest);
+		nesting.unbounded = nesting.unbounded || optionNesting.unbounded;
+	}
+	return nesting;
+}
+
 template<typename Data>
 void SelectNode<Data>::AddOption(Node<Data>* option, float weight) {
 	m_pOptions.push_back(std::make_pair(option, weight));
@@ -121,7 +211,7 @@ void SelectNode<Data>::AddOption(Node<Data>* option, float weight) {
 
 template<typename Data>
 int SelectNode<Data>::WeightedRandom() {
-	float randomWeight{ float(((rand() % 100)/100.0f ) * m_WeightsSum) };
+	float randomWeight{ UniformFloat(GrammarEngine()) * m_WeightsSum };
 
 	for (int index{ 0 }; index < m_pOptions.size(); ++index) {
 		randomWeight -= m_pOptions[index].second;
@@ -148,8 +238,9 @@ public:
 	SequenceNode& operator=(const SequenceNode&) = delete;
 	SequenceNode& operator=(SequenceNode&&) = delete;
 
-	virtual void Parse(std::vector<Data>& result, int depth) override;
+	virtual void Parse(const Visitor<Data>& visit, int depth) override;
 	virtual void SwapDependingNode(Node<Data>* oldNode, Node<Data>* newNode) override;
+	virtual Nesting MeasureNesting(NestingCache<Data>& cache, int depth) const override;
 	void AddElement(Node<Data>* option);
 
 private:
@@ -160,10 +251,10 @@ template<typename Data>
 SequenceNode<Data>::SequenceNode() {};
 
 template<typename Data>
-void SequenceNode<Data>::Parse(std::vector<Data>& result, int depth) {
+void SequenceNode<Data>::Parse(const Visitor<Data>& visit, int depth) {
 
 	for (auto& element : m_pElements) {
-		element->Parse(result, depth);
+		element->Parse(visit, depth);
 	}
 }
 
@@ -176,6 +267,19 @@ void SequenceNode<Data>::SwapDependingNode(Node<Data>* oldNode, Node<Data>* newN
 	}
 }
 
+template<typename Data>
+Nesting SequenceNode<Data>::MeasureNesting(NestingCache<Data>& cache, int depth) const {
+
+	Nesting nesting{ 0, 0, false };
+	for (const auto& element : m_pElements) {
+		const Nesting elementNesting{ element->Measure(cache, depth) };
+		nesting.deepest = std::max(nesting.deepest, nesting.change + elementNesting.deepest);
+		nesting.change += elementNesting.change;
+		nesting.unbounded = nesting.unbounded || elementNesting.unbounded;
+	}
+	return nesting;
+}
+
 template<typename Data>
 void SequenceNode<Data>::AddElement(Node<Data>* option) {
 	m_pElements.push_back(option);
@@ -197,8 +301,9 @@ public:
 	RepetitionNode& operator=(const RepetitionNode&) = delete;
 	RepetitionNode& operator=(RepetitionNode&&) = delete;
 
-	virtual void Parse(std::vector<Data>& result, int depth) override;
+	virtual void Parse(const Visitor<Data>& visit, int depth) override;
 	virtual void SwapDependingNode(Node<Data>* oldNode, Node<Data>* newNode) override;
+	virtual Nesting MeasureNesting(NestingCache<Data>& cache, int depth) const override;
 
 private:
 	Node<Data>* m_pNode;
@@ -212,12 +317,12 @@ RepetitionNode<Data>::RepetitionNode(Node<Data>* node, float chance)
 {}
 
 template<typename Data>
-void RepetitionNode<Data>::Parse(std::vector<Data>& result, int depth) {
+void RepetitionNode<Data>::Parse(const Visitor<Data>& visit, int depth) {
 
 	do {
-		m_pNode->Parse(result, depth);
-	} 
-	while (float((rand() % 100)/100.0f) <= m_RepetitionChance);
+		m_pNode->Parse(visit, depth);
+	}
+	while (UniformFloat(GrammarEngine()) <= m_RepetitionChance);
 }
 
 template<typename Data>
@@ -227,6 +332,17 @@ void RepetitionNode<Data>::SwapDependingNode(Node<Data>* oldNode, Node<Data>* ne
 	}
 }
 
+template<typename Data>
+Nesting RepetitionNode<Data>::MeasureNesting(NestingCache<Data>& cache, int depth) const {
+	// Repeats of a node that ends where it started, or lower, reach no deeper than the first one.
+	// A node that opens more than it closes nests deeper with every repeat, so there is no bound.
+	Nesting nesting{ m_pNode->Measure(cache, depth) };
+	if (nesting.change > 0) {
+		nesting.unbounded = true;
+	}
+	return nesting;
+}
+
 //*** LNODE ***
 //
 //
@@ -242,8 +358,9 @@ public:
 	LNode& operator=(const LNode&) = delete;
 	LNode& operator=(LNode&&) = delete;
 
-	virtual void Parse(std::vector<Data>& result, int depth) override;
+	virtual void Parse(const Visitor<Data>& visit, int depth) override;
 	virtual void SwapDependingNode(Node<Data>* oldNode, Node<Data>* newNode) override;
+	virtual Nesting MeasureNesting(NestingCache<Data>& cache, int depth) const override;
 	static void SetDepth(int depth) { MaxDepth = depth; }
 
 private:
@@ -262,16 +379,14 @@ LNode<Data>::LNode(Node<Data>* node, std::shared_ptr<Node<Data>> fallback)
 {}
 
 template<typename Data>
-void LNode<Data>::Parse(std::vector<Data>& result, int depth) {
+void LNode<Data>::Parse(const Visitor<Data>& visit, int depth) {
 
 	if (depth >= MaxDepth) {
-		m_pFallback->Parse(result, 0);
+		m_pFallback->Parse(visit, 0);
 		return;
 	}
 
-	m_pNode->Parse(result, ++depth);
-	--depth;
-
+	m_pNode->Parse(visit, depth + 1);
 }
 
 template<typename Data>
@@ -279,4 +394,13 @@ void LNode<Data>::SwapDependingNode(Node<Data>* oldNode, Node<Data>* newNode) {
 	if (m_pNode == oldNode) {
 		m_pNode = newNode;
 	}
+}
+
+template<typename Data>
+Nesting LNode<Data>::MeasureNesting(NestingCache<Data>& cache, int depth) const {
+
+	if (depth >= MaxDepth) {
+		return m_pFallback->Measure(cache, 0);
+	}
+	return m_pNode->Measure(cache, depth + 1);
 }
\ No newline at end of file
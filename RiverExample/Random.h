@@ -0,0 +1,41 @@
+#pragma once
+#include <cstdint>
+
+//*** RANDOM ***
+//
+//
+
+// Conversions from raw engine output to numbers, defined bit for bit so every standard library
+// and platform produces the same results. Engines have to return full 32 or 64 bit words,
+// like std::mt19937 and std::mt19937_64, whose output the standard does pin down.
+
+template<typename Engine>
+inline uint32_t RandomBits(Engine& engine) {
+	static_assert(Engine::min() == 0 && (Engine::max() == 0xFFFFFFFFull || Engine::max() == 0xFFFFFFFFFFFFFFFFull),
+		"Engine has to produce full 32 or 64 bit words");
+
+	// Of a 64 bit word the upper half is used, its bits are the strongest
+	return Engine::max() == 0xFFFFFFFFull ? static_cast<uint32_t>(engine()) : static_cast<uint32_t>(static_cast<uint64_t>(engine()) >> 32);
+}
+
+// [0, 1) in steps of 2^-24, every value is exactly representable as a float
+template<typename Engine>
+inline float UniformFloat(Engine& engine) {
+	return static_cast<float>(RandomBits(engine) >> 8) * (1.0f / 16777216.0f);
+}
+
+// [0, range) without modulo bias, multiply and shift with rejection of the few biased values
+template<typename Engine>
+inline uint32_t UniformInt(Engine& engine, uint32_t range) {
+
+	uint64_t product{ static_cast<uint64_t>(RandomBits(engine)) * range };
+	uint32_t low{ static_cast<uint32_t>(product) };
+	if (low < range) {
+		const uint32_t threshold{ (0u - range) % range };
+		while (low < threshold) {
+			product = static_cast<uint64_t>(RandomBits(engine)) * range;
+			low = static_cast<uint32_t>(product);
+		}
+	}
+	return static_cast<uint32_t>(product >> 32);
+}
@@ -0,0 +1,427 @@
+#include "RiverWorld.h"
+#include <cmath>
+#include <cstdlib>
+#include <iterator>
+#include <algorithm>
+
+namespace {
+	constexpr int AnchorSpacing{ 8 };			// Tiles from one anchor to the next
+	constexpr int PrefetchMargin{ 1 };			// Tiles around the view that are generated ahead
+	constexpr int EvictionMargin{ 3 };			// Tiles around the view that are kept
+	constexpr int MaxGenerations{ 64 };			// Grammar runs before a tile gives up on reaching its border
+	constexpr float BankMargin{ 96.0f };		// Distance the main river keeps from the top and bottom of its row
+	constexpr float MinWidth{ 14.0f };
+	constexpr float MaxWidth{ 30.0f };
+	constexpr float MaxAnchorAngle{ 20.0f * TO_RADIANS };
+	constexpr float IndexCellSize{ 32.0f };
+
+	constexpr unsigned long long GrammarSalt{ 0x6772616D6D6172ull };
+	constexpr unsigned long long AnchorSalt{ 0x616E63686F72ull };
+
+	// SplitMix64 finalizer, every input bit reaches every output bit
+	unsigned long long Mix(unsigned long long value) {
+		value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ull;
+		value = (value ^ (value >> 27)) * 0x94D049BB133111EBull;
+		return value ^ (value >> 31);
+	}
+
+	// 16 bits of the hash as [0, 1)
+	float UnitFloat(unsigned long long hash, int shift) {
+		return float((hash >> shift) & 0xFFFF) / 65536.0f;
+	}
+
+	// Moves the tile onto the anchor at its right border, given relative to the anchor tile. The shift grows from nothing at the
+	// left border to the full difference at the right one, so both borders stay where they were.
+	void BendToAnchor(RiverTile& tile, const RiverState& anchor) {
+		const float offset{ anchor.position.y - tile.exit.position.y };
+		const float widthScale{ anchor.width / tile.exit.width };
+		auto share = [](float x) { return std::min(std::max(x / RiverWorld::TileSize, 0.0f), 1.0f); };
+
+		for (RiverSegment& segment : tile.segments) {
+			const float startShare{ share(segment.start.x) };
+			const float endShare{ share(segment.end.x) };
+			segment.start.y += offset * startShare;
+			segment.end.y += offset * endShare;
+			segment.width *= 1.0f + (widthScale - 1.0f) * 0.5f * (startShare + endShare);
+		}
+		tile.exit = anchor;
+		tile.exit.position.x += RiverWorld::TileSize;
+	}
+}
+
+size_t TileCoordinateHash::operator()(const TileCoordinate& coordinate) const {
+	return size_t(Mix((static_cast<unsigned long long>(static_cast<unsigned int>(coordinate.x)) << 32) | static_cast<unsigned int>(coordinate.y)));
+}
+
+//*** RIVERTURTLE ***
+//
+//
+
+void RiverTurtle::Forward() {
+	const bool isMainRiver{ saved.IsEmpty() };
+
+	// The main river bounces off the banks of its row, so rows never run into each other
+	if (isMainRiver && ((state.position.y < bankTop && state.angle > 0.0f) || (state.position.y > bankBottom && state.angle < 0.0f))) {
+		state.angle = -state.angle;
+	}
+
+	Vector2D end{ state.position.x + segmentLength * cosf(state.angle), state.position.y - segmentLength * sinf(state.angle) };
+
+	// Cut at the border, the next tile picks the river up from there
+	if (isMainRiver && end.x >= exitX) {
+		const float share{ (exitX - state.position.x) / (end.x - state.position.x) };
+		end = Vector2D{ exitX, state.position.y + (end.y - state.position.y) * share };
+		hasExited = true;
+	}
+
+	pSegments->push_back(RiverSegment{ state.position, end, state.width });
+	state.position = end;
+}
+
+void RiverTurtle::Turn(float direction) {
+	state.angle = std::min(std::max(state.angle + direction * turnAngle, -maxAngle), maxAngle);
+}
+
+void RiverTurtle::Push() {
+	saved.Push(state);
+}
+
+void RiverTurtle::Pop() {
+	state = saved.Pop();
+}
+
+void RiverTurtle::Narrow() {
+	state.width *= 0.8f;
+}
+
+//*** RIVERWORLD ***
+//
+//
+
+bool RiverWorld::TileRange::Contains(const TileCoordinate& coordinate, int margin) const {
+	return coordinate.x >= left - margin && coordinate.x <= right + margin && coordinate.y >= top - margin && coordinate.y <= bottom + margin;
+}
+
+RiverWorld::RiverWorld(unsigned long long seed, unsigned int threadCount)
+	: m_Seed{ seed }
+{
+	m_Grammar.AddLeaveNode("F", [](RiverTurtle& turtle) { turtle.Forward(); });
+	m_Grammar.AddLeaveNode("-", [](RiverTurtle& turtle) { turtle.Turn(-1.0f); });
+	m_Grammar.AddLeaveNode("+", [](RiverTurtle& turtle) { turtle.Turn(1.0f); });
+	m_Grammar.AddLeaveNode("[", [](RiverTurtle& turtle) { turtle.Push(); });
+	m_Grammar.AddLeaveNode("]", [](RiverTurtle& turtle) { turtle.Pop(); });
+	m_Grammar.AddLeaveNode(">", [](RiverTurtle& turtle) { turtle.Narrow(); });
+	m_Grammar.AddLeaveNode("X", [](RiverTurtle&) {});
+
+	// The river of the single river mode, except that only forks narrow, a river crossing many
+	// tiles would dry up otherwise
+	m_Grammar.ParseRule("Forward", "F -> F # 0.4");
+	m_Grammar.ParseRule("Right", "F -> - & Forward");
+	m_Grammar.ParseRule("Left", "F -> + & Forward");
+	m_Grammar.ParseRule("TurnRight", "Right # 0.4");
+	m_Grammar.ParseRule("TurnLeft", "Left # 0.4");
+	m_Grammar.ParseRule("Fork", "F -> [ & > & > # 0.3 & X # 0.5 & ]");
+	m_Grammar.ParseRule("Segment", "F -> 0.4 Forward | 0.6 TurnRight | 0.6 TurnLeft | 0.1 Fork");
+	m_Grammar.ParseRule("X", "X -> X & Segment # 0.7");
+
+	LNode<RiverAction>::SetDepth(10);
+	m_MaxNesting = m_Grammar.GetMaxNesting("X", "[", "]");
+
+	if (threadCount == 0) {
+		threadCount = std::max(std::thread::hardware_concurrency(), 2u) - 1;
+	}
+	for (unsigned int index{ 0 }; index < threadCount; ++index) {
+		m_Workers.emplace_back(&RiverWorld::Work, this);
+	}
+}
+
+RiverWorld::~RiverWorld() {
+	{
+		std::lock_guard<std::mutex> lock{ m_Mutex };
+		m_IsStopping = true;
+	}
+	m_Condition.notify_all();
+
+	for (std::thread& worker : m_Workers) {
+		worker.join();
+	}
+}
+
+void RiverWorld::Update(double viewLeft, double viewTop, float viewWidth, float viewHeight) {
+
+	const TileRange view{
+		int(std::floor(viewLeft / TileSize)),
+		int(std::floor(viewTop / TileSize)),
+		int(std::floor((viewLeft + viewWidth) / TileSize)),
+		int(std::floor((viewTop + viewHeight) / TileSize))
+	};
+
+	std::lock_guard<std::mutex> lock{ m_Mutex };
+	m_View = view;
+
+	// Far tiles go, so memory stays the same however far the view travels. Entries are kept
+	// an anchor run further, they are small and save walking back from the anchor.
+	for (auto tile{ m_Tiles.begin() }; tile != m_Tiles.end();) {
+		tile = view.Contains(tile->first, EvictionMargin) ? std::next(tile) : m_Tiles.erase(tile);
+	}
+	for (auto entry{ m_Entries.begin() }; entry != m_Entries.end();) {
+		entry = view.Contains(entry->first, EvictionMargin + AnchorSpacing) ? std::next(entry) : m_Entries.erase(entry);
+	}
+	m_Pending.erase(std::remove_if(m_Pending.begin(), m_Pending.end(), [&](const TileCoordinate& coordinate) {
+		return !view.Contains(coordinate, PrefetchMargin);
+	}), m_Pending.end());
+
+	bool hasNewJobs{ false };
+	for (int y{ view.top - PrefetchMargin }; y <= view.bottom + PrefetchMargin; ++y) {
+		for (int x{ view.left - PrefetchMargin }; x <= view.right + PrefetchMargin; ++x) {
+			const TileCoordinate coordinate{ x, y };
+			if (m_Tiles.find(coordinate) != m_Tiles.end()
+				|| std::find(m_Pending.begin(), m_Pending.end(), coordinate) != m_Pending.end()
+				|| std::find(m_InProgress.begin(), m_InProgress.end(), coordinate) != m_InProgress.end()) {
+				continue;
+			}
+			m_Pending.push_back(coordinate);
+			hasNewJobs = true;
+		}
+	}
+
+	if (hasNewJobs) {
+		m_Condition.notify_all();
+	}
+}
+
+void RiverWorld::GetVisibleTiles(std::vector<std::shared_ptr<const RiverTile>>& tiles) const {
+
+	// Forks can run past the border of their tile, so the ring around the view is included
+	std::lock_guard<std::mutex> lock{ m_Mutex };
+	for (const auto& tile : m_Tiles) {
+		if (m_View.Contains(tile.first, 1)) {
+			tiles.push_back(tile.second);
+		}
+	}
+}
+
+void RiverWorld::QueryNearRiver(const WorldPosition* positions, size_t count, float radius, bool* results) const {
+
+	const TileMap tiles{ GetTiles() };
+	for (size_t query{ 0 }; query < count; ++query) {
+		const WorldPosition& position{ positions[query] };
+		const int tileX{ int(std::floor(position.x / TileSize)) };
+		const int tileY{ int(std::floor(position.y / TileSize)) };
+
+		// Forks reach past their tile, so the neighbours are asked as well
+		results[query] = false;
+		for (int y{ tileY - 1 }; y <= tileY + 1 && !results[query]; ++y) {
+			for (int x{ tileX - 1 }; x <= tileX + 1 && !results[query]; ++x) {
+				const auto tile{ tiles.find(TileCoordinate{ x, y }) };
+				if (tile == tiles.end()) {
+					continue;
+				}
+
+				const Vector2D point{ float(position.x - double(x) * TileSize), float(position.y - double(y) * TileSize) };
+				results[query] = tile->second->index.IsNear(point, radius);
+			}
+		}
+	}
+}
+
+void RiverWorld::QueryCrossesRiver(const WorldPosition* starts, const WorldPosition* ends, size_t count, bool* results) const {
+
+	const TileMap tiles{ GetTiles() };
+	for (size_t query{ 0 }; query < count; ++query) {
+		const WorldPosition& start{ starts[query] };
+		const WorldPosition& end{ ends[query] };
+		const int left{ int(std::floor(std::min(start.x, end.x) / TileSize)) - 1 };
+		const int top{ int(std::floor(std::min(start.y, end.y) / TileSize)) - 1 };
+		const int right{ int(std::floor(std::max(start.x, end.x) / TileSize)) + 1 };
+		const int bottom{ int(std::floor(std::max(start.y, end.y) / TileSize)) + 1 };
+
+		results[query] = false;
+		for (int y{ top }; y <= bottom && !results[query]; ++y) {
+			for (int x{ left }; x <= right && !results[query]; ++x) {
+				const auto tile{ tiles.find(TileCoordinate{ x, y }) };
+				if (tile == tiles.end()) {
+					continue;
+				}
+
+				const double originX{ double(x) * TileSize };
+				const double originY{ double(y) * TileSize };
+				results[query] = tile->second->index.Crosses(
+					Vector2D{ float(start.x - originX), float(start.y - originY) },
+					Vector2D{ float(end.x - originX), float(end.y - originY) });
+			}
+		}
+	}
+}
+
+size_t RiverWorld::GetTileCount() const {
+	std::lock_guard<std::mutex> lock{ m_Mutex };
+	return m_Tiles.size();
+}
+
+size_t RiverWorld::GetPendingCount() const {
+	std::lock_guard<std::mutex> lock{ m_Mutex };
+	return m_Pending.size() + m_InProgress.size();
+}
+
+void RiverWorld::Work() {
+
+	StrokeTessellator tessellator{};
+	while (true) {
+		TileCoordinate coordinate{};
+		{
+			std::unique_lock<std::mutex> lock{ m_Mutex };
+			m_Condition.wait(lock, [this]() { return m_IsStopping || !m_Pending.empty(); });
+			if (m_IsStopping) {
+				return;
+			}
+			if (!TakeJob(coordinate)) {
+				continue;
+			}
+		}
+
+		// Tiles are indexed and tessellated here rather than in GenerateTile, the tiles walked through
+		// in GetEntry are thrown away
+		const RiverState entry{ GetEntry(coordinate) };
+		std::shared_ptr<RiverTile> pNewTile{ std::make_shared<RiverTile>(GenerateTile(coordinate, entry)) };
+		pNewTile->index.Build(pNewTile->segments, IndexCellSize);
+		tessellator.Tessellate(pNewTile->segments, pNewTile->strip);
+		std::shared_ptr<const RiverTile> pTile{ pNewTile };
+
+		RiverState nextEntry{ pTile->exit };
+		nextEntry.position.x -= TileSize;
+
+		std::lock_guard<std::mutex> lock{ m_Mutex };
+		m_InProgress.erase(std::find(m_InProgress.begin(), m_InProgress.end(), coordinate));
+		m_Entries[TileCoordinate{ coordinate.x + 1, coordinate.y }] = nextEntry;
+
+		// The view may have moved on while the tile was made
+		if (m_View.Contains(coordinate, EvictionMargin)) {
+			m_Tiles[coordinate] = pTile;
+		}
+	}
+}
+
+// Takes the pending tile closest to the middle of the view, preferring tiles whose entry is
+// already known over tiles that have to walk back to their anchor first. Called with the lock held.
+bool RiverWorld::TakeJob(TileCoordinate& coordinate) {
+
+	if (m_Pending.empty()) {
+		return false;
+	}
+
+	const int centerX{ m_View.left + m_View.right };
+	const int centerY{ m_View.top + m_View.bottom };
+	auto cost = [&](const TileCoordinate& candidate) {
+		const bool isEntryKnown{ IsAnchor(candidate.x) || m_Entries.find(candidate) != m_Entries.end() };
+		return (isEntryKnown ? 0 : 1 << 24) + std::abs(2 * candidate.x - centerX) + std::abs(2 * candidate.y - centerY);
+	};
+
+	auto best{ std::min_element(m_Pending.begin(), m_Pending.end(), [&](const TileCoordinate& first, const TileCoordinate& second) {
+		return cost(first) < cost(second);
+	}) };
+	coordinate = *best;
+	m_Pending.erase(best);
+	m_InProgress.push_back(coordinate);
+	return true;
+}
+
+// Walks left to the nearest known entry or anchor, then generates forward to the tile
+RiverState RiverWorld::GetEntry(const TileCoordinate& coordinate) {
+
+	TileCoordinate current{ coordinate };
+	RiverState state{};
+	{
+		std::lock_guard<std::mutex> lock{ m_Mutex };
+		while (true) {
+			const auto entry{ m_Entries.find(current) };
+			if (entry != m_Entries.end()) {
+				state = entry->second;
+				break;
+			}
+			if (IsAnchor(current.x)) {
+				state = GetAnchor(current);
+				break;
+			}
+			--current.x;
+		}
+	}
+
+	for (; current.x < coordinate.x; ++current.x) {
+		state = GenerateTile(current, state).exit;
+		state.position.x -= TileSize;
+
+		std::lock_guard<std::mutex> lock{ m_Mutex };
+		m_Entries[TileCoordinate{ current.x + 1, current.y }] = state;
+	}
+	return state;
+}
+
+// The river state at the left border of an anchor tile, from the coordinates alone
+RiverState RiverWorld::GetAnchor(const TileCoordinate& coordinate) const {
+
+	const unsigned long long hash{ GetTileSeed(coordinate, AnchorSalt) };
+
+	RiverState state{};
+	state.position = Vector2D{ 0.0f, BankMargin + (TileSize - 2.0f * BankMargin) * UnitFloat(hash, 0) };
+	state.angle = (2.0f * UnitFloat(hash, 16) - 1.0f) * MaxAnchorAngle;
+	state.width = MinWidth + (MaxWidth - MinWidth) * UnitFloat(hash, 32);
+	return state;
+}
+
+RiverTile RiverWorld::GenerateTile(const TileCoordinate& coordinate, const RiverState& entry) {
+
+	RiverTile tile{ coordinate, {}, entry };
+
+	RiverTurtle turtle{};
+	turtle.state = entry;
+	turtle.pSegments = &tile.segments;
+	turtle.bankTop = BankMargin;
+	turtle.bankBottom = TileSize - BankMargin;
+	turtle.exitX = TileSize;
+	turtle.saved.ReserveNesting(m_MaxNesting);
+
+	// Every tile draws from its own stream, so it comes out the same on any thread at any time
+	const unsigned long long seed{ GetTileSeed(coordinate, GrammarSalt) };
+	GrammarEngine().seed(static_cast<std::mt19937::result_type>(seed ^ (seed >> 32)));
+
+	for (int generation{ 0 }; generation < MaxGenerations && !turtle.hasExited; ++generation) {
+		for (const RiverAction& action : m_Grammar.GenerateSequence("X")) {
+			action(turtle);
+			if (turtle.hasExited) {
+				break;
+			}
+		}
+		turtle.saved.Clear();
+	}
+
+	// Straight to the border, only when the grammar kept the river in the tile for too long
+	if (!turtle.hasExited) {
+		const Vector2D end{ TileSize, turtle.state.position.y };
+		tile.segments.push_back(RiverSegment{ turtle.state.position, end, turtle.state.width });
+		turtle.state.position = end;
+		turtle.state.angle = 0.0f;
+	}
+
+	tile.exit = turtle.state;
+	if (IsAnchor(coordinate.x + 1)) {
+		BendToAnchor(tile, GetAnchor(TileCoordinate{ coordinate.x + 1, coordinate.y }));
+	}
+	return tile;
+}
+
+unsigned long long RiverWorld::GetTileSeed(const TileCoordinate& coordinate, unsigned long long salt) const {
+	unsigned long long hash{ Mix(m_Seed ^ salt) };
+	hash = Mix(hash + static_cast<unsigned int>(coordinate.x));
+	return Mix(hash + static_cast<unsigned int>(coordinate.y));
+}
+
+// A copy of the tile pointers, so a batch of queries takes the lock only once
+RiverWorld::TileMap RiverWorld::GetTiles() const {
+	std::lock_guard<std::mutex> lock{ m_Mutex };
+	return m_Tiles;
+}
+
+bool RiverWorld::IsAnchor(int x) {
+	return (x % AnchorSpacing + AnchorSpacing) % AnchorSpacing == 0;
+}
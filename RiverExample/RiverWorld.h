@@ -0,0 +1,144 @@
+#pragma once
+
+#include "Math.h"
+#include "Grammar.h"
+#include "SegmentIndex.h"
+#include "StrokeTessellator.h"
+#include "StateStack.h"
+#include <vector>
+#include <memory>
+#include <functional>
+#include <unordered_map>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+//*** RIVERWORLD ***
+//
+//
+
+struct TileCoordinate {
+	int x;
+	int y;
+
+	bool operator==(const TileCoordinate& other) const { return x == other.x && y == other.y; }
+};
+
+struct TileCoordinateHash {
+	size_t operator()(const TileCoordinate& coordinate) const;
+};
+
+// Position relative to the tile it belongs to, so precision does not depend on how far out the tile is
+struct RiverState {
+	Vector2D position{ 0, 0 };
+	float angle{ 0.0f };
+	float width{ 0.0f };
+};
+
+using RiverSegment = Segment;
+
+struct RiverTile {
+	TileCoordinate coordinate;
+	std::vector<RiverSegment> segments;
+	RiverState exit;		// Where the river leaves through the right border
+	SegmentIndex index;		// Over the segments, in the same tile relative coordinates
+	std::vector<StrokeVertex> strip;	// The segments as one triangle strip, for drawing
+};
+
+struct WorldPosition {
+	double x;
+	double y;
+};
+
+// Turtle of a single tile generation. The grammar actions work on it instead of on shared state,
+// so any number of tiles can be generated at the same time.
+struct RiverTurtle {
+	RiverState state{};
+	StateStack<RiverState> saved{};
+	std::vector<RiverSegment>* pSegments{ nullptr };
+	float segmentLength{ 10.0f };
+	float turnAngle{ 5.0f * TO_RADIANS };
+	float maxAngle{ 60.0f * TO_RADIANS };
+	float bankTop{ 0.0f };
+	float bankBottom{ 0.0f };
+	float exitX{ 0.0f };
+	bool hasExited{ false };
+
+	void Forward();
+	void Turn(float direction);
+	void Push();
+	void Pop();
+	void Narrow();
+};
+
+using RiverAction = std::function<void(RiverTurtle&)>;
+
+// Rivers over an unbounded grid of square tiles, one river per tile row flowing to the right.
+// A tile is generated from a seed derived from its coordinates and starts where the river left
+// its left neighbour, so the world looks the same whatever order tiles are made in. Every few
+// tiles an anchor fixes the border state from its coordinates alone, which bounds how far back a
+// tile has to look; the tile before an anchor bends its river onto it. Tiles around the view are
+// made on worker threads and tiles far from it are dropped again.
+class RiverWorld final {
+
+	public:
+		// A thread count of 0 uses all but one hardware thread
+		RiverWorld(unsigned long long seed, unsigned int threadCount = 0);
+		~RiverWorld();
+
+		RiverWorld(const RiverWorld& ref) = delete;
+		RiverWorld(RiverWorld&& ref) = delete;
+		RiverWorld& operator=(const RiverWorld& ref) = delete;
+		RiverWorld& operator=(RiverWorld&& ref) = delete;
+
+		// Requests the tiles around the view and evicts far ones, in world coordinates
+		void Update(double viewLeft, double viewTop, float viewWidth, float viewHeight);
+		// Tiles generated so far that can reach into the current view
+		void GetVisibleTiles(std::vector<std::shared_ptr<const RiverTile>>& tiles) const;
+
+		// Batched proximity and crossing tests against the rivers, in world coordinates. Tiles that
+		// are not generated yet count as dry land.
+		void QueryNearRiver(const WorldPosition* positions, size_t count, float radius, bool* results) const;
+		void QueryCrossesRiver(const WorldPosition* starts, const WorldPosition* ends, size_t count, bool* results) const;
+
+		size_t GetTileCount() const;
+		size_t GetPendingCount() const;
+
+		static constexpr float TileSize{ 512.0f };
+
+	private:
+		using TileMap = std::unordered_map<TileCoordinate, std::shared_ptr<const RiverTile>, TileCoordinateHash>;
+
+		struct TileRange {
+			int left, top, right, bottom;
+
+			bool Contains(const TileCoordinate& coordinate, int margin) const;
+		};
+
+		const unsigned long long m_Seed;
+		Grammar<RiverAction> m_Grammar;
+
+		mutable std::mutex m_Mutex;
+		std::condition_variable m_Condition;
+		std::vector<std::thread> m_Workers;
+		bool m_IsStopping{ false };
+
+		TileRange m_View{ 0, 0, -1, -1 };
+		TileMap m_Tiles;
+		std::unordered_map<TileCoordinate, RiverState, TileCoordinateHash> m_Entries;
+		std::vector<TileCoordinate> m_Pending;
+		std::vector<TileCoordinate> m_InProgress;
+		int m_MaxNesting{ 0 };	// Of forks in the grammar, what a turtle saves at most or UnboundedNesting
+
+		void Work();
+		bool TakeJob(TileCoordinate& coordinate);
+
+		RiverState GetEntry(const TileCoordinate& coordinate);
+		RiverState GetAnchor(const TileCoordinate& coordinate) const;
+		RiverTile GenerateTile(const TileCoordinate& coordinate, const RiverState& entry);
+		unsigned long long GetTileSeed(const TileCoordinate& coordinate, unsigned long long salt) const;
+
+		TileMap GetTiles() const;
+
+		static bool IsAnchor(int x);
+};
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "Math.h"
+#include <vector>
+#include <cstddef>
+
+//*** SEGMENTINDEX ***
+//
+//
+
+// A stroke of the turtle, as wide as it was drawn
+struct Segment {
+	Vector2D start;
+	Vector2D end;
+	float width;
+};
+
+// Uniform grid over a set of segments, for proximity and crossing tests. Every cell lists the
+// segments whose bounds overlap it, stored by value and grouped per cell, so a query only reads
+// the memory of the cells it covers. Segments count as capsules of half their width.
+class SegmentIndex final {
+
+	public:
+		SegmentIndex() = default;
+		~SegmentIndex() = default;
+
+		SegmentIndex(const SegmentIndex& ref) = default;
+		SegmentIndex(SegmentIndex&& ref) = default;
+		SegmentIndex& operator=(const SegmentIndex& ref) = default;
+		SegmentIndex& operator=(SegmentIndex&& ref) = default;
+
+		// Replaces the contents. The cell size grows when the bounds would need too many cells.
+		void Build(const std::vector<Segment>& segments, float cellSize);
+
+		// Whether a segment comes within radius of the point
+		bool IsNear(const Vector2D& point, float radius) const;
+		// Whether the line from start to end touches a segment
+		bool Crosses(const Vector2D& start, const Vector2D& end) const;
+
+		void QueryNear(const Vector2D* points, size_t count, float radius, bool* results) const;
+		void QueryCrossings(const Vector2D* starts, const Vector2D* ends, size_t count, bool* results) const;
+
+		bool IsEmpty() const { return m_Entries.empty(); }
+
+	private:
+		struct Entry {
+			float startX, startY;
+			float endX, endY;
+			float radius;
+		};
+
+		float m_Left{ 0.0f };
+		float m_Top{ 0.0f };
+		float m_CellSize{ 1.0f };
+		int m_Columns{ 0 };
+		int m_Rows{ 0 };
+		float m_MaxRadius{ 0.0f };
+
+		std::vector<unsigned int> m_CellStarts{};	// Entries of cell i are [m_CellStarts[i], m_CellStarts[i + 1])
+		std::vector<Entry> m_Entries{};
+
+		// Cells overlapping the box, clamped to the grid, false when the box misses the grid
+		bool GetCells(float left, float top, float right, float bottom, int& firstColumn, int& firstRow, int& lastColumn, int& lastRow) const;
+};
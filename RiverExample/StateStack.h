@@ -0,0 +1,71 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+
+//*** STATESTACK ***
+//
+//
+
+// Stack of turtle states for branches. The storage is made once for the deepest nesting expected
+// and kept between drawings, so a push or pop is a single copy of the state. Nesting deeper than
+// reserved still works, it grows the storage then. States need a default constructor.
+template<typename State>
+class StateStack final {
+
+	public:
+		StateStack() = default;
+		~StateStack() = default;
+
+		StateStack(const StateStack& ref) = default;
+		StateStack(StateStack&& ref) = default;
+		StateStack& operator=(const StateStack& ref) = default;
+		StateStack& operator=(StateStack&& ref) = default;
+
+		// Depth reserved for a grammar whose nesting has no bound
+		static const size_t DefaultDepth{ 64 };
+
+		// Makes room for depth states at once, keeps what is saved
+		void Reserve(size_t depth);
+		// Reserves for what Grammar::GetMaxNesting returned, DefaultDepth when that is unbounded
+		void ReserveNesting(int nesting);
+
+		void Push(const State& state);
+		// The state stays valid until the next push
+		const State& Pop() { return m_States[--m_Size]; }
+
+		void Clear() { m_Size = 0; }
+		bool IsEmpty() const { return m_Size == 0; }
+		size_t GetSize() const { return m_Size; }
+
+	private:
+		std::vector<State> m_States{};
+		size_t m_Size{ 0 };
+};
+
+template<typename State>
+void StateStack<State>::Reserve(size_t depth) {
+	if (depth > m_States.size()) {
+		m_States.resize(depth);
+	}
+}
+
+template<typename State>
+void StateStack<State>::ReserveNesting(int nesting) {
+	if (nesting < 0) {
+		Reserve(DefaultDepth);
+		return;
+	}
+	Reserve(size_t(nesting));
+}
+
+template<typename State>
+void StateStack<State>::Push(const State& state) {
+	if (m_Size == m_States.size()) {
+		m_States.push_back(state);
+	}
+	else {
+		m_States[m_Size] = state;
+	}
+	++m_Size;
+}
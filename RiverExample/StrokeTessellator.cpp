@@ -0,0 +1,189 @@
+#include "StrokeTessellator.h"
+#include <cmath>
+#include <algorithm>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define STROKE_SSE
+#include <xmmintrin.h>
+#endif
+
+namespace {
+	constexpr float MinLengthSquared{ 1e-12f };
+
+	// Unit normal of every segment from vertex i to vertex i + 1, zero for empty segments
+	void SegmentNormals(const float* pX, const float* pY, size_t count, float* pNormalX, float* pNormalY) {
+
+		size_t index{ 0 };
+#if defined(STROKE_SSE)
+		const __m128 minLengthSquared{ _mm_set1_ps(MinLengthSquared) };
+		const __m128 zero{ _mm_setzero_ps() };
+		for (; index + 4 < count; index += 4) {
+			const __m128 directionX{ _mm_sub_ps(_mm_loadu_ps(pX + index + 1), _mm_loadu_ps(pX + index)) };
+			const __m128 directionY{ _mm_sub_ps(_mm_loadu_ps(pY + index + 1), _mm_loadu_ps(pY + index)) };
+			const __m128 lengthSquared{ _mm_add_ps(_mm_mul_ps(directionX, directionX), _mm_mul_ps(directionY, directionY)) };
+			const __m128 isLong{ _mm_cmpgt_ps(lengthSquared, minLengthSquared) };
+			const __m128 inverse{ _mm_and_ps(isLong, _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(_mm_max_ps(lengthSquared, minLengthSquared)))) };
+
+			_mm_storeu_ps(pNormalX + index, _mm_mul_ps(_mm_sub_ps(zero, directionY), inverse));
+			_mm_storeu_ps(pNormalY + index, _mm_mul_ps(directionX, inverse));
+		}
+#endif
+		for (; index + 1 < count; ++index) {
+			const float directionX{ pX[index + 1] - pX[index] };
+			const float directionY{ pY[index + 1] - pY[index] };
+			const float lengthSquared{ directionX * directionX + directionY * directionY };
+			const float inverse{ lengthSquared > MinLengthSquared ? 1.0f / std::sqrt(lengthSquared) : 0.0f };
+
+			pNormalX[index] = -directionY * inverse;
+			pNormalY[index] = directionX * inverse;
+		}
+	}
+
+	// Left and right vertex of every vertex, on the bisector of its incoming and outgoing normal.
+	// A bisector of zero length is a full turn back, the outgoing normal is used then.
+	void Sides(const float* pX, const float* pY, const float* pWidth, const float* pInX, const float* pInY, const float* pOutX, const float* pOutY,
+		size_t count, float minCosine, StrokeVertex* pSides) {
+
+		size_t index{ 0 };
+#if defined(STROKE_SSE)
+		const __m128 minLengthSquared{ _mm_set1_ps(MinLengthSquared) };
+		const __m128 minCosines{ _mm_set1_ps(minCosine) };
+		const __m128 half{ _mm_set1_ps(0.5f) };
+		for (; index + 4 <= count; index += 4) {
+			const __m128 outX{ _mm_loadu_ps(pOutX + index) };
+			const __m128 outY{ _mm_loadu_ps(pOutY + index) };
+			__m128 miterX{ _mm_add_ps(_mm_loadu_ps(pInX + index), outX) };
+			__m128 miterY{ _mm_add_ps(_mm_loadu_ps(pInY + index), outY) };
+
+			const __m128 lengthSquared{ _mm_add_ps(_mm_mul_ps(miterX, miterX), _mm_mul_ps(miterY, miterY)) };
+			const __m128 isValid{ _mm_cmpgt_ps(lengthSquared, minLengthSquared) };
+			const __m128 inverse{ _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(_mm_max_ps(lengthSquared, minLengthSquared))) };
+			miterX = _mm_or_ps(_mm_and_ps(isValid, _mm_mul_ps(miterX, inverse)), _mm_andnot_ps(isValid, outX));
+			miterY = _mm_or_ps(_mm_and_ps(isValid, _mm_mul_ps(miterY, inverse)), _mm_andnot_ps(isValid, outY));
+
+			const __m128 cosine{ _mm_max_ps(_mm_add_ps(_mm_mul_ps(miterX, outX), _mm_mul_ps(miterY, outY)), minCosines) };
+			const __m128 scale{ _mm_div_ps(_mm_mul_ps(half, _mm_loadu_ps(pWidth + index)), cosine) };
+			const __m128 offsetX{ _mm_mul_ps(miterX, scale) };
+			const __m128 offsetY{ _mm_mul_ps(miterY, scale) };
+
+			const __m128 x{ _mm_loadu_ps(pX + index) };
+			const __m128 y{ _mm_loadu_ps(pY + index) };
+			__m128 leftX{ _mm_add_ps(x, offsetX) };
+			__m128 leftY{ _mm_add_ps(y, offsetY) };
+			__m128 rightX{ _mm_sub_ps(x, offsetX) };
+			__m128 rightY{ _mm_sub_ps(y, offsetY) };
+
+			// Lanes to vertices, each row becomes left x, left y, right x, right y of one vertex
+			_MM_TRANSPOSE4_PS(leftX, leftY, rightX, rightY);
+			float* pOut{ &pSides[2 * index].x };
+			_mm_storeu_ps(pOut, leftX);
+			_mm_storeu_ps(pOut + 4, leftY);
+			_mm_storeu_ps(pOut + 8, rightX);
+			_mm_storeu_ps(pOut + 12, rightY);
+		}
+#endif
+		for (; index < count; ++index) {
+			float miterX{ pInX[index] + pOutX[index] };
+			float miterY{ pInY[index] + pOutY[index] };
+			const float lengthSquared{ miterX * miterX + miterY * miterY };
+			if (lengthSquared > MinLengthSquared) {
+				const float inverse{ 1.0f / std::sqrt(lengthSquared) };
+				miterX *= inverse;
+				miterY *= inverse;
+			}
+			else {
+				miterX = pOutX[index];
+				miterY = pOutY[index];
+			}
+
+			const float cosine{ std::max(miterX * pOutX[index] + miterY * pOutY[index], minCosine) };
+			const float scale{ 0.5f * pWidth[index] / cosine };
+			pSides[2 * index] = StrokeVertex{ pX[index] + miterX * scale, pY[index] + miterY * scale };
+			pSides[2 * index + 1] = StrokeVertex{ pX[index] - miterX * scale, pY[index] - miterY * scale };
+		}
+	}
+}
+
+void Polylines::Clear() {
+	x.clear();
+	y.clear();
+	width.clear();
+	starts.clear();
+}
+
+void StrokeTessellator::BuildPolylines(const std::vector<Segment>& segments, Polylines& polylines) {
+
+	polylines.Clear();
+	polylines.x.reserve(2 * segments.size());
+	polylines.y.reserve(2 * segments.size());
+	polylines.width.reserve(2 * segments.size());
+	for (size_t index{ 0 }; index < segments.size(); ++index) {
+		const Segment& segment{ segments[index] };
+		const bool isContinued{ index > 0 && segment.start.x == segments[index - 1].end.x && segment.start.y == segments[index - 1].end.y };
+
+		if (isContinued) {
+			polylines.width.back() = segment.width;
+		}
+		else {
+			polylines.starts.push_back(static_cast<unsigned int>(polylines.x.size()));
+			polylines.x.push_back(segment.start.x);
+			polylines.y.push_back(segment.start.y);
+			polylines.width.push_back(segment.width);
+		}
+
+		polylines.x.push_back(segment.end.x);
+		polylines.y.push_back(segment.end.y);
+		polylines.width.push_back(segment.width);
+	}
+	polylines.starts.push_back(static_cast<unsigned int>(polylines.x.size()));
+}
+
+void StrokeTessellator::Tessellate(const std::vector<Segment>& segments, std::vector<StrokeVertex>& strip) {
+	BuildPolylines(segments, m_Polylines);
+	Tessellate(m_Polylines, strip);
+}
+
+void StrokeTessellator::Tessellate(const Polylines& polylines, std::vector<StrokeVertex>& strip) {
+
+	const size_t count{ polylines.x.size() };
+	if (count == 0) {
+		return;
+	}
+
+	m_InX.resize(count);
+	m_InY.resize(count);
+	m_OutX.resize(count);
+	m_OutY.resize(count);
+	m_Sides.resize(2 * count);
+
+	// Outgoing normals run across polyline ends, those and the first incoming ones are patched below
+	SegmentNormals(polylines.x.data(), polylines.y.data(), count, m_OutX.data(), m_OutY.data());
+	std::copy(m_OutX.begin(), m_OutX.end() - 1, m_InX.begin() + 1);
+	std::copy(m_OutY.begin(), m_OutY.end() - 1, m_InY.begin() + 1);
+
+	for (size_t polyline{ 0 }; polyline < polylines.GetCount(); ++polyline) {
+		const unsigned int first{ polylines.starts[polyline] };
+		const unsigned int last{ polylines.starts[polyline + 1] - 1 };
+		m_OutX[last] = m_InX[last];
+		m_OutY[last] = m_InY[last];
+		m_InX[first] = m_OutX[first];
+		m_InY[first] = m_OutY[first];
+	}
+
+	Sides(polylines.x.data(), polylines.y.data(), polylines.width.data(), m_InX.data(), m_InY.data(), m_OutX.data(), m_OutY.data(),
+		count, 1.0f / m_MiterLimit, m_Sides.data());
+
+	// Left and right vertices are already in strip order, only the degenerate links are added
+	strip.reserve(strip.size() + m_Sides.size() + 2 * polylines.GetCount());
+	for (size_t polyline{ 0 }; polyline < polylines.GetCount(); ++polyline) {
+		const StrokeVertex* pFirst{ m_Sides.data() + 2 * polylines.starts[polyline] };
+		const StrokeVertex* pEnd{ m_Sides.data() + 2 * polylines.starts[polyline + 1] };
+
+		if (!strip.empty()) {
+			const StrokeVertex previous{ strip.back() };
+			strip.push_back(previous);
+			strip.push_back(*pFirst);
+		}
+		strip.insert(strip.end(), pFirst, pEnd);
+	}
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "SegmentIndex.h"
+#include <vector>
+#include <cstddef>
+
+//*** STROKETESSELLATOR ***
+//
+//
+
+struct StrokeVertex {
+	float x;
+	float y;
+};
+
+// Turtle segments chained into polylines, every vertex with its own width
+struct Polylines {
+	std::vector<float> x{};
+	std::vector<float> y{};
+	std::vector<float> width{};
+	std::vector<unsigned int> starts{};		// First vertex of every polyline, then the total vertex count
+
+	void Clear();
+	size_t GetCount() const { return starts.empty() ? 0 : starts.size() - 1; }
+};
+
+// Turns polylines into a single triangle strip. Every vertex becomes a left and a right vertex
+// on the miter of its two segments, so consecutive segments share their edge and joints have
+// no gaps or overlaps. Polylines are joined with degenerate triangles. Joins and segment normals
+// are worked out four at a time with SSE where available.
+class StrokeTessellator final {
+
+	public:
+		StrokeTessellator() = default;
+		~StrokeTessellator() = default;
+
+		StrokeTessellator(const StrokeTessellator& ref) = delete;
+		StrokeTessellator(StrokeTessellator&& ref) = delete;
+		StrokeTessellator& operator=(const StrokeTessellator& ref) = delete;
+		StrokeTessellator& operator=(StrokeTessellator&& ref) = delete;
+
+		// A segment continues the polyline of the segment before when it starts where that one ended.
+		// Vertices take the width of the segment leaving them, the last one of the segment ending there.
+		static void BuildPolylines(const std::vector<Segment>& segments, Polylines& polylines);
+
+		// Appends the strip to the vertices
+		void Tessellate(const Polylines& polylines, std::vector<StrokeVertex>& strip);
+		void Tessellate(const std::vector<Segment>& segments, std::vector<StrokeVertex>& strip);
+
+		// Longest miter as a multiple of half the width, sharper joints are pulled in to it
+		void SetMiterLimit(float limit) { m_MiterLimit = limit; }
+
+	private:
+		float m_MiterLimit{ 4.0f };
+
+		// Scratch buffers, kept to save allocations between calls
+		Polylines m_Polylines{};
+		std::vector<float> m_InX{};
+		std::vector<float> m_InY{};
+		std::vector<float> m_OutX{};
+		std::vector<float> m_OutY{};
+		std::vector<StrokeVertex> m_Sides{};	// Left then right vertex of every polyline vertex
+};
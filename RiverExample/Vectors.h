@@ -2,16 +2,17 @@
 
 struct Vector2D {
 	float x, y;
-	float w;	// w = 1 -> point, w = 0 -> vector
 
-	Vector2D(float x, float y, float w = 1);
+	Vector2D(float x, float y);
 
-	float Magnitude() ;
+	float Magnitude() const;
 	void Normalize();
 
-
-	Vector2D operator+(const Vector2D& other);
-	void operator*=(const float& other);
+	Vector2D operator+(const Vector2D& other) const;
+	Vector2D operator-(const Vector2D& other) const;
+	Vector2D operator*(float scale) const;
+	Vector2D& operator+=(const Vector2D& other);
+	Vector2D& operator*=(float scale);
 
 };
 
@@ -23,5 +24,10 @@ struct Vector3 {
 	static Vector3 Cross(const Vector3& v1, const Vector3& v2);
 	static float Dot(const Vector3& v1, const Vector3& v2);
 
-	Vector3 operator-(const Vector3 other);
+	float Magnitude() const;
+	void Normalize();
+
+	Vector3 operator+(const Vector3& other) const;
+	Vector3 operator-(const Vector3& other) const;
+	Vector3 operator*(float scale) const;
 };
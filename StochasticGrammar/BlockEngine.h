@@ -0,0 +1,246 @@
+#pragma once
+#include <cstdint>
+#include <random>
+#include "Random.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+//*** BLOCKENGINE ***
+//
+//
+
+// Random engine that runs eight xoshiro128** generators side by side and hands out their
+// output from a buffer, refilled a block at a time. The lanes map onto one AVX2 register,
+// without AVX2 the same lanes are stepped in a plain loop and produce the same sequence.
+// Satisfies the engine interface, so it plugs into GenerateSequence, UniformFloat and the like.
+class BlockEngine
+{
+	public:
+		using result_type = uint32_t;
+
+		static constexpr unsigned int Lanes{ 8 };
+		static constexpr unsigned int Rows{ 32 };
+		static constexpr unsigned int BlockSize{ Lanes * Rows };
+
+		explicit BlockEngine(uint64_t seed = 0);
+		virtual ~BlockEngine() = default;
+
+		BlockEngine(const BlockEngine&) = default;
+		BlockEngine(BlockEngine&&) = default;
+		BlockEngine& operator=(const BlockEngine&) = default;
+		BlockEngine& operator=(BlockEngine&&) = default;
+
+		static constexpr result_type min() { return 0; }
+		static constexpr result_type max() { return 0xFFFFFFFFu; }
+
+		void Seed(uint64_t seed);
+		result_type operator()();
+
+	private:
+		alignas(32) uint32_t m_State[4][Lanes];
+		alignas(32) uint32_t m_Buffer[BlockSize];
+		unsigned int m_Index{ BlockSize };
+
+		void Refill();
+};
+
+//*** XOSHIRO128 ***
+//
+//
+
+inline uint64_t SplitMix(uint64_t& state) {
+
+	uint64_t value{ state += 0x9E3779B97F4A7C15ull };
+	value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ull;
+	value = (value ^ (value >> 27)) * 0x94D049BB133111EBull;
+	return value ^ (value >> 31);
+}
+
+// Takes the next two words of a SplitMix64 stream as xoshiro128** state, never all zero
+inline void SeedXoshiro128(uint64_t& mix, uint32_t* pState) {
+
+	const uint64_t low{ SplitMix(mix) };
+	const uint64_t high{ SplitMix(mix) };
+	pState[0] = static_cast<uint32_t>(low);
+	pState[1] = static_cast<uint32_t>(low >> 32);
+	pState[2] = static_cast<uint32_t>(high);
+	pState[3] = static_cast<uint32_t>(high >> 32) | 1u;
+}
+
+// Single xoshiro128** generator, cheap to seed, for short seeded generations.
+// For a seed it steps through the same states as lane 0 of a BlockEngine and draws what a
+// LaneEngines lane with that seed draws. It does not match what BlockEngine's operator() returns,
+// that output takes one number from each of the eight lanes in turn.
+class Xoshiro128
+{
+	public:
+		using result_type = uint32_t;
+
+		explicit Xoshiro128(uint64_t seed = 0) { Seed(seed); }
+
+		static constexpr result_type min() { return 0; }
+		static constexpr result_type max() { return 0xFFFFFFFFu; }
+
+		void Seed(uint64_t seed) { SeedXoshiro128(seed, m_State); }
+		result_type operator()();
+
+	private:
+		uint32_t m_State[4];
+};
+
+inline Xoshiro128::result_type Xoshiro128::operator()() {
+
+	const uint32_t times5{ m_State[1] * 5u };
+	const uint32_t rotated{ (times5 << 7) | (times5 >> 25) };
+	const uint32_t shifted{ m_State[1] << 9 };
+
+	m_State[2] ^= m_State[0];
+	m_State[3] ^= m_State[1];
+	m_State[1] ^= m_State[2];
+	m_State[0] ^= m_State[3];
+	m_State[2] ^= shifted;
+	m_State[3] = (m_State[3] << 11) | (m_State[3] >> 21);
+	return rotated * 9u;
+}
+
+//*** LANEENGINES ***
+//
+//
+
+// One xoshiro128** per lane, stored lane by lane so all lanes step in one SIMD pass.
+// Only lanes in the mask advance, every lane draws the same numbers as its own Xoshiro128.
+template<unsigned int LaneCount>
+class LaneEngines
+{
+	public:
+		void Seed(unsigned int lane, uint64_t seed);
+		void Next(unsigned int mask, uint32_t* pBits);
+
+	private:
+		alignas(32) uint32_t m_State[4][LaneCount];
+};
+
+template<unsigned int LaneCount>
+void LaneEngines<LaneCount>::Seed(unsigned int lane, uint64_t seed) {
+
+	uint32_t state[4];
+	SeedXoshiro128(seed, state);
+	for (unsigned int word{ 0 }; word < 4; ++word) {
+		m_State[word][lane] = state[word];
+	}
+}
+
+template<unsigned int LaneCount>
+void LaneEngines<LaneCount>::Next(unsigned int mask, uint32_t* pBits) {
+
+	// Branch free so compilers vectorize it, inactive lanes keep their state
+	for (unsigned int lane{ 0 }; lane < LaneCount; ++lane) {
+		const uint32_t keep{ ((mask >> lane) & 1u) - 1u };
+		const uint32_t s0{ m_State[0][lane] };
+		const uint32_t s1{ m_State[1][lane] };
+		const uint32_t s2{ m_State[2][lane] };
+		const uint32_t s3{ m_State[3][lane] };
+
+		const uint32_t times5{ s1 * 5u };
+		const uint32_t rotated{ (times5 << 7) | (times5 >> 25) };
+		pBits[lane] = rotated * 9u;
+
+		const uint32_t t2{ s2 ^ s0 };
+		const uint32_t t3{ s3 ^ s1 };
+		const uint32_t n1{ s1 ^ t2 };
+		const uint32_t n0{ s0 ^ t3 };
+		const uint32_t n2{ t2 ^ (s1 << 9) };
+		const uint32_t n3{ (t3 << 11) | (t3 >> 21) };
+
+		m_State[0][lane] = (n0 & ~keep) | (s0 & keep);
+		m_State[1][lane] = (n1 & ~keep) | (s1 & keep);
+		m_State[2][lane] = (n2 & ~keep) | (s2 & keep);
+		m_State[3][lane] = (n3 & ~keep) | (s3 & keep);
+	}
+}
+
+// Fresh 64 bit seed for engines that don't need to be reproducible
+inline uint64_t RandomDeviceSeed() {
+
+	std::random_device device{};
+	return (static_cast<uint64_t>(device()) << 32) | device();
+}
+
+inline BlockEngine::BlockEngine(uint64_t seed) {
+	Seed(seed);
+}
+
+inline void BlockEngine::Seed(uint64_t seed) {
+
+	// Every lane gets its own state from one SplitMix64 stream
+	uint64_t mix{ seed };
+	for (unsigned int lane{ 0 }; lane < Lanes; ++lane) {
+		uint32_t state[4];
+		SeedXoshiro128(mix, state);
+		for (unsigned int word{ 0 }; word < 4; ++word) {
+			m_State[word][lane] = state[word];
+		}
+	}
+	m_Index = BlockSize;
+}
+
+inline BlockEngine::result_type BlockEngine::operator()() {
+
+	if (m_Index == BlockSize) {
+		Refill();
+	}
+	return m_Buffer[m_Index++];
+}
+
+inline void BlockEngine::Refill() {
+
+#if defined(__AVX2__)
+	__m256i s0{ _mm256_load_si256(reinterpret_cast<const __m256i*>(m_State[0])) };
+	__m256i s1{ _mm256_load_si256(reinterpret_cast<const __m256i*>(m_State[1])) };
+	__m256i s2{ _mm256_load_si256(reinterpret_cast<const __m256i*>(m_State[2])) };
+	__m256i s3{ _mm256_load_si256(reinterpret_cast<const __m256i*>(m_State[3])) };
+
+	for (unsigned int row{ 0 }; row < Rows; ++row) {
+		// rotl(s1 * 5, 7) * 9
+		const __m256i times5{ _mm256_add_epi32(_mm256_slli_epi32(s1, 2), s1) };
+		const __m256i rotated{ _mm256_or_si256(_mm256_slli_epi32(times5, 7), _mm256_srli_epi32(times5, 25)) };
+		const __m256i result{ _mm256_add_epi32(_mm256_slli_epi32(rotated, 3), rotated) };
+		_mm256_store_si256(reinterpret_cast<__m256i*>(m_Buffer + row * Lanes), result);
+
+		const __m256i shifted{ _mm256_slli_epi32(s1, 9) };
+		s2 = _mm256_xor_si256(s2, s0);
+		s3 = _mm256_xor_si256(s3, s1);
+		s1 = _mm256_xor_si256(s1, s2);
+		s0 = _mm256_xor_si256(s0, s3);
+		s2 = _mm256_xor_si256(s2, shifted);
+		s3 = _mm256_or_si256(_mm256_slli_epi32(s3, 11), _mm256_srli_epi32(s3, 21));
+	}
+
+	_mm256_store_si256(reinterpret_cast<__m256i*>(m_State[0]), s0);
+	_mm256_store_si256(reinterpret_cast<__m256i*>(m_State[1]), s1);
+	_mm256_store_si256(reinterpret_cast<__m256i*>(m_State[2]), s2);
+	_mm256_store_si256(reinterpret_cast<__m256i*>(m_State[3]), s3);
+#else
+	// Lanes are independent, compilers vectorize this loop with whatever SIMD they may use
+	for (unsigned int row{ 0 }; row < Rows; ++row) {
+		uint32_t* pOut{ m_Buffer + row * Lanes };
+		for (unsigned int lane{ 0 }; lane < Lanes; ++lane) {
+			const uint32_t times5{ m_State[1][lane] * 5u };
+			const uint32_t rotated{ (times5 << 7) | (times5 >> 25) };
+			pOut[lane] = rotated * 9u;
+
+			const uint32_t shifted{ m_State[1][lane] << 9 };
+			m_State[2][lane] ^= m_State[0][lane];
+			m_State[3][lane] ^= m_State[1][lane];
+			m_State[1][lane] ^= m_State[2][lane];
+			m_State[0][lane] ^= m_State[3][lane];
+			m_State[2][lane] ^= shifted;
+			m_State[3][lane] = (m_State[3][lane] << 11) | (m_State[3][lane] >> 21);
+		}
+	}
+#endif
+
+	m_Index = 0;
+}
@@ -0,0 +1,1209 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <future>
+#include <functional>
+#include <unordered_map>
+#include <unordered_set>
+#include <algorithm>
+#include "Nodes.h"
+#include "ThreadPool.h"
+#include "BlockEngine.h"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// Handle to a rule, resolved once by name and reused on hot paths
+struct RuleId {
+	unsigned int index;
+
+	bool operator==(const RuleId& other) const { return index == other.index; }
+	bool operator!=(const RuleId& other) const { return index != other.index; }
+};
+
+inline unsigned long long NextGrammarVersion() {
+
+	static std::atomic<unsigned long long> version{ 0 };
+	return ++version;
+}
+
+//*** COMPILEDNODE ***
+//
+//
+
+enum class CompiledType : unsigned char {
+	Leaf,
+	Select,
+	Sequence,
+	Repetition,
+	LNode
+};
+
+// Flattened node, children are referenced by index
+//		leaf:		first = payload
+//		select:		first = first option, second = option count, value = weights sum
+//		sequence:	first = first element, second = element count
+//		repetition:	first = node, value = repetition chance
+//		lnode:		first = node, second = fallback
+struct CompiledNode {
+	CompiledType type{ CompiledType::Leaf };
+	unsigned int first{ 0 };
+	unsigned int second{ 0 };
+	float value{ 0.0f };
+};
+
+template<typename Data>
+class GrammarFork;
+
+class SharedGrammar;
+
+//*** PARAMETEROVERLAY ***
+//
+//
+
+// Sparse set of parameters that replace the ones of a compiled node.
+// Selectors store their cumulative weights, repetitions their chance.
+class ParameterOverlay
+{
+	public:
+		ParameterOverlay() = default;
+		virtual ~ParameterOverlay() = default;
+
+		ParameterOverlay(const ParameterOverlay&) = default;
+		ParameterOverlay(ParameterOverlay&&) = delete;
+		ParameterOverlay& operator=(const ParameterOverlay&) = delete;
+		ParameterOverlay& operator=(ParameterOverlay&&) = delete;
+
+		bool IsEmpty() const { return m_Ranges.empty(); }
+		size_t GetSize() const { return m_Parameters.size(); }
+
+		void Find(unsigned int node, const float*& pParameters, float& last) const;
+		float* Override(unsigned int node, const float* pParameters, unsigned int count);
+
+	private:
+		std::unordered_map<unsigned int, std::pair<unsigned int, unsigned int>> m_Ranges;
+		std::vector<float> m_Parameters;
+};
+
+inline void ParameterOverlay::Find(unsigned int node, const float*& pParameters, float& last) const {
+
+	if (m_Ranges.empty()) {
+		return;
+	}
+
+	auto it{ m_Ranges.find(node) };
+	if (it == m_Ranges.end()) {
+		return;
+	}
+
+	pParameters = &m_Parameters[it->second.first];
+	last = m_Parameters[it->second.first + it->second.second - 1];
+}
+
+inline float* ParameterOverlay::Override(unsigned int node, const float* pParameters, unsigned int count) {
+
+	// First override of a node copies its current parameters
+	auto it{ m_Ranges.find(node) };
+	if (it == m_Ranges.end()) {
+		std::pair<unsigned int, unsigned int> range{ static_cast<unsigned int>(m_Parameters.size()), count };
+		it = m_Ranges.emplace(node, range).first;
+		m_Parameters.insert(m_Parameters.end(), pParameters, pParameters + count);
+	}
+	return &m_Parameters[it->second.first];
+}
+
+//*** COMPILEDTABLES ***
+//
+//
+
+// Raw view of compiled tables, owned by a CompiledGrammar or mapped from shared memory
+struct CompiledTables {
+	const CompiledNode* pNodes{ nullptr };
+	const unsigned int* pChildren{ nullptr };
+	const float* pWeights{ nullptr };
+};
+
+// Walks the tables from a node and emits the payload index of every leaf it reaches.
+// Counts the LNodes that fell back to their terminal form when given a counter.
+template<typename Emit, typename Engine>
+void WalkCompiled(const CompiledTables& tables, unsigned int index, Emit& emit, int depth, int maxDepth, Engine& engine, const ParameterOverlay* pOverlay, unsigned int* pFallbacks = nullptr) {
+
+	const CompiledNode& node{ tables.pNodes[index] };
+	switch (node.type) {
+
+		case CompiledType::Leaf: {
+			emit(node.first);
+			break;
+		}
+
+		case CompiledType::Select: {
+			if (node.second == 0) {
+				break;
+			}
+
+			const float* pWeights{ &tables.pWeights[node.first] };
+			float weightsSum{ node.value };
+			if (pOverlay) {
+				pOverlay->Find(index, pWeights, weightsSum);
+			}
+
+			const float randomWeight{ UniformFloat(engine) * weightsSum };
+
+			// Weights are stored cumulative, pick the first one above the random weight
+			unsigned int option{ 0 };
+			const unsigned int last{ node.second - 1 };
+			while (option < last && !(randomWeight < pWeights[option])) {
+				++option;
+			}
+			WalkCompiled(tables, tables.pChildren[node.first + option], emit, depth, maxDepth, engine, pOverlay, pFallbacks);
+			break;
+		}
+
+		case CompiledType::Sequence: {
+			const unsigned int end{ node.first + node.second };
+			for (unsigned int element{ node.first }; element < end; ++element) {
+				WalkCompiled(tables, tables.pChildren[element], emit, depth, maxDepth, engine, pOverlay, pFallbacks);
+			}
+			break;
+		}
+
+		case CompiledType::Repetition: {
+			const float* pChance{ &node.value };
+			float chance{ node.value };
+			if (pOverlay) {
+				pOverlay->Find(index, pChance, chance);
+			}
+
+			do {
+				WalkCompiled(tables, node.first, emit, depth, maxDepth, engine, pOverlay, pFallbacks);
+			}
+			while (UniformFloat(engine) <= *pChance);
+			break;
+		}
+
+		case CompiledType::LNode: {
+			if (depth >= maxDepth) {
+				if (pFallbacks) {
+					++*pFallbacks;
+				}
+				WalkCompiled(tables, node.second, emit, 0, maxDepth, engine, pOverlay, pFallbacks);
+				break;
+			}
+
+			WalkCompiled(tables, node.first, emit, depth + 1, maxDepth, engine, pOverlay, pFallbacks);
+			break;
+		}
+	}
+}
+
+//*** LANE WALK ***
+//
+//
+
+// Generations walked together by WalkCompiledLanes, bit i of a lane mask stands for generation i
+constexpr unsigned int SamplingLanes{ 8 };
+// Rules up to this height are shallow enough for lanes to stay mostly in step
+constexpr unsigned int MaxLaneHeight{ 16 };
+
+inline unsigned int LowestLane(unsigned int mask) {
+#if defined(_MSC_VER)
+	unsigned long lane{ 0 };
+	_BitScanForward(&lane, mask);
+	return static_cast<unsigned int>(lane);
+#else
+	return static_cast<unsigned int>(__builtin_ctz(mask));
+#endif
+}
+
+// Walks the tables for several generations at once, each with its own engine lane and output.
+// Lanes taking the same branch share one step through the tables, where they diverge each
+// branch is walked with the mask of its lanes. Every lane draws its random numbers in the
+// same order as WalkCompiled would, so a lane's output equals a scalar walk with Xoshiro128.
+inline void WalkCompiledLanes(const CompiledTables& tables, unsigned int index, unsigned int mask, int depth, int maxDepth,
+	LaneEngines<SamplingLanes>& engines, std::vector<unsigned int>* pOutputs) {
+
+	const CompiledNode& node{ tables.pNodes[index] };
+	switch (node.type) {
+
+		case CompiledType::Leaf: {
+			for (unsigned int lanes{ mask }; lanes != 0; lanes &= lanes - 1) {
+				pOutputs[LowestLane(lanes)].push_back(node.first);
+			}
+			break;
+		}
+
+		case CompiledType::Select: {
+			if (node.second == 0) {
+				break;
+			}
+			uint32_t bits[SamplingLanes];
+			if (node.second == 1) {
+				engines.Next(mask, bits);
+				WalkCompiledLanes(tables, tables.pChildren[node.first], mask, depth, maxDepth, engines, pOutputs);
+				break;
+			}
+
+			float randomWeights[SamplingLanes];
+			engines.Next(mask, bits);
+			for (unsigned int lane{ 0 }; lane < SamplingLanes; ++lane) {
+				randomWeights[lane] = BitsToFloat(bits[lane]) * node.value;
+			}
+
+			// Cumulative weights never decrease, so counting the ones at or below the random
+			// weight picks the same option as the scalar search, without branching per lane
+			const float* pWeights{ &tables.pWeights[node.first] };
+			unsigned int options[SamplingLanes]{};
+			for (unsigned int option{ 0 }; option + 1 < node.second; ++option) {
+				const float weight{ pWeights[option] };
+				for (unsigned int lane{ 0 }; lane < SamplingLanes; ++lane) {
+					options[lane] += randomWeights[lane] >= weight ? 1u : 0u;
+				}
+			}
+
+			// Walk each chosen option once, for all lanes that chose it
+			unsigned int remaining{ mask };
+			while (remaining != 0) {
+				const unsigned int option{ options[LowestLane(remaining)] };
+
+				unsigned int group{ 0 };
+				for (unsigned int lanes{ remaining }; lanes != 0; lanes &= lanes - 1) {
+					const unsigned int lane{ LowestLane(lanes) };
+					group |= options[lane] == option ? 1u << lane : 0u;
+				}
+				remaining &= ~group;
+				WalkCompiledLanes(tables, tables.pChildren[node.first + option], group, depth, maxDepth, engines, pOutputs);
+			}
+			break;
+		}
+
+		case CompiledType::Sequence: {
+			const unsigned int end{ node.first + node.second };
+			for (unsigned int element{ node.first }; element < end; ++element) {
+				WalkCompiledLanes(tables, tables.pChildren[element], mask, depth, maxDepth, engines, pOutputs);
+			}
+			break;
+		}
+
+		case CompiledType::Repetition: {
+			// Lanes drop out of the loop one by one, the rest keep repeating together
+			unsigned int active{ mask };
+			uint32_t bits[SamplingLanes];
+			while (active != 0) {
+				WalkCompiledLanes(tables, node.first, active, depth, maxDepth, engines, pOutputs);
+				engines.Next(active, bits);
+				for (unsigned int lane{ 0 }; lane < SamplingLanes; ++lane) {
+					if (!(BitsToFloat(bits[lane]) <= node.value)) {
+						active &= ~(1u << lane);
+					}
+				}
+			}
+			break;
+		}
+
+		case CompiledType::LNode: {
+			// All lanes at a node share the path there, so they share the depth too
+			if (depth >= maxDepth) {
+				WalkCompiledLanes(tables, node.second, mask, 0, maxDepth, engines, pOutputs);
+				break;
+			}
+
+			WalkCompiledLanes(tables, node.first, mask, depth + 1, maxDepth, engines, pOutputs);
+			break;
+		}
+	}
+}
+
+// Generations of a batch in symbol mode, generation i is symbols[offsets[i]] up to symbols[offsets[i + 1]]
+struct SymbolBatch {
+	std::vector<unsigned int> symbols;
+	std::vector<size_t> offsets;
+};
+
+// Cost of a single generation, as counted by the instrumented GenerateSequence
+struct GenerationStats {
+	unsigned int fallbacks{ 0 };		// LNodes that hit the depth limit
+	unsigned int allocations{ 0 };		// Times the result grew its storage
+};
+
+//*** COMPILEDGRAMMAR ***
+//
+//
+
+// Immutable snapshot of a grammar, safe to generate from on any number of threads
+template<typename Data>
+class CompiledGrammar : public std::enable_shared_from_this<CompiledGrammar<Data>>
+{
+	public:
+		CompiledGrammar() = default;
+		virtual ~CompiledGrammar() = default;
+
+		CompiledGrammar(const CompiledGrammar&) = delete;
+		CompiledGrammar(CompiledGrammar&&) = delete;
+		CompiledGrammar& operator=(const CompiledGrammar&) = delete;
+		CompiledGrammar& operator=(CompiledGrammar&&) = delete;
+
+		RuleId Resolve(const std::string& name) const;
+		int GetDepth() const { return m_MaxDepth; }
+		// Unique per snapshot, across all grammars of the process
+		unsigned long long GetVersion() const { return m_Version; }
+
+		bool IsFinite(RuleId rule) const;
+		unsigned int GetHeight(RuleId rule) const;
+		float GetExpectedSize(RuleId rule) const;
+
+		std::shared_ptr<GrammarFork<Data>> Fork() const;
+
+		std::vector<Data> GenerateSequence(RuleId rule) const;
+		template<typename Engine>
+		void GenerateSequence(RuleId rule, std::vector<Data>& result, Engine& engine) const;
+		template<typename Engine>
+		void GenerateSequence(RuleId rule, std::vector<Data>& result, Engine& engine, int maxDepth) const;
+		template<typename Engine>
+		void GenerateSequence(RuleId rule, std::vector<Data>& result, Engine& engine, int maxDepth, GenerationStats& stats) const;
+
+		// Symbol mode emits payload indices instead of copying payloads
+		template<typename Engine>
+		void GenerateSymbols(RuleId rule, std::vector<unsigned int>& symbols, Engine& engine, int maxDepth) const;
+		const Data& GetSymbol(unsigned int symbol) const { return m_Payloads[symbol]; }
+
+		// Every generation of a batch runs on its own engine seeded with its seed
+		void GenerateBatch(RuleId rule, const unsigned long long* pSeeds, size_t count, SymbolBatch& batch, int maxDepth) const;
+		void GenerateBatch(ThreadPool& pool, RuleId rule, const unsigned long long* pSeeds, size_t count, SymbolBatch& batch, int maxDepth) const;
+		size_t GetSymbolCount() const { return m_Payloads.size(); }
+
+		// Bytes held by this snapshot, tables, payload copies and rule names included
+		size_t GetMemoryUsage() const;
+
+	private:
+		friend class GrammarCompiler<Data>;
+		friend class GrammarFork<Data>;
+		friend class SharedGrammar;
+
+		std::unordered_map<std::string, RuleId> m_RuleIds;
+		std::vector<unsigned int> m_Roots;
+		std::vector<CompiledNode> m_Nodes;
+		std::vector<unsigned int> m_Children;
+		std::vector<float> m_Weights;
+		std::vector<Data> m_Payloads;
+		int m_MaxDepth{ 0 };
+		unsigned long long m_Version{ 0 };
+
+		// Analyses per node, kept up to date by the compiler
+		std::vector<unsigned int> m_Heights;
+		std::vector<float> m_ExpectedSizes;
+
+		CompiledTables GetTables() const;
+};
+
+template<typename Data>
+RuleId CompiledGrammar<Data>::Resolve(const std::string& name) const {
+
+	auto it{ m_RuleIds.find(name) };
+	if (it == m_RuleIds.end()) {
+		throw Rule404Exception{};
+	}
+	return it->second;
+}
+
+// Finite rules never reach an LNode or recurse, their size doesn't depend on the depth
+template<typename Data>
+bool CompiledGrammar<Data>::IsFinite(RuleId rule) const {
+	return GetHeight(rule) != 0;
+}
+
+template<typename Data>
+unsigned int CompiledGrammar<Data>::GetHeight(RuleId rule) const {
+
+	if (rule.index >= m_Roots.size()) {
+		throw Rule404Exception{};
+	}
+	return m_Heights[m_Roots[rule.index]];
+}
+
+template<typename Data>
+float CompiledGrammar<Data>::GetExpectedSize(RuleId rule) const {
+
+	if (rule.index >= m_Roots.size()) {
+		throw Rule404Exception{};
+	}
+	return m_ExpectedSizes[m_Roots[rule.index]];
+}
+
+template<typename Data>
+size_t CompiledGrammar<Data>::GetMemoryUsage() const {
+
+	size_t bytes{ sizeof(CompiledGrammar) + SharedBlockOverhead + HashMapMemory(m_RuleIds) };
+	for (const auto& rule : m_RuleIds) {
+		bytes += StringMemory(rule.first);
+	}
+
+	bytes += VectorMemory(m_Roots) + VectorMemory(m_Nodes) + VectorMemory(m_Children) + VectorMemory(m_Weights);
+	bytes += VectorMemory(m_Heights) + VectorMemory(m_ExpectedSizes) + VectorMemory(m_Payloads);
+	for (const Data& payload : m_Payloads) {
+		bytes += PayloadMemory(payload);
+	}
+	return bytes;
+}
+
+template<typename Data>
+std::vector<Data> CompiledGrammar<Data>::GenerateSequence(RuleId rule) const {
+
+	// Every thread gets its own engine, so readers never share state
+	thread_local BlockEngine engine{ RandomDeviceSeed() };
+
+	std::vector<Data> result{};
+	result.reserve(size_t(GetExpectedSize(rule)) + 1);
+	GenerateSequence(rule, result, engine);
+	return result;
+}
+
+template<typename Data>
+template<typename Engine>
+void CompiledGrammar<Data>::GenerateSequence(RuleId rule, std::vector<Data>& result, Engine& engine) const {
+	GenerateSequence(rule, result, engine, m_MaxDepth);
+}
+
+template<typename Data>
+template<typename Engine>
+void CompiledGrammar<Data>::GenerateSequence(RuleId rule, std::vector<Data>& result, Engine& engine, int maxDepth) const {
+
+	if (rule.index >= m_Roots.size()) {
+		throw Rule404Exception{};
+	}
+
+	auto emit = [&](unsigned int payload) { result.push_back(m_Payloads[payload]); };
+	WalkCompiled(GetTables(), m_Roots[rule.index], emit, 0, maxDepth, engine, nullptr);
+}
+
+template<typename Data>
+template<typename Engine>
+void CompiledGrammar<Data>::GenerateSequence(RuleId rule, std::vector<Data>& result, Engine& engine, int maxDepth, GenerationStats& stats) const {
+
+	if (rule.index >= m_Roots.size()) {
+		throw Rule404Exception{};
+	}
+
+	auto emit = [&](unsigned int payload) {
+		const size_t capacity{ result.capacity() };
+		result.push_back(m_Payloads[payload]);
+		stats.allocations += result.capacity() != capacity;
+	};
+	WalkCompiled(GetTables(), m_Roots[rule.index], emit, 0, maxDepth, engine, nullptr, &stats.fallbacks);
+}
+
+template<typename Data>
+template<typename Engine>
+void CompiledGrammar<Data>::GenerateSymbols(RuleId rule, std::vector<unsigned int>& symbols, Engine& engine, int maxDepth) const {
+
+	if (rule.index >= m_Roots.size()) {
+		throw Rule404Exception{};
+	}
+
+	auto emit = [&](unsigned int payload) { symbols.push_back(payload); };
+	WalkCompiled(GetTables(), m_Roots[rule.index], emit, 0, maxDepth, engine, nullptr);
+}
+
+template<typename Data>
+void CompiledGrammar<Data>::GenerateBatch(RuleId rule, const unsigned long long* pSeeds, size_t count, SymbolBatch& batch, int maxDepth) const {
+
+	if (batch.offsets.empty()) {
+		batch.offsets.push_back(batch.symbols.size());
+	}
+	batch.symbols.reserve(batch.symbols.size() + count * (size_t(GetExpectedSize(rule)) + 1));
+
+	// Finite, shallow rules are walked a group of lanes at a time, with the same results
+	size_t index{ 0 };
+	if (count >= SamplingLanes && IsFinite(rule) && GetHeight(rule) <= MaxLaneHeight) {
+		LaneEngines<SamplingLanes> engines{};
+		std::vector<unsigned int> outputs[SamplingLanes];
+
+		for (; index + SamplingLanes <= count; index += SamplingLanes) {
+			for (unsigned int lane{ 0 }; lane < SamplingLanes; ++lane) {
+				engines.Seed(lane, pSeeds[index + lane]);
+				outputs[lane].clear();
+			}
+
+			WalkCompiledLanes(GetTables(), m_Roots[rule.index], (1u << SamplingLanes) - 1, 0, maxDepth, engines, outputs);
+			for (unsigned int lane{ 0 }; lane < SamplingLanes; ++lane) {
+				batch.symbols.insert(batch.symbols.end(), outputs[lane].begin(), outputs[lane].end());
+				batch.offsets.push_back(batch.symbols.size());
+			}
+		}
+	}
+
+	for (; index < count; ++index) {
+		Xoshiro128 engine{ pSeeds[index] };
+		GenerateSymbols(rule, batch.symbols, engine, maxDepth);
+		batch.offsets.push_back(batch.symbols.size());
+	}
+}
+
+template<typename Data>
+void CompiledGrammar<Data>::GenerateBatch(ThreadPool& pool, RuleId rule, const unsigned long long* pSeeds, size_t count, SymbolBatch& batch, int maxDepth) const {
+
+	if (rule.index >= m_Roots.size()) {
+		throw Rule404Exception{};
+	}
+
+	// Split into a few chunks per thread, each chunk fills its own batch
+	const size_t chunkSize{ std::max(size_t(64), count / (pool.GetThreadCount() * 4) + 1) };
+	const size_t chunkCount{ (count + chunkSize - 1) / chunkSize };
+	if (chunkCount <= 1) {
+		GenerateBatch(rule, pSeeds, count, batch, maxDepth);
+		return;
+	}
+
+	std::vector<SymbolBatch> chunks(chunkCount);
+	std::vector<std::future<void>> futures;
+	futures.reserve(chunkCount);
+
+	// Tasks write into chunks, every one of them has to finish before chunks goes away
+	try {
+		for (size_t chunk{ 0 }; chunk < chunkCount; ++chunk) {
+			const size_t first{ chunk * chunkSize };
+			const size_t generations{ std::min(chunkSize, count - first) };
+			futures.push_back(pool.Submit([this, rule, pSeeds, first, generations, maxDepth, &chunks, chunk]() {
+				GenerateBatch(rule, pSeeds + first, generations, chunks[chunk], maxDepth);
+			}));
+		}
+	}
+	catch (...) {
+		for (std::future<void>& future : futures) {
+			future.wait();
+		}
+		throw;
+	}
+	for (std::future<void>& future : futures) {
+		future.wait();
+	}
+
+	// Stitch the chunks together in seed order
+	if (batch.offsets.empty()) {
+		batch.offsets.push_back(batch.symbols.size());
+	}
+	for (size_t chunk{ 0 }; chunk < chunkCount; ++chunk) {
+		futures[chunk].get();
+
+		const size_t base{ batch.symbols.size() };
+		batch.symbols.insert(batch.symbols.end(), chunks[chunk].symbols.begin(), chunks[chunk].symbols.end());
+		for (size_t offset{ 1 }; offset < chunks[chunk].offsets.size(); ++offset) {
+			batch.offsets.push_back(base + chunks[chunk].offsets[offset]);
+		}
+	}
+}
+
+template<typename Data>
+CompiledTables CompiledGrammar<Data>::GetTables() const {
+
+	CompiledTables tables{};
+	tables.pNodes = m_Nodes.data();
+	tables.pChildren = m_Children.data();
+	tables.pWeights = m_Weights.data();
+	return tables;
+}
+
+//*** GRAMMARFORK ***
+//
+//
+
+// Variant of a compiled grammar with its own weights and repetition chances.
+// The compiled structure is shared, only the overridden parameters are stored.
+template<typename Data>
+class GrammarFork
+{
+	public:
+		GrammarFork(std::shared_ptr<const CompiledGrammar<Data>> compiled, const ParameterOverlay& overlay = ParameterOverlay{});
+		virtual ~GrammarFork() = default;
+
+		GrammarFork(const GrammarFork&) = delete;
+		GrammarFork(GrammarFork&&) = delete;
+		GrammarFork& operator=(const GrammarFork&) = delete;
+		GrammarFork& operator=(GrammarFork&&) = delete;
+
+		RuleId Resolve(const std::string& name) const { return m_pCompiled->Resolve(name); }
+		std::shared_ptr<GrammarFork<Data>> Fork() const;
+		size_t GetOverlaySize() const { return m_Overlay.GetSize(); }
+
+		void SetOptionWeight(RuleId rule, int option, float weight);
+		void SetRepetitionChance(RuleId rule, float chance);
+
+		std::vector<Data> GenerateSequence(RuleId rule) const;
+		template<typename Engine>
+		void GenerateSequence(RuleId rule, std::vector<Data>& result, Engine& engine) const;
+		template<typename Engine>
+		void GenerateSequence(RuleId rule, std::vector<Data>& result, Engine& engine, int maxDepth) const;
+
+	private:
+		std::shared_ptr<const CompiledGrammar<Data>> m_pCompiled;
+		ParameterOverlay m_Overlay;
+
+		unsigned int RootIndex(RuleId rule, CompiledType type) const;
+};
+
+template<typename Data>
+std::shared_ptr<GrammarFork<Data>> CompiledGrammar<Data>::Fork() const {
+	return std::make_shared<GrammarFork<Data>>(this->shared_from_this());
+}
+
+template<typename Data>
+GrammarFork<Data>::GrammarFork(std::shared_ptr<const CompiledGrammar<Data>> compiled, const ParameterOverlay& overlay)
+	: m_pCompiled{ compiled }
+	, m_Overlay{ overlay }
+{}
+
+template<typename Data>
+std::shared_ptr<GrammarFork<Data>> GrammarFork<Data>::Fork() const {
+	return std::make_shared<GrammarFork<Data>>(m_pCompiled, m_Overlay);
+}
+
+template<typename Data>
+unsigned int GrammarFork<Data>::RootIndex(RuleId rule, CompiledType type) const {
+
+	if (rule.index >= m_pCompiled->m_Roots.size()) {
+		throw Rule404Exception{};
+	}
+
+	unsigned int index{ m_pCompiled->m_Roots[rule.index] };
+	if (m_pCompiled->m_Nodes[index].type != type) {
+		throw RuleTypeException{};
+	}
+	return index;
+}
+
+template<typename Data>
+void GrammarFork<Data>::SetOptionWeight(RuleId rule, int option, float weight) {
+
+	unsigned int index{ RootIndex(rule, CompiledType::Select) };
+	const CompiledNode& node{ m_pCompiled->m_Nodes[index] };
+	if (option < 0 || static_cast<unsigned int>(option) >= node.second) {
+		throw Rule404Exception{};
+	}
+
+	// Shift every cumulative weight from the option onwards
+	float* pWeights{ m_Overlay.Override(index, &m_pCompiled->m_Weights[node.first], node.second) };
+	float delta{ weight - (pWeights[option] - (option > 0 ? pWeights[option - 1] : 0.0f)) };
+	for (unsigned int other{ static_cast<unsigned int>(option) }; other < node.second; ++other) {
+		pWeights[other] += delta;
+	}
+}
+
+template<typename Data>
+void GrammarFork<Data>::SetRepetitionChance(RuleId rule, float chance) {
+
+	unsigned int index{ RootIndex(rule, CompiledType::Repetition) };
+	float* pChance{ m_Overlay.Override(index, &m_pCompiled->m_Nodes[index].value, 1) };
+	*pChance = chance;
+}
+
+template<typename Data>
+std::vector<Data> GrammarFork<Data>::GenerateSequence(RuleId rule) const {
+
+	thread_local BlockEngine engine{ RandomDeviceSeed() };
+
+	std::vector<Data> result{};
+	GenerateSequence(rule, result, engine);
+	return result;
+}
+
+template<typename Data>
+template<typename Engine>
+void GrammarFork<Data>::GenerateSequence(RuleId rule, std::vector<Data>& result, Engine& engine) const {
+	GenerateSequence(rule, result, engine, m_pCompiled->GetDepth());
+}
+
+template<typename Data>
+template<typename Engine>
+void GrammarFork<Data>::GenerateSequence(RuleId rule, std::vector<Data>& result, Engine& engine, int maxDepth) const {
+
+	if (rule.index >= m_pCompiled->m_Roots.size()) {
+		throw Rule404Exception{};
+	}
+
+	const ParameterOverlay* pOverlay{ m_Overlay.IsEmpty() ? nullptr : &m_Overlay };
+	auto emit = [&](unsigned int payload) { result.push_back(m_pCompiled->m_Payloads[payload]); };
+	WalkCompiled(m_pCompiled->GetTables(), m_pCompiled->m_Roots[rule.index], emit, 0, maxDepth, engine, pOverlay);
+}
+
+//*** GRAMMARCOMPILER ***
+//
+//
+
+// Flattens a node graph into a CompiledGrammar, nodes call back into it from Node::Compile.
+// The compiler remembers where every node went, so after the first Finish only the
+// rules and nodes that changed are compiled again and analysed again.
+template<typename Data>
+class GrammarCompiler
+{
+	public:
+		GrammarCompiler();
+		virtual ~GrammarCompiler() = default;
+
+		GrammarCompiler(const GrammarCompiler&) = delete;
+		GrammarCompiler(GrammarCompiler&&) = delete;
+		GrammarCompiler& operator=(const GrammarCompiler&) = delete;
+		GrammarCompiler& operator=(GrammarCompiler&&) = delete;
+
+		bool NeedsRebuild() const;
+		void Reset();
+
+		void AddRule(const std::string& name, RuleId rule, const Node<Data>* node);
+		void MarkNode(const Node<Data>* node);
+		void RetireNode(std::shared_ptr<Node<Data>> node);
+		std::shared_ptr<const CompiledGrammar<Data>> Finish(int maxDepth);
+
+		void AddMemoryUsage(GrammarMemoryUsage& usage, std::unordered_set<const Node<Data>*>& counted) const;
+
+		unsigned int NodeIndex(const Node<Data>* node);
+		void SetLeaf(unsigned int index, const Data& value);
+		void SetSelect(unsigned int index, const std::vector<std::pair<unsigned int, float>>& options);
+		void SetSequence(unsigned int index, const std::vector<unsigned int>& elements);
+		void SetRepetition(unsigned int index, unsigned int node, float chance);
+		void SetLNode(unsigned int index, unsigned int node, unsigned int fallback);
+
+	private:
+		std::shared_ptr<const CompiledGrammar<Data>> m_pPrevious;
+		std::shared_ptr<CompiledGrammar<Data>> m_pCompiled;
+
+		std::unordered_map<const Node<Data>*, unsigned int> m_NodeIndices;
+		std::vector<std::vector<unsigned int>> m_Parents;
+		std::vector<std::shared_ptr<Node<Data>>> m_pRetired;
+		std::vector<std::shared_ptr<Node<Data>>> m_pUnlinked;
+		std::vector<const Node<Data>*> m_pMarked;
+		std::vector<unsigned int> m_Changed;
+		size_t m_Garbage{ 0 };
+
+		void Begin();
+		void Recompile(const Node<Data>* node, unsigned int index);
+		void Unlink(unsigned int index);
+		void ReleaseRetired();
+		void GetChildren(const CompiledNode& node, std::vector<unsigned int>& children) const;
+		void Analyze();
+		void AnalyzeNode(unsigned int index, std::vector<unsigned char>& state);
+};
+
+template<typename Data>
+GrammarCompiler<Data>::GrammarCompiler()
+{}
+
+template<typename Data>
+void GrammarCompiler<Data>::AddMemoryUsage(GrammarMemoryUsage& usage, std::unordered_set<const Node<Data>*>& counted) const {
+
+	usage.compiler += HashMapMemory(m_NodeIndices) + VectorMemory(m_Parents) + VectorMemory(m_pRetired) + VectorMemory(m_pUnlinked);
+	usage.compiler += VectorMemory(m_pMarked) + VectorMemory(m_Changed);
+	for (const std::vector<unsigned int>& parents : m_Parents) {
+		usage.compiler += VectorMemory(parents);
+	}
+
+	// Replaced nodes live on until the next rebuild, rules don't refer to them anymore
+	GrammarMemoryUsage retired{};
+	for (const std::shared_ptr<Node<Data>>& pNode : m_pRetired) {
+		pNode->CountMemory(retired, counted);
+	}
+	for (const std::shared_ptr<Node<Data>>& pNode : m_pUnlinked) {
+		pNode->CountMemory(retired, counted);
+	}
+	usage.compiler += retired.GetTotal();
+
+	if (m_pPrevious) {
+		usage.compiled += m_pPrevious->GetMemoryUsage();
+	}
+}
+
+template<typename Data>
+bool GrammarCompiler<Data>::NeedsRebuild() const {
+
+	// Rebuild once more than half of the tables is garbage from replaced nodes
+	if (!m_pPrevious) {
+		return true;
+	}
+	return 2 * m_Garbage > m_pPrevious->m_Nodes.size() + m_pPrevious->m_Children.size();
+}
+
+template<typename Data>
+void GrammarCompiler<Data>::Reset() {
+	m_pPrevious = nullptr;
+	m_pCompiled = nullptr;
+	m_NodeIndices.clear();
+	m_Parents.clear();
+	m_pRetired.clear();
+	m_pUnlinked.clear();
+	m_pMarked.clear();
+	m_Changed.clear();
+	m_Garbage = 0;
+}
+
+template<typename Data>
+void GrammarCompiler<Data>::AddRule(const std::string& name, RuleId rule, const Node<Data>* node) {
+
+	Begin();
+
+	if (m_pCompiled->m_Roots.size() <= rule.index) {
+		m_pCompiled->m_Roots.resize(rule.index + 1);
+	}
+
+	m_pCompiled->m_Roots[rule.index] = NodeIndex(node);
+	m_pCompiled->m_RuleIds.emplace(name, rule);
+}
+
+template<typename Data>
+void GrammarCompiler<Data>::MarkNode(const Node<Data>* node) {
+
+	// Nothing compiled yet, the first Finish compiles everything anyway
+	if (m_pPrevious && m_NodeIndices.find(node) != m_NodeIndices.end()) {
+		m_pMarked.push_back(node);
+	}
+}
+
+template<typename Data>
+void GrammarCompiler<Data>::RetireNode(std::shared_ptr<Node<Data>> node) {
+
+	// Keep compiled nodes alive, so their address can't be reused by a new node.
+	// Another rule or an LNode fallback may still use it, Finish checks that.
+	if (m_pPrevious && m_NodeIndices.find(node.get()) != m_NodeIndices.end()
+		&& std::find(m_pRetired.begin(), m_pRetired.end(), node) == m_pRetired.end()) {
+		m_pRetired.push_back(node);
+	}
+}
+
+template<typename Data>
+std::shared_ptr<const CompiledGrammar<Data>> GrammarCompiler<Data>::Finish(int maxDepth) {
+
+	Begin();
+
+	// Nodes that had a child swapped are compiled again in place
+	std::sort(m_pMarked.begin(), m_pMarked.end());
+	m_pMarked.erase(std::unique(m_pMarked.begin(), m_pMarked.end()), m_pMarked.end());
+	for (const Node<Data>* node : m_pMarked) {
+		Recompile(node, m_NodeIndices[node]);
+	}
+	m_pMarked.clear();
+	ReleaseRetired();
+
+	Analyze();
+	m_Changed.clear();
+
+	m_pCompiled->m_MaxDepth = maxDepth;
+	m_pCompiled->m_Version = NextGrammarVersion();
+	m_pPrevious = m_pCompiled;
+	m_pCompiled = nullptr;
+	return m_pPrevious;
+}
+
+template<typename Data>
+void GrammarCompiler<Data>::Begin() {
+
+	if (m_pCompiled) {
+		return;
+	}
+
+	// Start from the previous tables, untouched rules are reused as they are
+	m_pCompiled = std::make_shared<CompiledGrammar<Data>>();
+	if (m_pPrevious) {
+		m_pCompiled->m_RuleIds = m_pPrevious->m_RuleIds;
+		m_pCompiled->m_Roots = m_pPrevious->m_Roots;
+		m_pCompiled->m_Nodes = m_pPrevious->m_Nodes;
+		m_pCompiled->m_Children = m_pPrevious->m_Children;
+		m_pCompiled->m_Weights = m_pPrevious->m_Weights;
+		m_pCompiled->m_Payloads = m_pPrevious->m_Payloads;
+		m_pCompiled->m_Heights = m_pPrevious->m_Heights;
+		m_pCompiled->m_ExpectedSizes = m_pPrevious->m_ExpectedSizes;
+	}
+}
+
+template<typename Data>
+unsigned int GrammarCompiler<Data>::NodeIndex(const Node<Data>* node) {
+
+	auto it{ m_NodeIndices.find(node) };
+	if (it != m_NodeIndices.end()) {
+		return it->second;
+	}
+
+	// Reserve the index before compiling, recursive rules refer back to it
+	unsigned int index{ static_cast<unsigned int>(m_pCompiled->m_Nodes.size()) };
+	m_pCompiled->m_Nodes.emplace_back();
+	m_pCompiled->m_Heights.push_back(0);
+	m_pCompiled->m_ExpectedSizes.push_back(0.0f);
+	m_Parents.emplace_back();
+	m_NodeIndices.emplace(node, index);
+
+	node->Compile(*this, index);
+	m_Changed.push_back(index);
+	return index;
+}
+
+template<typename Data>
+void GrammarCompiler<Data>::Recompile(const Node<Data>* node, unsigned int index) {
+
+	// The node keeps its slot, only the child range of a select or sequence becomes garbage
+	Unlink(index);
+	const CompiledNode& oldNode{ m_pCompiled->m_Nodes[index] };
+	if (oldNode.type == CompiledType::Select || oldNode.type == CompiledType::Sequence) {
+		m_Garbage += oldNode.second;
+	}
+
+	node->Compile(*this, index);
+	m_Changed.push_back(index);
+}
+
+template<typename Data>
+void GrammarCompiler<Data>::Unlink(unsigned int index) {
+
+	std::vector<unsigned int> children;
+	GetChildren(m_pCompiled->m_Nodes[index], children);
+	for (unsigned int child : children) {
+		std::vector<unsigned int>& parents{ m_Parents[child] };
+		auto it{ std::find(parents.begin(), parents.end(), index) };
+		if (it != parents.end()) {
+			parents.erase(it);
+		}
+	}
+}
+
+template<typename Data>
+void GrammarCompiler<Data>::ReleaseRetired() {
+
+	// Retired nodes nothing else holds on to are unreachable, unlink them so changes
+	// below them don't analyse them again, their slot and child range become garbage
+	auto released{ std::stable_partition(m_pRetired.begin(), m_pRetired.end(),
+		[](const std::shared_ptr<Node<Data>>& pNode) { return pNode.use_count() > 1; }) };
+
+	for (auto it{ released }; it != m_pRetired.end(); ++it) {
+		const unsigned int index{ m_NodeIndices[it->get()] };
+		Unlink(index);
+		const CompiledNode& node{ m_pCompiled->m_Nodes[index] };
+		m_Garbage += 1 + ((node.type == CompiledType::Select || node.type == CompiledType::Sequence) ? node.second : 0);
+		m_pUnlinked.push_back(std::move(*it));
+	}
+	m_pRetired.erase(released, m_pRetired.end());
+}
+
+template<typename Data>
+void GrammarCompiler<Data>::GetChildren(const CompiledNode& node, std::vector<unsigned int>& children) const {
+
+	switch (node.type) {
+		case CompiledType::Leaf:
+			break;
+		case CompiledType::Select:
+		case CompiledType::Sequence:
+			children.insert(children.end(), m_pCompiled->m_Children.begin() + node.first, m_pCompiled->m_Children.begin() + node.first + node.second);
+			break;
+		case CompiledType::Repetition:
+			children.push_back(node.first);
+			break;
+		case CompiledType::LNode:
+			children.push_back(node.first);
+			children.push_back(node.second);
+			break;
+	}
+}
+
+template<typename Data>
+void GrammarCompiler<Data>::Analyze() {
+
+	// Only nodes that can reach a changed node can have a different result
+	std::vector<unsigned char> state(m_pCompiled->m_Nodes.size(), 2);
+	std::vector<unsigned int> affected{ m_Changed };
+	for (unsigned int index : affected) {
+		state[index] = 0;
+	}
+	for (size_t next{ 0 }; next < affected.size(); ++next) {
+		for (unsigned int parent : m_Parents[affected[next]]) {
+			if (state[parent] != 0) {
+				state[parent] = 0;
+				affected.push_back(parent);
+			}
+		}
+	}
+
+	for (unsigned int index : affected) {
+		AnalyzeNode(index, state);
+	}
+}
+
+// state: 0 = stale, 1 = being analysed, 2 = up to date
+template<typename Data>
+void GrammarCompiler<Data>::AnalyzeNode(unsigned int index, std::vector<unsigned char>& state) {
+
+	if (state[index] != 0) {
+		return;
+	}
+	state[index] = 1;
+
+	const CompiledNode& node{ m_pCompiled->m_Nodes[index] };
+	std::vector<unsigned int>& heights{ m_pCompiled->m_Heights };
+	std::vector<float>& expectedSizes{ m_pCompiled->m_ExpectedSizes };
+	std::vector<unsigned int> children;
+	GetChildren(node, children);
+
+	// Height 0 marks nodes that recurse or depend on the LNode depth
+	unsigned int height{ 1 };
+	for (unsigned int child : children) {
+		AnalyzeNode(child, state);
+		if (state[child] == 1 || heights[child] == 0) {
+			height = 0;
+			break;
+		}
+		height = std::max(height, heights[child] + 1);
+	}
+
+	float expectedSize{ 0.0f };
+	switch (node.type) {
+		case CompiledType::Leaf:
+			expectedSize = 1.0f;
+			break;
+		case CompiledType::Select: {
+			float previousWeight{ 0.0f };
+			for (unsigned int option{ 0 }; option < node.second && height != 0; ++option) {
+				const float cumulativeWeight{ m_pCompiled->m_Weights[node.first + option] };
+				expectedSize += (cumulativeWeight - previousWeight) / node.value * expectedSizes[children[option]];
+				previousWeight = cumulativeWeight;
+			}
+			break;
+		}
+		case CompiledType::Sequence:
+			for (unsigned int child : children) {
+				expectedSize += height != 0 ? expectedSizes[child] : 0.0f;
+			}
+			break;
+		case CompiledType::Repetition:
+			if (node.value >= 1.0f) {
+				height = 0;
+			}
+			else if (height != 0) {
+				expectedSize = expectedSizes[node.first] / (1.0f - node.value);
+			}
+			break;
+		case CompiledType::LNode:
+			height = 0;
+			break;
+	}
+
+	heights[index] = height;
+	expectedSizes[index] = height != 0 ? expectedSize : 0.0f;
+	state[index] = 2;
+}
+
+template<typename Data>
+void GrammarCompiler<Data>::SetLeaf(unsigned int index, const Data& value) {
+
+	CompiledNode& node{ m_pCompiled->m_Nodes[index] };
+	node.type = CompiledType::Leaf;
+	node.first = static_cast<unsigned int>(m_pCompiled->m_Payloads.size());
+	node.second = 0;
+	node.value = 0.0f;
+
+	m_pCompiled->m_Payloads.push_back(value);
+}
+
+template<typename Data>
+void GrammarCompiler<Data>::SetSelect(unsigned int index, const std::vector<std::pair<unsigned int, float>>& options) {
+
+	CompiledNode& node{ m_pCompiled->m_Nodes[index] };
+	node.type = CompiledType::Select;
+	node.first = static_cast<unsigned int>(m_pCompiled->m_Children.size());
+	node.second = static_cast<unsigned int>(options.size());
+
+	float weightsSum{ 0 };
+	for (auto& option : options) {
+		weightsSum += option.second;
+		m_pCompiled->m_Children.push_back(option.first);
+		m_pCompiled->m_Weights.push_back(weightsSum);
+		m_Parents[option.first].push_back(index);
+	}
+	node.value = weightsSum;
+}
+
+template<typename Data>
+void GrammarCompiler<Data>::SetSequence(unsigned int index, const std::vector<unsigned int>& elements) {
+
+	CompiledNode& node{ m_pCompiled->m_Nodes[index] };
+	node.type = CompiledType::Sequence;
+	node.first = static_cast<unsigned int>(m_pCompiled->m_Children.size());
+	node.second = static_cast<unsigned int>(elements.size());
+	node.value = 0.0f;
+
+	for (unsigned int element : elements) {
+		m_pCompiled->m_Children.push_back(element);
+		m_pCompiled->m_Weights.push_back(0.0f);
+		m_Parents[element].push_back(index);
+	}
+}
+
+template<typename Data>
+void GrammarCompiler<Data>::SetRepetition(unsigned int index, unsigned int repeated, float chance) {
+
+	CompiledNode& node{ m_pCompiled->m_Nodes[index] };
+	node.type = CompiledType::Repetition;
+	node.first = repeated;
+	node.second = 0;
+	node.value = chance;
+
+	m_Parents[repeated].push_back(index);
+}
+
+template<typename Data>
+void GrammarCompiler<Data>::SetLNode(unsigned int index, unsigned int normal, unsigned int fallback) {
+
+	CompiledNode& node{ m_pCompiled->m_Nodes[index] };
+	node.type = CompiledType::LNode;
+	node.first = normal;
+	node.second = fallback;
+	node.value = 0.0f;
+
+	m_Parents[normal].push_back(index);
+	m_Parents[fallback].push_back(index);
+}
+
+//*** GRAMMARSNAPSHOT ***
+//
+//
+
+// Publishes compiled grammars to readers with an atomic pointer swap.
+// Readers keep the snapshot they acquired alive until they release it,
+// so in-flight generations finish on the old grammar after a reload.
+template<typename Data>
+class GrammarSnapshot
+{
+	public:
+		GrammarSnapshot(std::shared_ptr<const CompiledGrammar<Data>> compiled = nullptr);
+		virtual ~GrammarSnapshot() = default;
+
+		GrammarSnapshot(const GrammarSnapshot&) = delete;
+		GrammarSnapshot(GrammarSnapshot&&) = delete;
+		GrammarSnapshot& operator=(const GrammarSnapshot&) = delete;
+		GrammarSnapshot& operator=(GrammarSnapshot&&) = delete;
+
+		std::shared_ptr<const CompiledGrammar<Data>> Acquire() const;
+		void Publish(std::shared_ptr<const CompiledGrammar<Data>> compiled);
+		std::future<void> Reload(std::function<std::shared_ptr<const CompiledGrammar<Data>>()> build);
+
+	private:
+		std::shared_ptr<const CompiledGrammar<Data>> m_pCompiled;
+};
+
+template<typename Data>
+GrammarSnapshot<Data>::GrammarSnapshot(std::shared_ptr<const CompiledGrammar<Data>> compiled)
+	: m_pCompiled{ compiled }
+{}
+
+template<typename Data>
+std::shared_ptr<const CompiledGrammar<Data>> GrammarSnapshot<Data>::Acquire() const {
+	return std::atomic_load(&m_pCompiled);
+}
+
+template<typename Data>
+void GrammarSnapshot<Data>::Publish(std::shared_ptr<const CompiledGrammar<Data>> compiled) {
+	std::atomic_store(&m_pCompiled, compiled);
+}
+
+template<typename Data>
+std::future<void> GrammarSnapshot<Data>::Reload(std::function<std::shared_ptr<const CompiledGrammar<Data>>()> build) {
+
+	// Build the new grammar off-thread, readers keep using the current one meanwhile
+	return std::async(std::launch::async, [this, build]() {
+		Publish(build());
+	});
+}
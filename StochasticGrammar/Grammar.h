@@ -1,9 +1,14 @@
 #pragma once
 #include <string>
 #include "Nodes.h"
+#include "CompiledGrammar.h"
 #include <memory>
+#include <istream>
+#include <stdexcept>
 #include <unordered_map>
+#include <unordered_set>
 
+#define DEF_DEL " = "
 #define SEQ_DEL " & "
 #define SEL_DEL " | "
 #define REP_DEL " # "
@@ -12,7 +17,7 @@
 using weightedRule = std::pair<std::string, float>;
 using repeatedRule = std::pair<std::string, float>;
 
-class Rule404Exception {};
+class RuleSyntaxException {};
 
 template<typename Data>
 class Grammar
@@ -26,27 +31,49 @@ class Grammar
 		Grammar& operator=(const Grammar&) = delete;
 		Grammar& operator=(Grammar&&) = delete;
 
-		std::vector<Data> GenerateSequence(std::string rule);
+		RuleId Resolve(const std::string& name) const;
 
-		void ParseRule(const std::string& name, const std::string& rule);
-		void AddLeaveNode(const std::string& name, const Data& data);
+		std::vector<Data> GenerateSequence(const std::string& rule);
+		std::vector<Data> GenerateSequence(RuleId rule);
+		void GenerateSequence(RuleId rule, std::vector<Data>& result);
 
-	private:
-		std::unordered_map<std::string,std::shared_ptr<Node<Data>>> m_pRules;
+		void SetOptionWeight(RuleId rule, int option, float weight);
+
+		std::shared_ptr<const CompiledGrammar<Data>> Freeze();
+		// The snapshot uses maxDepth instead of the LNode default
+		std::shared_ptr<const CompiledGrammar<Data>> Freeze(int maxDepth);
 
-		void ParseSelectorRule(const std::string& name, std::string& rule);
-		void ParseSequenceRule(const std::string& name, std::string& rule);
-		void ParseRepetitionRule(const std::string& name, std::string& rule);
-		void ParseLNodeRule(const std::string& name, std::string& rule);
-		void ParseSingleRule(const std::string& name, std::string rule);
+		// Bytes held by the rules, the compiler and the last frozen snapshot
+		GrammarMemoryUsage MemoryUsage() const;
 
-		void ChangeRule(const std::string& ruleName, std::shared_ptr<Node<Data>> newNode);
+		RuleId ParseRule(const std::string& name, const std::string& rule);
+		void ParseRules(std::istream& stream);
+		RuleId AddLeaveNode(const std::string& name, const Data& data);
 
-		void AddSingleRule(const std::string& name, const std::string& rule);
-		void AddSelectorRule(const std::string& name, const std::vector<weightedRule> rules);
-		void AddSequenceRule(const std::string& name, const std::vector<std::string> rules);
-		void AddRepetitionRule(const std::string& name, const repeatedRule rule);
-		void AddLNodeRule(const std::string& name, const std::string& rule, const std::string& fallbackRule);
+	private:
+		std::unordered_map<std::string, RuleId> m_RuleIds;
+		std::vector<const std::string*> m_pRuleNames;
+		std::vector<std::shared_ptr<Node<Data>>> m_pRules;
+
+		GrammarCompiler<Data> m_Compiler;
+		std::vector<RuleId> m_ChangedRules;
+
+		RuleId ParseSelectorRule(const std::string& name, std::string& rule);
+		RuleId ParseSequenceRule(const std::string& name, std::string& rule);
+		RuleId ParseRepetitionRule(const std::string& name, std::string& rule);
+		RuleId ParseLNodeRule(const std::string& name, std::string& rule);
+		RuleId ParseSingleRule(const std::string& name, std::string rule);
+		static float ParseNumber(const std::string& text);
+
+		RuleId GetOrParseRule(const std::string& ruleName);
+		RuleId SetRule(const std::string& ruleName, std::shared_ptr<Node<Data>> newNode);
+		void ChangeRule(RuleId rule, std::shared_ptr<Node<Data>> newNode);
+
+		RuleId AddSingleRule(const std::string& name, const std::string& rule);
+		RuleId AddSelectorRule(const std::string& name, const std::vector<weightedRule> rules);
+		RuleId AddSequenceRule(const std::string& name, const std::vector<std::string> rules);
+		RuleId AddRepetitionRule(const std::string& name, const repeatedRule rule);
+		RuleId AddLNodeRule(const std::string& name, const std::string& rule, const std::string& fallbackRule);
 };
 
 template<typename Data>
@@ -54,157 +81,217 @@ Grammar<Data>::Grammar()
 {}
 
 template<typename Data>
-std::vector<Data> Grammar<Data>::GenerateSequence(std::string ruleName) {
+RuleId Grammar<Data>::Resolve(const std::string& name) const {
 
-	if (m_pRules.find(ruleName) == m_pRules.end()) {
+	auto it{ m_RuleIds.find(name) };
+	if (it == m_RuleIds.end()) {
 		throw Rule404Exception{};
 	}
+	return it->second;
+}
+
+template<typename Data>
+std::vector<Data> Grammar<Data>::GenerateSequence(const std::string& ruleName) {
+	return GenerateSequence(Resolve(ruleName));
+}
+
+template<typename Data>
+std::vector<Data> Grammar<Data>::GenerateSequence(RuleId rule) {
 
 	std::vector<Data> result{};
-	m_pRules[ruleName]->Parse(result, 0);
+	GenerateSequence(rule, result);
 	return result;
 }
 
-template<>
-void Grammar<std::string>::AddSingleRule(const std::string& name, const std::string& rule) {
-
-	// Non-existing subrule
-	if (m_pRules.find(rule) == m_pRules.end()) {
-		m_pRules[rule] = std::make_shared<LeafNode<std::string>>(rule);
-	}
+template<typename Data>
+void Grammar<Data>::GenerateSequence(RuleId rule, std::vector<Data>& result) {
 
-	if (m_pRules.find(name) != m_pRules.end()) {
-		ChangeRule(name, m_pRules[rule]);
-		return;
+	if (rule.index >= m_pRules.size()) {
+		throw Rule404Exception{};
 	}
 
-	// Non-existing rule
-	m_pRules[name] = m_pRules[rule];
+	m_pRules[rule.index]->Parse(result, 0);
 }
 
 template<typename Data>
-void Grammar<Data>::AddSingleRule(const std::string& name, const std::string& rule) {
-
-	// Non-existing subrule
-	if (m_pRules.find(rule) == m_pRules.end()) {
+void Grammar<Data>::SetOptionWeight(RuleId rule, int option, float weight) {
 
+	if (rule.index >= m_pRules.size()) {
 		throw Rule404Exception{};
 	}
 
-	if (m_pRules.find(name) != m_pRules.end()) {
-		ChangeRule(name, m_pRules[rule]);
-		return;
+	SelectNode<Data>* selectNode{ dynamic_cast<SelectNode<Data>*>(m_pRules[rule.index].get()) };
+	if (!selectNode) {
+		throw RuleTypeException{};
+	}
+	if (option < 0 || option >= selectNode->GetOptionCount()) {
+		throw Rule404Exception{};
 	}
 
-	// Non-existing rule
-	m_pRules[name] = m_pRules[rule];
+	selectNode->SetWeight(option, weight);
+	m_Compiler.MarkNode(selectNode);
 }
 
 template<typename Data>
-void Grammar<Data>::AddLeaveNode(const std::string& name, const Data& data) {
-	std::shared_ptr<LeafNode<Data>> leaf{ std::make_shared<LeafNode<Data>>(data) };
-	m_pRules[name] = leaf;
+std::shared_ptr<const CompiledGrammar<Data>> Grammar<Data>::Freeze() {
+	return Freeze(LNode<Data>::GetDepth());
 }
 
+// Only the rules changed since the previous Freeze are compiled again
 template<typename Data>
-void Grammar<Data>::AddSelectorRule(const std::string& name, const std::vector<weightedRule> rules) {
-	std::shared_ptr<SelectNode<Data>> selectNode = std::make_shared<SelectNode<Data>>();
-	for (auto& rule : rules) {
+std::shared_ptr<const CompiledGrammar<Data>> Grammar<Data>::Freeze(int maxDepth) {
 
-		// Non-existing subrule
-		if (m_pRules.find(rule.first) == m_pRules.end()) {
-			ParseRule(rule.first, rule.first);
+	if (m_Compiler.NeedsRebuild()) {
+		m_Compiler.Reset();
+		for (unsigned int index{ 0 }; index < m_pRules.size(); ++index) {
+			m_Compiler.AddRule(*m_pRuleNames[index], RuleId{ index }, m_pRules[index].get());
 		}
-
-		// Add to selectNode
-		selectNode->AddOption(m_pRules[rule.first].get(), rule.second);
 	}
-
-	if (m_pRules.find(name) != m_pRules.end()) {
-		ChangeRule(name, selectNode);
-		return;
+	else {
+		for (RuleId rule : m_ChangedRules) {
+			m_Compiler.AddRule(*m_pRuleNames[rule.index], rule, m_pRules[rule.index].get());
+		}
 	}
 
-	// Non-existing rule
-	m_pRules[name] = selectNode;
+	m_ChangedRules.clear();
+	return m_Compiler.Finish(maxDepth);
 }
 
 template<typename Data>
-void Grammar<Data>::AddSequenceRule(const std::string& name, const std::vector<std::string> rules) {
-	std::shared_ptr<SequenceNode<Data>> sequenceNode = std::make_shared<SequenceNode<Data>>();
-	for (auto& rule : rules) {
+GrammarMemoryUsage Grammar<Data>::MemoryUsage() const {
 
-		// Non-existing subule
-		if (m_pRules.find(rule) == m_pRules.end()) {
-			ParseRule(rule, rule);
-		}
+	GrammarMemoryUsage usage{};
 
-		// Add to selectNode
-		sequenceNode->AddElement(m_pRules[rule].get());
+	// Rules may share nodes, every node is counted once
+	std::unordered_set<const Node<Data>*> counted{};
+	for (const std::shared_ptr<Node<Data>>& pRule : m_pRules) {
+		pRule->CountMemory(usage, counted);
 	}
 
-	if (m_pRules.find(name) != m_pRules.end()) {
-		ChangeRule(name, sequenceNode);
-		return;
+	usage.ruleTable += HashMapMemory(m_RuleIds) + VectorMemory(m_pRuleNames) + VectorMemory(m_pRules) + VectorMemory(m_ChangedRules);
+	for (const auto& rule : m_RuleIds) {
+		usage.ruleNames += StringMemory(rule.first);
 	}
 
-	// Non-existing rule
-	m_pRules[name] = sequenceNode;
+	m_Compiler.AddMemoryUsage(usage, counted);
+	return usage;
+}
+
+template<>
+RuleId Grammar<std::string>::AddSingleRule(const std::string& name, const std::string& rule) {
+
+	// Non-existing subrule
+	auto it{ m_RuleIds.find(rule) };
+	if (it == m_RuleIds.end()) {
+		return SetRule(name, std::make_shared<LeafNode<std::string>>(rule));
+	}
+
+	return SetRule(name, m_pRules[it->second.index]);
 }
 
 template<typename Data>
-void Grammar<Data>::AddRepetitionRule(const std::string& name, const repeatedRule rule) {
+RuleId Grammar<Data>::AddSingleRule(const std::string& name, const std::string& rule) {
 
 	// Non-existing subrule
-	if (m_pRules.find(rule.first) == m_pRules.end()) {
-		ParseRule(rule.first, rule.first);
+	auto it{ m_RuleIds.find(rule) };
+	if (it == m_RuleIds.end()) {
+		throw Rule404Exception{};
 	}
 
-	if (m_pRules.find(name) != m_pRules.end()) {
-		ChangeRule(name, std::make_shared<RepetitionNode<Data>>(m_pRules[rule.first].get(), rule.second));
-		return;
+	return SetRule(name, m_pRules[it->second.index]);
+}
+
+template<typename Data>
+RuleId Grammar<Data>::AddLeaveNode(const std::string& name, const Data& data) {
+	std::shared_ptr<LeafNode<Data>> leaf{ std::make_shared<LeafNode<Data>>(data) };
+	return SetRule(name, leaf);
+}
+
+template<typename Data>
+RuleId Grammar<Data>::AddSelectorRule(const std::string& name, const std::vector<weightedRule> rules) {
+	std::shared_ptr<SelectNode<Data>> selectNode = std::make_shared<SelectNode<Data>>();
+	for (auto& rule : rules) {
+		RuleId option{ GetOrParseRule(rule.first) };
+		selectNode->AddOption(m_pRules[option.index].get(), rule.second);
 	}
 
-	// Non-existing rule
-	m_pRules[name] = std::make_shared<RepetitionNode<Data>>(m_pRules[rule.first].get(), rule.second);
+	return SetRule(name, selectNode);
 }
 
 template<typename Data>
-void Grammar<Data>::AddLNodeRule(const std::string& name, const std::string& rule, const std::string& fallbackRule) {
-	
-	// Non-existing subrule
-	if (m_pRules.find(rule) == m_pRules.end()) {
-		ParseRule(rule, rule);
+RuleId Grammar<Data>::AddSequenceRule(const std::string& name, const std::vector<std::string> rules) {
+	std::shared_ptr<SequenceNode<Data>> sequenceNode = std::make_shared<SequenceNode<Data>>();
+	for (auto& rule : rules) {
+		RuleId element{ GetOrParseRule(rule) };
+		sequenceNode->AddElement(m_pRules[element.index].get());
 	}
-	if (m_pRules.find(fallbackRule) == m_pRules.end()) {
-		ParseRule(fallbackRule, fallbackRule);
+
+	return SetRule(name, sequenceNode);
+}
+
+template<typename Data>
+RuleId Grammar<Data>::AddRepetitionRule(const std::string& name, const repeatedRule rule) {
+	RuleId repeated{ GetOrParseRule(rule.first) };
+	return SetRule(name, std::make_shared<RepetitionNode<Data>>(m_pRules[repeated.index].get(), rule.second));
+}
+
+template<typename Data>
+RuleId Grammar<Data>::AddLNodeRule(const std::string& name, const std::string& rule, const std::string& fallbackRule) {
+	RuleId normal{ GetOrParseRule(rule) };
+	RuleId fallback{ GetOrParseRule(fallbackRule) };
+	return SetRule(name, std::make_shared<LNode<Data>>(m_pRules[normal.index].get(), m_pRules[fallback.index]));
+}
+
+template<typename Data>
+RuleId Grammar<Data>::GetOrParseRule(const std::string& ruleName) {
+
+	auto it{ m_RuleIds.find(ruleName) };
+	if (it != m_RuleIds.end()) {
+		return it->second;
 	}
 
-	if (m_pRules.find(name) != m_pRules.end()) {
-		ChangeRule(name, std::make_shared<LNode<Data>>(m_pRules[rule].get(), m_pRules[fallbackRule]));
-		return;
+	// Non-existing subrule
+	return ParseRule(ruleName, ruleName);
+}
+
+template<typename Data>
+RuleId Grammar<Data>::SetRule(const std::string& ruleName, std::shared_ptr<Node<Data>> newNode) {
+
+	auto it{ m_RuleIds.find(ruleName) };
+	if (it != m_RuleIds.end()) {
+		ChangeRule(it->second, newNode);
+		m_ChangedRules.push_back(it->second);
+		return it->second;
 	}
 
 	// Non-existing rule
-	m_pRules[name] = std::make_shared<LNode<Data>>(m_pRules[rule].get(), m_pRules[fallbackRule]);
+	RuleId rule{ static_cast<unsigned int>(m_pRules.size()) };
+	it = m_RuleIds.emplace(ruleName, rule).first;
+	m_pRuleNames.push_back(&it->first);
+	m_pRules.push_back(newNode);
+	m_ChangedRules.push_back(rule);
+	return rule;
 }
 
 template<typename Data>
-void Grammar<Data>::ChangeRule(const std::string& ruleName, std::shared_ptr<Node<Data>> newNode) {
+void Grammar<Data>::ChangeRule(RuleId rule, std::shared_ptr<Node<Data>> newNode) {
 
 	// Get the old node
-	std::shared_ptr<Node<Data>> oldNode = m_pRules[ruleName];
+	std::shared_ptr<Node<Data>> oldNode = m_pRules[rule.index];
 	if (oldNode == newNode) {
 		return;
 	}
 
 
 	// Update the rule
-	m_pRules[ruleName] = newNode;
+	m_pRules[rule.index] = newNode;
+	m_Compiler.RetireNode(oldNode);
 
 	// Change every reference to the old node to the new one
-	for (auto& rule : m_pRules) {
-		rule.second->SwapDependingNode(oldNode.get(), newNode.get());
+	for (auto& node : m_pRules) {
+		if (node->SwapDependingNode(oldNode.get(), newNode.get())) {
+			m_Compiler.MarkNode(node.get());
+		}
 	}	
 }
 
@@ -218,31 +305,54 @@ void Grammar<Data>::ChangeRule(const std::string& ruleName, std::shared_ptr<Node
 //		repetiton: [rule] # [times]
 
 template<typename Data>
-void Grammar<Data>::ParseRule(const std::string& name, const std::string& rule) {
+RuleId Grammar<Data>::ParseRule(const std::string& name, const std::string& rule) {
 
 	std::string parsedRule{ rule };
 
 	if (parsedRule.find(LND_DEL) != std::string::npos) {
-		ParseLNodeRule(name, parsedRule);
-		return;
+		return ParseLNodeRule(name, parsedRule);
 	}
 	if (parsedRule.find(SEQ_DEL) != std::string::npos) {
-		ParseSequenceRule(name, parsedRule);
-		return;
+		return ParseSequenceRule(name, parsedRule);
 	}
 	if (parsedRule.find(SEL_DEL) != std::string::npos) {
-		ParseSelectorRule(name, parsedRule);
-		return;
+		return ParseSelectorRule(name, parsedRule);
 	}
 	if (parsedRule.find(REP_DEL) != std::string::npos) {
-		ParseRepetitionRule(name, parsedRule);
-		return;
+		return ParseRepetitionRule(name, parsedRule);
+	}
+	return ParseSingleRule(name, rule);
+}
+
+// Grammar files hold one rule per line:
+//		[name] = [rule]
+// Empty lines and lines starting with // are skipped
+
+template<typename Data>
+void Grammar<Data>::ParseRules(std::istream& stream) {
+
+	std::string line;
+	while (std::getline(stream, line)) {
+
+		if (!line.empty() && line.back() == '\r') {
+			line.pop_back();
+		}
+		if (line.find_first_not_of(" \t") == std::string::npos || line.compare(0, 2, "//") == 0) {
+			continue;
+		}
+
+		size_t splitIndex = line.find(DEF_DEL);
+		if (splitIndex == std::string::npos) {
+			throw RuleSyntaxException{};
+		}
+
+		std::string del{ DEF_DEL };
+		ParseRule(line.substr(0, splitIndex), line.substr(splitIndex + del.length()));
 	}
-	ParseSingleRule(name, rule);
 }
 
 template<typename Data>
-void Grammar<Data>::ParseSelectorRule(const std::string& name, std::string& rule) {
+RuleId Grammar<Data>::ParseSelectorRule(const std::string& name, std::string& rule) {
 
 	//split into subrules
 	std::vector<std::string> rules;
@@ -262,16 +372,16 @@ void Grammar<Data>::ParseSelectorRule(const std::string& name, std::string& rule
 		std::string weightString{ rule.substr(0, spaceIndex) };
 		std::string ruleName{ rule.substr(spaceIndex + 1, rule.length() - weightString.length() - 1) };
 
-		float weight{ std::stof(weightString) };
+		float weight{ ParseNumber(weightString) };
 		weightedRules.push_back(std::make_pair(ruleName, weight));
 	}
 
 	// Add to grammar
-	AddSelectorRule(name, weightedRules);
+	return AddSelectorRule(name, weightedRules);
 }
 
 template<typename Data>
-void Grammar<Data>::ParseSequenceRule(const std::string& name, std::string& rule) {
+RuleId Grammar<Data>::ParseSequenceRule(const std::string& name, std::string& rule) {
 
 	//split into subrules
 	std::vector<std::string> rules;
@@ -283,33 +393,48 @@ void Grammar<Data>::ParseSequenceRule(const std::string& name, std::string& rule
 		rules.push_back(rule.substr(first, last - first));
 	}
 
-	AddSequenceRule(name, rules);
+	return AddSequenceRule(name, rules);
+}
+
+// Weights and chances that are not a number are syntax errors, like any other malformed rule
+template<typename Data>
+float Grammar<Data>::ParseNumber(const std::string& text) {
+
+	try {
+		return std::stof(text);
+	}
+	catch (const std::invalid_argument&) {
+		throw RuleSyntaxException{};
+	}
+	catch (const std::out_of_range&) {
+		throw RuleSyntaxException{};
+	}
 }
 
 template<typename Data>
-void Grammar<Data>::ParseSingleRule(const std::string& name, std::string rule) {
-	AddSingleRule(name, rule);
+RuleId Grammar<Data>::ParseSingleRule(const std::string& name, std::string rule) {
+	return AddSingleRule(name, rule);
 }
 
 template<typename Data>
-void Grammar<Data>::ParseRepetitionRule(const std::string& name, std::string& rule) {
+RuleId Grammar<Data>::ParseRepetitionRule(const std::string& name, std::string& rule) {
 
 	std::string del{ REP_DEL };
 	size_t splitIndex = rule.find(del);
 	std::string ruleName{ rule.substr(0, splitIndex) };
 	std::string repetitionString{ rule.substr(splitIndex + del.length(), rule.length() - ruleName.length() - del.length())};
 
-	float repetitions{ std::stof(repetitionString) };
-	AddRepetitionRule(name, std::make_pair(ruleName, repetitions));
+	float repetitions{ ParseNumber(repetitionString) };
+	return AddRepetitionRule(name, std::make_pair(ruleName, repetitions));
 }
 
 template<typename Data>
-void Grammar<Data>::ParseLNodeRule(const std::string& name, std::string& rule) {
+RuleId Grammar<Data>::ParseLNodeRule(const std::string& name, std::string& rule) {
 
 	std::string del{ LND_DEL };
 	size_t splitIndex = rule.find(del);
 	std::string fallbackName{ rule.substr(0, splitIndex) };
-	std::string ruleName{ rule.substr(splitIndex + del.length(), rule.length() - ruleName.length() - del.length()) };
+	std::string ruleName{ rule.substr(splitIndex + del.length()) };
 
-	AddLNodeRule(name, ruleName, fallbackName);
+	return AddLNodeRule(name, ruleName, fallbackName);
 }
\ No newline at end of file
@@ -0,0 +1,53 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+//*** MEMORYUSAGE ***
+//
+//
+
+// Bytes a grammar holds, by what holds them. Worked out from container sizes and capacities,
+// so allocator headers and padding between blocks are not included.
+struct GrammarMemoryUsage {
+	size_t nodes{ 0 };			// Node objects with their shared_ptr control blocks
+	size_t children{ 0 };		// Option and element vectors of select and sequence nodes
+	size_t ruleTable{ 0 };		// Rule hash table, rule vectors and pending changes
+	size_t ruleNames{ 0 };		// Heap memory of the rule name strings
+	size_t payloads{ 0 };		// Heap memory of leaf payloads, the payload itself is part of its node
+	size_t compiler{ 0 };		// Caches of the incremental compiler and the nodes it keeps for retirement
+	size_t compiled{ 0 };		// Compiled tables of the last Freeze, with their own payload and name copies
+
+	size_t GetTotal() const { return nodes + children + ruleTable + ruleNames + payloads + compiler + compiled; }
+};
+
+// Use and weak counts next to the vtable pointer, in front of a node made with make_shared
+constexpr size_t SharedBlockOverhead{ sizeof(void*) + 2 * sizeof(int) };
+
+template<typename T>
+size_t VectorMemory(const std::vector<T>& vector) {
+	return vector.capacity() * sizeof(T);
+}
+
+// Strings short enough for the small string buffer have no heap memory
+inline size_t StringMemory(const std::string& string) {
+
+	static const size_t localCapacity{ std::string{}.capacity() };
+	return string.capacity() > localCapacity ? string.capacity() + 1 : 0;
+}
+
+// Heap memory a payload owns, none unless overloaded for its type
+template<typename Data>
+size_t PayloadMemory(const Data&) {
+	return 0;
+}
+
+inline size_t PayloadMemory(const std::string& payload) {
+	return StringMemory(payload);
+}
+
+// Bucket array plus one node per entry, a node holds the entry, a next pointer and a cached hash
+template<typename Key, typename Value, typename Hash, typename Equal, typename Allocator>
+size_t HashMapMemory(const std::unordered_map<Key, Value, Hash, Equal, Allocator>& map) {
+	return map.bucket_count() * sizeof(void*) + map.size() * (sizeof(std::pair<const Key, Value>) + 2 * sizeof(void*));
+}
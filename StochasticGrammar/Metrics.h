@@ -0,0 +1,437 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include "CompiledGrammar.h"
+
+#if defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#endif
+
+//*** HDRHISTOGRAM ***
+//
+//
+
+// Log-linear histogram: values below 16 get a bucket each, above that every power of two is
+// split into eight buckets, so any 64 bit value is kept within 12.5% in a fixed 496 buckets.
+class HdrHistogram
+{
+	public:
+		static constexpr unsigned int SubBuckets{ 8 };
+		static constexpr unsigned int BucketCount{ 496 };
+
+		static unsigned int GetIndex(uint64_t value);
+		static uint64_t GetLowerBound(unsigned int index);
+		static uint64_t GetUpperBound(unsigned int index);
+
+		void Record(uint64_t value, uint64_t count = 1);
+		void Add(unsigned int index, uint64_t count) { m_Counts[index] += count; m_Count += count; }
+		void Merge(const HdrHistogram& other);
+
+		uint64_t GetCount() const { return m_Count; }
+		uint64_t GetBucket(unsigned int index) const { return m_Counts[index]; }
+		// Upper bound of the bucket holding the given fraction of all values
+		uint64_t GetPercentile(double fraction) const;
+
+	private:
+		uint64_t m_Counts[BucketCount]{};
+		uint64_t m_Count{ 0 };
+};
+
+inline unsigned int HdrHistogram::GetIndex(uint64_t value) {
+
+	if (value < 2 * SubBuckets) {
+		return static_cast<unsigned int>(value);
+	}
+
+	// Position of the highest set bit, the three bits below it pick the sub bucket
+	unsigned int highest{ 0 };
+	for (unsigned int step{ 32 }; step > 0; step >>= 1) {
+		if (value >> (highest + step)) {
+			highest += step;
+		}
+	}
+	const unsigned int shift{ highest - 3 };
+	return shift * SubBuckets + static_cast<unsigned int>(value >> shift);
+}
+
+inline uint64_t HdrHistogram::GetLowerBound(unsigned int index) {
+
+	if (index < 2 * SubBuckets) {
+		return index;
+	}
+	const unsigned int shift{ index / SubBuckets - 1 };
+	return static_cast<uint64_t>(index % SubBuckets + SubBuckets) << shift;
+}
+
+inline uint64_t HdrHistogram::GetUpperBound(unsigned int index) {
+	return index + 1 < BucketCount ? GetLowerBound(index + 1) - 1 : UINT64_MAX;
+}
+
+inline void HdrHistogram::Record(uint64_t value, uint64_t count) {
+	Add(GetIndex(value), count);
+}
+
+inline void HdrHistogram::Merge(const HdrHistogram& other) {
+
+	for (unsigned int index{ 0 }; index < BucketCount; ++index) {
+		m_Counts[index] += other.m_Counts[index];
+	}
+	m_Count += other.m_Count;
+}
+
+inline uint64_t HdrHistogram::GetPercentile(double fraction) const {
+
+	if (m_Count == 0) {
+		return 0;
+	}
+
+	const uint64_t rank{ std::max<uint64_t>(1, static_cast<uint64_t>(fraction * double(m_Count) + 0.5)) };
+	uint64_t seen{ 0 };
+	for (unsigned int index{ 0 }; index < BucketCount; ++index) {
+		seen += m_Counts[index];
+		if (seen >= rank) {
+			return GetUpperBound(index);
+		}
+	}
+	return GetUpperBound(BucketCount - 1);
+}
+
+//*** METRICSREGISTRY ***
+//
+//
+
+// Everything recorded for one rule, summed over all threads
+struct RuleMetrics {
+	unsigned int rule{ 0 };
+	std::string name;
+	unsigned long long generations{ 0 };
+	unsigned long long symbols{ 0 };
+	unsigned long long fallbacks{ 0 };
+	unsigned long long allocations{ 0 };
+	unsigned long long latencySum{ 0 };		// Nanoseconds
+	HdrHistogram latency{};					// Nanoseconds per generation
+	HdrHistogram length{};					// Symbols per generation
+};
+
+struct MetricsSnapshot {
+	std::vector<RuleMetrics> rules;		// Only rules that were generated, by rule index
+};
+
+// Generation metrics by rule. Every thread records into its own shard with plain relaxed
+// stores, so recording never locks or contends; snapshots sum the shards of all threads.
+// Rules at or above maxRules share one overflow slot, exported with the label "other".
+class MetricsRegistry
+{
+	public:
+		explicit MetricsRegistry(unsigned int maxRules = 4096);
+		virtual ~MetricsRegistry() = default;
+
+		MetricsRegistry(const MetricsRegistry&) = delete;
+		MetricsRegistry(MetricsRegistry&&) = delete;
+		MetricsRegistry& operator=(const MetricsRegistry&) = delete;
+		MetricsRegistry& operator=(MetricsRegistry&&) = delete;
+
+		// Label used in exports, rules without a name are labelled with their index
+		void SetRuleName(RuleId rule, const std::string& name);
+
+		void Record(RuleId rule, std::chrono::nanoseconds latency, size_t length, const GenerationStats& stats);
+
+		// Generates and records the generation in one go
+		template<typename Data, typename Engine>
+		void GenerateSequence(const CompiledGrammar<Data>& grammar, RuleId rule, std::vector<Data>& result, Engine& engine, int maxDepth);
+
+		MetricsSnapshot Snapshot() const;
+		// Prometheus text exposition format
+		std::string ExportPrometheus() const;
+		bool ExportPrometheus(const std::string& path) const;
+
+	private:
+		// Written by the owning thread only, read by snapshots
+		struct RuleSlot {
+			std::atomic<uint64_t> generations{ 0 };
+			std::atomic<uint64_t> symbols{ 0 };
+			std::atomic<uint64_t> fallbacks{ 0 };
+			std::atomic<uint64_t> allocations{ 0 };
+			std::atomic<uint64_t> latencySum{ 0 };
+			std::atomic<uint64_t> latency[HdrHistogram::BucketCount]{};
+			std::atomic<uint64_t> length[HdrHistogram::BucketCount]{};
+		};
+
+		struct ThreadShard {
+			explicit ThreadShard(unsigned int maxRules);
+
+			// Allocated on the first generation of a rule on this thread
+			std::unique_ptr<std::atomic<RuleSlot*>[]> pSlots;
+			std::vector<std::unique_ptr<RuleSlot>> ownedSlots;
+		};
+
+		unsigned long long m_Id;
+		unsigned int m_MaxRules;
+
+		mutable std::mutex m_Mutex;
+		std::vector<std::unique_ptr<ThreadShard>> m_pShards;
+		std::vector<std::string> m_RuleNames;
+
+		ThreadShard& GetShard();
+		RuleSlot& GetSlot(RuleId rule);
+
+		static void Increment(std::atomic<uint64_t>& counter, uint64_t amount);
+		static void WriteHistogram(std::ostream& stream, const std::string& metric, const std::string& label,
+			const HdrHistogram& histogram, unsigned long long sum, double scale);
+		static std::string EscapeLabel(const std::string& value);
+};
+
+inline MetricsRegistry::ThreadShard::ThreadShard(unsigned int maxRules)
+	: pSlots{ new std::atomic<RuleSlot*>[maxRules + 1] }
+{
+	for (unsigned int index{ 0 }; index <= maxRules; ++index) {
+		pSlots[index].store(nullptr, std::memory_order_relaxed);
+	}
+}
+
+inline MetricsRegistry::MetricsRegistry(unsigned int maxRules)
+	: m_MaxRules{ maxRules }
+{
+	// Ids are never reused, so a thread never mistakes a new registry for a destroyed one at the same address
+	static std::atomic<unsigned long long> nextId{ 0 };
+	m_Id = ++nextId;
+}
+
+inline void MetricsRegistry::SetRuleName(RuleId rule, const std::string& name) {
+
+	std::lock_guard<std::mutex> lock{ m_Mutex };
+	if (m_RuleNames.size() <= rule.index) {
+		m_RuleNames.resize(rule.index + 1);
+	}
+	m_RuleNames[rule.index] = name;
+}
+
+inline MetricsRegistry::ThreadShard& MetricsRegistry::GetShard() {
+
+	// Registries this thread recorded into, usually one or two
+	thread_local std::vector<std::pair<unsigned long long, ThreadShard*>> shards{};
+	for (const auto& shard : shards) {
+		if (shard.first == m_Id) {
+			return *shard.second;
+		}
+	}
+
+	// Shards stay with the registry when their thread exits, so nothing recorded is lost
+	std::lock_guard<std::mutex> lock{ m_Mutex };
+	m_pShards.push_back(std::make_unique<ThreadShard>(m_MaxRules));
+	shards.emplace_back(m_Id, m_pShards.back().get());
+	return *m_pShards.back();
+}
+
+inline MetricsRegistry::RuleSlot& MetricsRegistry::GetSlot(RuleId rule) {
+
+	// Metrics never fail a generation, rules past the table go into the overflow slot
+	const unsigned int index{ std::min(rule.index, m_MaxRules) };
+
+	ThreadShard& shard{ GetShard() };
+	RuleSlot* pSlot{ shard.pSlots[index].load(std::memory_order_relaxed) };
+	if (!pSlot) {
+		shard.ownedSlots.push_back(std::make_unique<RuleSlot>());
+		pSlot = shard.ownedSlots.back().get();
+		shard.pSlots[index].store(pSlot, std::memory_order_release);
+	}
+	return *pSlot;
+}
+
+inline void MetricsRegistry::Increment(std::atomic<uint64_t>& counter, uint64_t amount) {
+
+	// Single writer, a load and a store are enough and avoid a locked instruction
+	counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+}
+
+inline void MetricsRegistry::Record(RuleId rule, std::chrono::nanoseconds latency, size_t length, const GenerationStats& stats) {
+
+	RuleSlot& slot{ GetSlot(rule) };
+	const uint64_t nanoseconds{ static_cast<uint64_t>(std::max<long long>(0, latency.count())) };
+
+	Increment(slot.generations, 1);
+	Increment(slot.symbols, length);
+	Increment(slot.fallbacks, stats.fallbacks);
+	Increment(slot.allocations, stats.allocations);
+	Increment(slot.latencySum, nanoseconds);
+	Increment(slot.latency[HdrHistogram::GetIndex(nanoseconds)], 1);
+	Increment(slot.length[HdrHistogram::GetIndex(length)], 1);
+}
+
+template<typename Data, typename Engine>
+void MetricsRegistry::GenerateSequence(const CompiledGrammar<Data>& grammar, RuleId rule, std::vector<Data>& result, Engine& engine, int maxDepth) {
+
+	GenerationStats stats{};
+	const size_t size{ result.size() };
+
+	const auto start{ std::chrono::steady_clock::now() };
+	grammar.GenerateSequence(rule, result, engine, maxDepth, stats);
+	const auto end{ std::chrono::steady_clock::now() };
+
+	Record(rule, std::chrono::duration_cast<std::chrono::nanoseconds>(end - start), result.size() - size, stats);
+}
+
+inline MetricsSnapshot MetricsRegistry::Snapshot() const {
+
+	std::lock_guard<std::mutex> lock{ m_Mutex };
+
+	std::vector<std::unique_ptr<RuleMetrics>> rules(m_MaxRules + 1);
+	for (const std::unique_ptr<ThreadShard>& pShard : m_pShards) {
+		for (unsigned int index{ 0 }; index <= m_MaxRules; ++index) {
+			const RuleSlot* pSlot{ pShard->pSlots[index].load(std::memory_order_acquire) };
+			if (!pSlot) {
+				continue;
+			}
+
+			if (!rules[index]) {
+				rules[index] = std::make_unique<RuleMetrics>();
+				rules[index]->rule = index;
+				if (index == m_MaxRules) {
+					rules[index]->name = "other";
+				}
+				else {
+					rules[index]->name = index < m_RuleNames.size() && !m_RuleNames[index].empty() ? m_RuleNames[index] : std::to_string(index);
+				}
+			}
+
+			RuleMetrics& metrics{ *rules[index] };
+			metrics.generations += pSlot->generations.load(std::memory_order_relaxed);
+			metrics.symbols += pSlot->symbols.load(std::memory_order_relaxed);
+			metrics.fallbacks += pSlot->fallbacks.load(std::memory_order_relaxed);
+			metrics.allocations += pSlot->allocations.load(std::memory_order_relaxed);
+			metrics.latencySum += pSlot->latencySum.load(std::memory_order_relaxed);
+			for (unsigned int bucket{ 0 }; bucket < HdrHistogram::BucketCount; ++bucket) {
+				metrics.latency.Add(bucket, pSlot->latency[bucket].load(std::memory_order_relaxed));
+				metrics.length.Add(bucket, pSlot->length[bucket].load(std::memory_order_relaxed));
+			}
+		}
+	}
+
+	MetricsSnapshot snapshot{};
+	for (std::unique_ptr<RuleMetrics>& pRule : rules) {
+		if (pRule) {
+			snapshot.rules.push_back(std::move(*pRule));
+		}
+	}
+	return snapshot;
+}
+
+inline std::string MetricsRegistry::EscapeLabel(const std::string& value) {
+
+	std::string escaped{};
+	for (char character : value) {
+		switch (character) {
+			case '\\':
+				escaped += "\\\\";
+				break;
+			case '"':
+				escaped += "\\\"";
+				break;
+			case '\n':
+				escaped += "\\n";
+				break;
+			default:
+				escaped += character;
+		}
+	}
+	return escaped;
+}
+
+inline void MetricsRegistry::WriteHistogram(std::ostream& stream, const std::string& metric, const std::string& label,
+	const HdrHistogram& histogram, unsigned long long sum, double scale) {
+
+	// One cumulative bucket per power of two, from the first to the last one holding values
+	unsigned int first{ HdrHistogram::BucketCount };
+	unsigned int last{ 0 };
+	for (unsigned int index{ 0 }; index < HdrHistogram::BucketCount; ++index) {
+		if (histogram.GetBucket(index) > 0) {
+			first = std::min(first, index);
+			last = index;
+		}
+	}
+
+	uint64_t cumulative{ 0 };
+	for (unsigned int index{ 0 }; first <= last && index < HdrHistogram::BucketCount; ++index) {
+		cumulative += histogram.GetBucket(index);
+		const uint64_t upper{ HdrHistogram::GetUpperBound(index) };
+		const bool isPowerBoundary{ ((upper + 1) & upper) == 0 };
+		if (isPowerBoundary && index >= first) {
+			stream << metric << "_bucket{rule=\"" << label << "\",le=\"" << double(upper) * scale << "\"} " << cumulative << "\n";
+		}
+		if (isPowerBoundary && index >= last) {
+			break;
+		}
+	}
+
+	stream << metric << "_bucket{rule=\"" << label << "\",le=\"+Inf\"} " << histogram.GetCount() << "\n";
+	stream << metric << "_sum{rule=\"" << label << "\"} " << double(sum) * scale << "\n";
+	stream << metric << "_count{rule=\"" << label << "\"} " << histogram.GetCount() << "\n";
+}
+
+inline std::string MetricsRegistry::ExportPrometheus() const {
+
+	const MetricsSnapshot snapshot{ Snapshot() };
+	std::ostringstream stream{};
+	stream.precision(9);
+
+	auto writeCounter = [&](const char* metric, const char* help, unsigned long long RuleMetrics::* pValue) {
+		stream << "# HELP " << metric << " " << help << "\n";
+		stream << "# TYPE " << metric << " counter\n";
+		for (const RuleMetrics& rule : snapshot.rules) {
+			stream << metric << "{rule=\"" << EscapeLabel(rule.name) << "\"} " << rule.*pValue << "\n";
+		}
+	};
+
+	writeCounter("grammar_generations_total", "Generations per rule.", &RuleMetrics::generations);
+	writeCounter("grammar_symbols_total", "Symbols generated per rule.", &RuleMetrics::symbols);
+	writeCounter("grammar_lnode_fallbacks_total", "LNodes that reached the depth limit and fell back to their terminal form.", &RuleMetrics::fallbacks);
+	writeCounter("grammar_allocations_total", "Times a generation grew its result storage.", &RuleMetrics::allocations);
+
+	stream << "# HELP grammar_generation_latency_seconds Wall time of a generation.\n";
+	stream << "# TYPE grammar_generation_latency_seconds histogram\n";
+	for (const RuleMetrics& rule : snapshot.rules) {
+		WriteHistogram(stream, "grammar_generation_latency_seconds", EscapeLabel(rule.name), rule.latency, rule.latencySum, 1e-9);
+	}
+
+	stream << "# HELP grammar_output_symbols Symbols per generation.\n";
+	stream << "# TYPE grammar_output_symbols histogram\n";
+	for (const RuleMetrics& rule : snapshot.rules) {
+		WriteHistogram(stream, "grammar_output_symbols", EscapeLabel(rule.name), rule.length, rule.symbols, 1.0);
+	}
+
+	return stream.str();
+}
+
+inline bool MetricsRegistry::ExportPrometheus(const std::string& path) const {
+
+	// Written next to the target and renamed over it, so scrapers never read a partial file
+	const std::string temporary{ path + ".tmp" };
+	{
+		std::ofstream stream{ temporary, std::ios::binary | std::ios::trunc };
+		if (!stream) {
+			return false;
+		}
+		stream << ExportPrometheus();
+		if (!stream) {
+			return false;
+		}
+	}
+
+	// rename replaces the target atomically on POSIX, Windows needs MoveFileEx for that
+#if defined(_WIN32)
+	return MoveFileExA(temporary.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+	return std::rename(temporary.c_str(), path.c_str()) == 0;
+#endif
+}
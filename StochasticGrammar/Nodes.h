@@ -3,11 +3,21 @@
 #include <string>
 #include <random>
 #include <algorithm>
+#include <memory>
+#include <unordered_set>
+#include "Random.h"
+#include "MemoryUsage.h"
 
 // Random float generator
 std::random_device rd;
 std::mt19937 e2(rd());
 
+template<typename Data>
+class GrammarCompiler;
+
+class Rule404Exception {};
+class RuleTypeException {};
+
 //*** NODE ***
 //
 //
@@ -24,12 +34,25 @@ class Node {
 		Node& operator=(Node&&) = delete;
 
 		virtual void Parse(std::vector<Data>& result, int depth) = 0;
-		virtual void SwapDependingNode(Node<Data>* oldNode, Node<Data>* newNode) = 0;
+		virtual bool SwapDependingNode(Node<Data>* oldNode, Node<Data>* newNode) = 0;
+		virtual void Compile(GrammarCompiler<Data>& compiler, unsigned int index) const = 0;
+
+		// Adds this node and the nodes only it keeps alive, skipping nodes counted before
+		void CountMemory(GrammarMemoryUsage& usage, std::unordered_set<const Node<Data>*>& counted) const;
+		virtual void AddMemoryUsage(GrammarMemoryUsage& usage, std::unordered_set<const Node<Data>*>& counted) const = 0;
 };
 
 template<typename Data>
 Node<Data>::Node() {};
 
+template<typename Data>
+void Node<Data>::CountMemory(GrammarMemoryUsage& usage, std::unordered_set<const Node<Data>*>& counted) const {
+
+	if (counted.insert(this).second) {
+		AddMemoryUsage(usage, counted);
+	}
+}
+
 //*** LEAFNODE ***
 //
 //
@@ -47,7 +70,9 @@ class LeafNode : public Node<Data>
 		LeafNode& operator=(LeafNode&&) = delete;
 
 		virtual void Parse(std::vector<Data>& result, int depth) override;
-		virtual void SwapDependingNode(Node<Data>* oldNode, Node<Data>* newNode) override;
+		virtual bool SwapDependingNode(Node<Data>* oldNode, Node<Data>* newNode) override;
+		virtual void Compile(GrammarCompiler<Data>& compiler, unsigned int index) const override;
+		virtual void AddMemoryUsage(GrammarMemoryUsage& usage, std::unordered_set<const Node<Data>*>& counted) const override;
 
 	private:
 		Data m_Value;
@@ -65,8 +90,21 @@ void LeafNode<Data>::Parse(std::vector<Data>& result, int depth) {
 }
 
 template<typename Data>
-void LeafNode<Data>::SwapDependingNode(Node<Data>* oldNode, Node<Data>* newNode) {
+bool LeafNode<Data>::SwapDependingNode(Node<Data>* oldNode, Node<Data>* newNode) {
 	// No node dependencies
+	return false;
+}
+
+template<typename Data>
+void LeafNode<Data>::Compile(GrammarCompiler<Data>& compiler, unsigned int index) const {
+	compiler.SetLeaf(index, m_Value);
+}
+
+template<typename Data>
+void LeafNode<Data>::AddMemoryUsage(GrammarMemoryUsage& usage, std::unordered_set<const Node<Data>*>& /*counted*/) const {
+
+	usage.nodes += sizeof(LeafNode) + SharedBlockOverhead;
+	usage.payloads += PayloadMemory(m_Value);
 }
 
 //*** SELECTNODE ***
@@ -86,8 +124,12 @@ class SelectNode : public Node<Data>
 		SelectNode& operator=(SelectNode&&) = delete;
 
 		virtual void Parse(std::vector<Data>& result, int depth) override;
-		virtual void SwapDependingNode(Node<Data>* oldNode, Node<Data>* newNode) override;
+		virtual bool SwapDependingNode(Node<Data>* oldNode, Node<Data>* newNode) override;
+		virtual void Compile(GrammarCompiler<Data>& compiler, unsigned int index) const override;
+		virtual void AddMemoryUsage(GrammarMemoryUsage& usage, std::unordered_set<const Node<Data>*>& counted) const override;
 		void AddOption(Node<Data>* option, float weight);
+		void SetWeight(int index, float weight);
+		int GetOptionCount() const { return int(m_pOptions.size()); }
 
 	private:
 		std::vector<std::pair<Node<Data>*, float>> m_pOptions;
@@ -109,12 +151,31 @@ void SelectNode<Data>::Parse(std::vector<Data>& result, int depth) {
 }
 
 template<typename Data>
-void SelectNode<Data>::SwapDependingNode(Node<Data>* oldNode, Node<Data>* newNode) {
+bool SelectNode<Data>::SwapDependingNode(Node<Data>* oldNode, Node<Data>* newNode) {
+	bool swapped{ false };
 	for (auto& child : m_pOptions) {
 		if (child.first == oldNode) {
 			child.first = newNode;
+			swapped = true;
 		}
 	}
+	return swapped;
+}
+
+template<typename Data>
+void SelectNode<Data>::Compile(GrammarCompiler<Data>& compiler, unsigned int index) const {
+	std::vector<std::pair<unsigned int, float>> options;
+	for (auto& child : m_pOptions) {
+		options.push_back(std::make_pair(compiler.NodeIndex(child.first), child.second));
+	}
+	compiler.SetSelect(index, options);
+}
+
+template<typename Data>
+void SelectNode<Data>::AddMemoryUsage(GrammarMemoryUsage& usage, std::unordered_set<const Node<Data>*>& /*counted*/) const {
+
+	usage.nodes += sizeof(SelectNode) + SharedBlockOverhead;
+	usage.children += VectorMemory(m_pOptions);
 }
 
 template<typename Data>
@@ -123,10 +184,20 @@ void SelectNode<Data>::AddOption(Node<Data>* option, float weight) {
 	m_WeightsSum += weight;
 }
 
+template<typename Data>
+void SelectNode<Data>::SetWeight(int index, float weight) {
+
+	if (index < 0 || index >= GetOptionCount()) {
+		throw Rule404Exception{};
+	}
+
+	m_WeightsSum += weight - m_pOptions[index].second;
+	m_pOptions[index].second = weight;
+}
+
 template<typename Data>
 int SelectNode<Data>::WeightedRandom() {
-	std::uniform_real_distribution<> dist(0, m_WeightsSum);
-	float randomWeight{ float(dist(e2)) };
+	float randomWeight{ UniformFloat(e2) * m_WeightsSum };
 
 	for (int index{ 0 }; index < m_pOptions.size(); ++index) {
 		randomWeight -= m_pOptions[index].second;
@@ -154,7 +225,9 @@ public:
 	SequenceNode& operator=(SequenceNode&&) = delete;
 
 	virtual void Parse(std::vector<Data>& result, int depth) override;
-	virtual void SwapDependingNode(Node<Data>* oldNode, Node<Data>* newNode) override;
+	virtual bool SwapDependingNode(Node<Data>* oldNode, Node<Data>* newNode) override;
+	virtual void Compile(GrammarCompiler<Data>& compiler, unsigned int index) const override;
+	virtual void AddMemoryUsage(GrammarMemoryUsage& usage, std::unordered_set<const Node<Data>*>& counted) const override;
 	void AddElement(Node<Data>* option);
 
 private:
@@ -173,12 +246,31 @@ void SequenceNode<Data>::Parse(std::vector<Data>& result, int depth) {
 }
 
 template<typename Data>
-void SequenceNode<Data>::SwapDependingNode(Node<Data>* oldNode, Node<Data>* newNode) {
+bool SequenceNode<Data>::SwapDependingNode(Node<Data>* oldNode, Node<Data>* newNode) {
+	bool swapped{ false };
 	for (auto& child : m_pElements) {
 		if (child == oldNode) {
 			child = newNode;
+			swapped = true;
 		}
 	}
+	return swapped;
+}
+
+template<typename Data>
+void SequenceNode<Data>::Compile(GrammarCompiler<Data>& compiler, unsigned int index) const {
+	std::vector<unsigned int> elements;
+	for (auto& child : m_pElements) {
+		elements.push_back(compiler.NodeIndex(child));
+	}
+	compiler.SetSequence(index, elements);
+}
+
+template<typename Data>
+void SequenceNode<Data>::AddMemoryUsage(GrammarMemoryUsage& usage, std::unordered_set<const Node<Data>*>& /*counted*/) const {
+
+	usage.nodes += sizeof(SequenceNode) + SharedBlockOverhead;
+	usage.children += VectorMemory(m_pElements);
 }
 
 template<typename Data>
@@ -203,7 +295,9 @@ public:
 	RepetitionNode& operator=(RepetitionNode&&) = delete;
 
 	virtual void Parse(std::vector<Data>& result, int depth) override;
-	virtual void SwapDependingNode(Node<Data>* oldNode, Node<Data>* newNode) override;
+	virtual bool SwapDependingNode(Node<Data>* oldNode, Node<Data>* newNode) override;
+	virtual void Compile(GrammarCompiler<Data>& compiler, unsigned int index) const override;
+	virtual void AddMemoryUsage(GrammarMemoryUsage& usage, std::unordered_set<const Node<Data>*>& counted) const override;
 
 private:
 	Node<Data>* m_pNode;
@@ -218,19 +312,30 @@ RepetitionNode<Data>::RepetitionNode(Node<Data>* node, float chance)
 
 template<typename Data>
 void RepetitionNode<Data>::Parse(std::vector<Data>& result, int depth) {
-	std::uniform_real_distribution<> dist(0, 1.0f);
-
 	do {
 		m_pNode->Parse(result, depth);
 	} 
-	while (float(dist(e2)) <= m_RepetitionChance);
+	while (UniformFloat(e2) <= m_RepetitionChance);
 }
 
 template<typename Data>
-void RepetitionNode<Data>::SwapDependingNode(Node<Data>* oldNode, Node<Data>* newNode) {
+bool RepetitionNode<Data>::SwapDependingNode(Node<Data>* oldNode, Node<Data>* newNode) {
 	if (m_pNode == oldNode) {
 		m_pNode = newNode;
+		return true;
 	}
+	return false;
+}
+
+template<typename Data>
+void RepetitionNode<Data>::Compile(GrammarCompiler<Data>& compiler, unsigned int index) const {
+	compiler.SetRepetition(index, compiler.NodeIndex(m_pNode), m_RepetitionChance);
+}
+
+template<typename Data>
+void RepetitionNode<Data>::AddMemoryUsage(GrammarMemoryUsage& usage, std::unordered_set<const Node<Data>*>& /*counted*/) const {
+
+	usage.nodes += sizeof(RepetitionNode) + SharedBlockOverhead;
 }
 
 //*** LNODE ***
@@ -249,8 +354,11 @@ public:
 	LNode& operator=(LNode&&) = delete;
 
 	virtual void Parse(std::vector<Data>& result, int depth) override;
-	virtual void SwapDependingNode(Node<Data>* oldNode, Node<Data>* newNode) override;
+	virtual bool SwapDependingNode(Node<Data>* oldNode, Node<Data>* newNode) override;
+	virtual void Compile(GrammarCompiler<Data>& compiler, unsigned int index) const override;
+	virtual void AddMemoryUsage(GrammarMemoryUsage& usage, std::unordered_set<const Node<Data>*>& counted) const override;
 	static void SetDepth(int depth) { MaxDepth = depth; }
+	static int GetDepth() { return MaxDepth; }
 
 private:
 	Node<Data>* m_pNode;
@@ -281,8 +389,23 @@ void LNode<Data>::Parse(std::vector<Data>& result, int depth) {
 }
 
 template<typename Data>
-void LNode<Data>::SwapDependingNode(Node<Data>* oldNode, Node<Data>* newNode) {
+bool LNode<Data>::SwapDependingNode(Node<Data>* oldNode, Node<Data>* newNode) {
 	if (m_pNode == oldNode) {
 		m_pNode = newNode;
+		return true;
 	}
+	return false;
+}
+
+template<typename Data>
+void LNode<Data>::Compile(GrammarCompiler<Data>& compiler, unsigned int index) const {
+	compiler.SetLNode(index, compiler.NodeIndex(m_pNode), compiler.NodeIndex(m_pFallback.get()));
+}
+
+template<typename Data>
+void LNode<Data>::AddMemoryUsage(GrammarMemoryUsage& usage, std::unordered_set<const Node<Data>*>& counted) const {
+
+	usage.nodes += sizeof(LNode) + SharedBlockOverhead;
+	// The fallback may be a node no rule refers to anymore
+	m_pFallback->CountMemory(usage, counted);
 }
\ No newline at end of file
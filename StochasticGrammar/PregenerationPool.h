@@ -0,0 +1,360 @@
+#pragma once
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <unordered_map>
+#include <condition_variable>
+#include "CompiledGrammar.h"
+
+//*** BOUNDEDQUEUE ***
+//
+//
+
+// Lock-free multi producer, multi consumer ring buffer, capacity is rounded up to a power of two
+template<typename T>
+class BoundedQueue
+{
+	public:
+		BoundedQueue(size_t capacity);
+		virtual ~BoundedQueue() = default;
+
+		BoundedQueue(const BoundedQueue&) = delete;
+		BoundedQueue(BoundedQueue&&) = delete;
+		BoundedQueue& operator=(const BoundedQueue&) = delete;
+		BoundedQueue& operator=(BoundedQueue&&) = delete;
+
+		bool TryPush(T& value);
+		bool TryPop(T& value);
+
+		size_t GetCapacity() const { return m_Cells.size(); }
+		size_t GetSize() const;
+
+	private:
+		struct Cell {
+			std::atomic<size_t> sequence;
+			T value;
+		};
+
+		std::vector<Cell> m_Cells;
+		size_t m_Mask;
+
+		static size_t RoundUpToPowerOfTwo(size_t capacity);
+
+		// Kept on separate cache lines so producers and consumers do not contend
+		alignas(64) std::atomic<size_t> m_Tail{ 0 };
+		alignas(64) std::atomic<size_t> m_Head{ 0 };
+};
+
+template<typename T>
+BoundedQueue<T>::BoundedQueue(size_t capacity)
+	: m_Cells(RoundUpToPowerOfTwo(capacity))
+	, m_Mask{ m_Cells.size() - 1 }
+{
+	for (size_t index{ 0 }; index < m_Cells.size(); ++index) {
+		m_Cells[index].sequence.store(index, std::memory_order_relaxed);
+	}
+}
+
+template<typename T>
+size_t BoundedQueue<T>::RoundUpToPowerOfTwo(size_t capacity) {
+
+	size_t size{ 2 };
+	while (size < capacity) {
+		size <<= 1;
+	}
+	return size;
+}
+
+template<typename T>
+bool BoundedQueue<T>::TryPush(T& value) {
+
+	size_t position{ m_Tail.load(std::memory_order_relaxed) };
+	while (true) {
+		Cell& cell{ m_Cells[position & m_Mask] };
+		const size_t sequence{ cell.sequence.load(std::memory_order_acquire) };
+
+		if (sequence == position) {
+			if (m_Tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+				cell.value = std::move(value);
+				cell.sequence.store(position + 1, std::memory_order_release);
+				return true;
+			}
+		}
+		else if (sequence < position) {
+			return false;
+		}
+		else {
+			position = m_Tail.load(std::memory_order_relaxed);
+		}
+	}
+}
+
+template<typename T>
+bool BoundedQueue<T>::TryPop(T& value) {
+
+	size_t position{ m_Head.load(std::memory_order_relaxed) };
+	while (true) {
+		Cell& cell{ m_Cells[position & m_Mask] };
+		const size_t sequence{ cell.sequence.load(std::memory_order_acquire) };
+
+		if (sequence == position + 1) {
+			if (m_Head.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+				value = std::move(cell.value);
+				cell.sequence.store(position + m_Mask + 1, std::memory_order_release);
+				return true;
+			}
+		}
+		else if (sequence < position + 1) {
+			return false;
+		}
+		else {
+			position = m_Head.load(std::memory_order_relaxed);
+		}
+	}
+}
+
+template<typename T>
+size_t BoundedQueue<T>::GetSize() const {
+
+	const size_t tail{ m_Tail.load(std::memory_order_relaxed) };
+	const size_t head{ m_Head.load(std::memory_order_relaxed) };
+	return tail > head ? tail - head : 0;
+}
+
+//*** PREGENERATIONPOOL ***
+//
+//
+
+struct PoolMetrics {
+	unsigned long long hits;
+	unsigned long long misses;
+	unsigned long long generated;
+	size_t ready;
+	size_t target;
+	float popsPerSecond;
+
+	float GetHitRate() const { return hits + misses == 0 ? 0.f : float(hits) / float(hits + misses); }
+};
+
+// Keeps finished generations of a few rules ready, so consumers never wait on generation
+template<typename Data>
+class PregenerationPool
+{
+	public:
+		// The target of every rule follows its consumption rate, enough to cover the refill horizon
+		PregenerationPool(std::shared_ptr<const CompiledGrammar<Data>> pGrammar, const std::vector<RuleId>& rules,
+			unsigned int threadCount = 1, size_t capacity = 1024, size_t minTarget = 16, std::chrono::milliseconds horizon = std::chrono::milliseconds{ 250 });
+		virtual ~PregenerationPool();
+
+		PregenerationPool(const PregenerationPool&) = delete;
+		PregenerationPool(PregenerationPool&&) = delete;
+		PregenerationPool& operator=(const PregenerationPool&) = delete;
+		PregenerationPool& operator=(PregenerationPool&&) = delete;
+
+		// Constant time, returns false when the pool ran dry
+		bool TryPop(RuleId rule, std::vector<Data>& result);
+		// Falls back to generating on the calling thread when the pool ran dry
+		std::vector<Data> Pop(RuleId rule);
+
+		PoolMetrics GetMetrics(RuleId rule) const;
+
+	private:
+		struct RulePool {
+			RulePool(RuleId rule, size_t capacity, size_t minTarget);
+
+			RuleId rule;
+			BoundedQueue<std::vector<Data>> ready;
+			std::atomic<size_t> target;
+			std::atomic<unsigned long long> hits{ 0 };
+			std::atomic<unsigned long long> misses{ 0 };
+			std::atomic<unsigned long long> generated{ 0 };
+			std::atomic<float> popsPerSecond{ 0.f };
+
+			// Owned by whichever worker refills the pool
+			std::atomic_flag isRefilling = ATOMIC_FLAG_INIT;
+			unsigned long long lastPops{ 0 };
+			std::chrono::steady_clock::time_point lastSample;
+		};
+
+		std::shared_ptr<const CompiledGrammar<Data>> m_pGrammar;
+		std::vector<std::unique_ptr<RulePool>> m_Pools;
+		std::unordered_map<unsigned int, RulePool*> m_PoolsByRule;
+		size_t m_MinTarget;
+		std::chrono::milliseconds m_Horizon;
+
+		std::vector<std::thread> m_Workers;
+		std::mutex m_Mutex;
+		std::condition_variable m_Condition;
+		std::atomic<bool> m_IsStopping{ false };
+
+		RulePool& GetPool(RuleId rule) const;
+		void Work();
+		bool Refill(RulePool& pool, BlockEngine& engine);
+		void UpdateTarget(RulePool& pool);
+};
+
+template<typename Data>
+PregenerationPool<Data>::RulePool::RulePool(RuleId rule, size_t capacity, size_t minTarget)
+	: rule{ rule }
+	, ready{ capacity }
+	, target{ std::min(minTarget, ready.GetCapacity()) }
+	, lastSample{ std::chrono::steady_clock::now() }
+{}
+
+template<typename Data>
+PregenerationPool<Data>::PregenerationPool(std::shared_ptr<const CompiledGrammar<Data>> pGrammar, const std::vector<RuleId>& rules,
+	unsigned int threadCount, size_t capacity, size_t minTarget, std::chrono::milliseconds horizon)
+	: m_pGrammar{ pGrammar }
+	, m_MinTarget{ minTarget }
+	, m_Horizon{ horizon }
+{
+	for (RuleId rule : rules) {
+		if (m_PoolsByRule.count(rule.index) == 0) {
+			m_Pools.push_back(std::make_unique<RulePool>(rule, capacity, minTarget));
+			m_PoolsByRule[rule.index] = m_Pools.back().get();
+		}
+	}
+
+	for (unsigned int index{ 0 }; index < std::max(threadCount, 1u); ++index) {
+		m_Workers.emplace_back(&PregenerationPool::Work, this);
+	}
+}
+
+template<typename Data>
+PregenerationPool<Data>::~PregenerationPool() {
+
+	{
+		std::lock_guard<std::mutex> lock{ m_Mutex };
+		m_IsStopping = true;
+	}
+	m_Condition.notify_all();
+
+	for (std::thread& worker : m_Workers) {
+		worker.join();
+	}
+}
+
+template<typename Data>
+typename PregenerationPool<Data>::RulePool& PregenerationPool<Data>::GetPool(RuleId rule) const {
+
+	auto it{ m_PoolsByRule.find(rule.index) };
+	if (it == m_PoolsByRule.end()) {
+		throw Rule404Exception{};
+	}
+	return *it->second;
+}
+
+template<typename Data>
+bool PregenerationPool<Data>::TryPop(RuleId rule, std::vector<Data>& result) {
+
+	RulePool& pool{ GetPool(rule) };
+	if (!pool.ready.TryPop(result)) {
+		pool.misses.fetch_add(1, std::memory_order_relaxed);
+		m_Condition.notify_one();
+		return false;
+	}
+
+	pool.hits.fetch_add(1, std::memory_order_relaxed);
+	if (pool.ready.GetSize() < pool.target.load(std::memory_order_relaxed) / 2) {
+		m_Condition.notify_one();
+	}
+	return true;
+}
+
+template<typename Data>
+std::vector<Data> PregenerationPool<Data>::Pop(RuleId rule) {
+
+	std::vector<Data> result{};
+	if (!TryPop(rule, result)) {
+		result = m_pGrammar->GenerateSequence(rule);
+	}
+	return result;
+}
+
+template<typename Data>
+PoolMetrics PregenerationPool<Data>::GetMetrics(RuleId rule) const {
+
+	const RulePool& pool{ GetPool(rule) };
+	return PoolMetrics{
+		pool.hits.load(std::memory_order_relaxed),
+		pool.misses.load(std::memory_order_relaxed),
+		pool.generated.load(std::memory_order_relaxed),
+		pool.ready.GetSize(),
+		pool.target.load(std::memory_order_relaxed),
+		pool.popsPerSecond.load(std::memory_order_relaxed)
+	};
+}
+
+template<typename Data>
+void PregenerationPool<Data>::Work() {
+
+	BlockEngine engine{ RandomDeviceSeed() };
+	while (!m_IsStopping) {
+
+		bool isWorkDone{ false };
+		for (std::unique_ptr<RulePool>& pPool : m_Pools) {
+			isWorkDone |= Refill(*pPool, engine);
+		}
+
+		// Sleep until a consumer drains a pool, or re-sample the rates every now and then
+		if (!isWorkDone) {
+			std::unique_lock<std::mutex> lock{ m_Mutex };
+			m_Condition.wait_for(lock, std::chrono::milliseconds{ 10 });
+		}
+	}
+}
+
+template<typename Data>
+bool PregenerationPool<Data>::Refill(RulePool& pool, BlockEngine& engine) {
+
+	// One worker per pool at a time, others move on to the next rule
+	if (pool.isRefilling.test_and_set(std::memory_order_acquire)) {
+		return false;
+	}
+
+	UpdateTarget(pool);
+
+	// Refill in small chunks so one busy rule does not starve the others
+	const size_t target{ pool.target.load(std::memory_order_relaxed) };
+	const size_t ready{ pool.ready.GetSize() };
+	const size_t chunk{ target > ready ? std::min(target - ready, size_t(32)) : 0 };
+
+	for (size_t index{ 0 }; index < chunk && !m_IsStopping; ++index) {
+		std::vector<Data> result{};
+		m_pGrammar->GenerateSequence(pool.rule, result, engine);
+		if (!pool.ready.TryPush(result)) {
+			break;
+		}
+		pool.generated.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	pool.isRefilling.clear(std::memory_order_release);
+	return chunk > 0;
+}
+
+template<typename Data>
+void PregenerationPool<Data>::UpdateTarget(RulePool& pool) {
+
+	const auto now{ std::chrono::steady_clock::now() };
+	const float seconds{ std::chrono::duration<float>(now - pool.lastSample).count() };
+	if (seconds < 0.05f) {
+		return;
+	}
+
+	// Smooth the consumption rate, then keep enough ready to cover the horizon
+	const unsigned long long pops{ pool.hits.load(std::memory_order_relaxed) + pool.misses.load(std::memory_order_relaxed) };
+	const float rate{ float(pops - pool.lastPops) / seconds };
+	const float smoothed{ 0.7f * pool.popsPerSecond.load(std::memory_order_relaxed) + 0.3f * rate };
+	pool.popsPerSecond.store(smoothed, std::memory_order_relaxed);
+	pool.lastPops = pops;
+	pool.lastSample = now;
+
+	const float horizon{ std::chrono::duration<float>(m_Horizon).count() };
+	const size_t target{ std::max(m_MinTarget, size_t(smoothed * horizon) + 1) };
+	pool.target.store(std::min(target, pool.ready.GetCapacity()), std::memory_order_relaxed);
+}
@@ -0,0 +1,212 @@
+#pragma once
+#include <list>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <unordered_map>
+#include "CompiledGrammar.h"
+
+//*** RESULTCACHE ***
+//
+//
+
+// A seeded generation is fully determined by the grammar snapshot, rule, seed and depth
+struct ResultKey {
+	unsigned long long version;
+	unsigned long long seed;
+	unsigned int rule;
+	int maxDepth;
+
+	bool operator==(const ResultKey& other) const {
+		return version == other.version && seed == other.seed && rule == other.rule && maxDepth == other.maxDepth;
+	}
+};
+
+struct ResultKeyHash {
+	size_t operator()(const ResultKey& key) const {
+		unsigned long long hash{ Mix(key.version) };
+		hash = Mix(hash ^ key.seed);
+		hash = Mix(hash ^ (static_cast<unsigned long long>(key.rule) << 32 | static_cast<unsigned int>(key.maxDepth)));
+		return static_cast<size_t>(hash);
+	}
+
+	// SplitMix64 finalizer, every input bit affects every output bit
+	static unsigned long long Mix(unsigned long long value) {
+		value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ull;
+		value = (value ^ (value >> 27)) * 0x94D049BB133111EBull;
+		return value ^ (value >> 31);
+	}
+};
+
+struct CacheMetrics {
+	unsigned long long hits;
+	unsigned long long misses;
+	unsigned long long evictions;
+	size_t entries;
+	size_t bytes;
+
+	float GetHitRate() const { return hits + misses == 0 ? 0.f : float(hits) / float(hits + misses); }
+};
+
+// Sharded LRU cache of seeded generations in symbol form, bounded by an approximate byte budget
+class ResultCache
+{
+	public:
+		ResultCache(size_t byteBudget, unsigned int shardCount = 16);
+		virtual ~ResultCache() = default;
+
+		ResultCache(const ResultCache&) = delete;
+		ResultCache(ResultCache&&) = delete;
+		ResultCache& operator=(const ResultCache&) = delete;
+		ResultCache& operator=(ResultCache&&) = delete;
+
+		bool Find(const ResultKey& key, std::vector<unsigned int>& symbols);
+		void Insert(const ResultKey& key, const std::vector<unsigned int>& symbols);
+		void Clear();
+
+		// Same engine and seeding as CompiledGrammar::GenerateBatch, so cached and batched results agree
+		template<typename Data>
+		void GenerateSymbols(const CompiledGrammar<Data>& grammar, RuleId rule, unsigned long long seed, int maxDepth, std::vector<unsigned int>& symbols);
+		template<typename Data>
+		std::vector<Data> GenerateSequence(const CompiledGrammar<Data>& grammar, RuleId rule, unsigned long long seed, int maxDepth);
+
+		CacheMetrics GetMetrics() const;
+
+	private:
+		using Entry = std::pair<ResultKey, std::vector<unsigned int>>;
+
+		struct Shard {
+			mutable std::mutex mutex;
+			std::list<Entry> entries;		// Most recently used first
+			std::unordered_map<ResultKey, std::list<Entry>::iterator, ResultKeyHash> index;
+			size_t bytes{ 0 };
+			unsigned long long hits{ 0 };
+			unsigned long long misses{ 0 };
+			unsigned long long evictions{ 0 };
+		};
+
+		std::vector<std::unique_ptr<Shard>> m_pShards;
+		size_t m_ShardBudget;
+
+		Shard& GetShard(const ResultKey& key) const;
+		static size_t GetEntrySize(const std::vector<unsigned int>& symbols);
+};
+
+inline ResultCache::ResultCache(size_t byteBudget, unsigned int shardCount)
+	: m_ShardBudget{ byteBudget / std::max(shardCount, 1u) }
+{
+	for (unsigned int index{ 0 }; index < std::max(shardCount, 1u); ++index) {
+		m_pShards.push_back(std::make_unique<Shard>());
+	}
+}
+
+inline ResultCache::Shard& ResultCache::GetShard(const ResultKey& key) const {
+
+	// The upper bits pick the shard, the map inside buckets on the lower ones
+	const unsigned long long hash{ ResultKeyHash{}(key) };
+	return *m_pShards[(hash >> 40) % m_pShards.size()];
+}
+
+inline size_t ResultCache::GetEntrySize(const std::vector<unsigned int>& symbols) {
+
+	// List node, map node and bucket overhead are estimated as a fixed cost per entry
+	return symbols.size() * sizeof(unsigned int) + sizeof(Entry) + 64;
+}
+
+inline bool ResultCache::Find(const ResultKey& key, std::vector<unsigned int>& symbols) {
+
+	Shard& shard{ GetShard(key) };
+	std::lock_guard<std::mutex> lock{ shard.mutex };
+
+	auto it{ shard.index.find(key) };
+	if (it == shard.index.end()) {
+		++shard.misses;
+		return false;
+	}
+
+	++shard.hits;
+	shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+	symbols.assign(it->second->second.begin(), it->second->second.end());
+	return true;
+}
+
+inline void ResultCache::Insert(const ResultKey& key, const std::vector<unsigned int>& symbols) {
+
+	const size_t size{ GetEntrySize(symbols) };
+	if (size > m_ShardBudget) {
+		return;
+	}
+
+	Shard& shard{ GetShard(key) };
+	std::lock_guard<std::mutex> lock{ shard.mutex };
+
+	// Another thread may have generated the same key in the meantime
+	if (shard.index.find(key) != shard.index.end()) {
+		return;
+	}
+
+	shard.entries.emplace_front(key, symbols);
+	shard.index[key] = shard.entries.begin();
+	shard.bytes += size;
+
+	while (shard.bytes > m_ShardBudget) {
+		const Entry& last{ shard.entries.back() };
+		shard.bytes -= GetEntrySize(last.second);
+		shard.index.erase(last.first);
+		shard.entries.pop_back();
+		++shard.evictions;
+	}
+}
+
+inline void ResultCache::Clear() {
+
+	for (std::unique_ptr<Shard>& pShard : m_pShards) {
+		std::lock_guard<std::mutex> lock{ pShard->mutex };
+		pShard->entries.clear();
+		pShard->index.clear();
+		pShard->bytes = 0;
+	}
+}
+
+template<typename Data>
+void ResultCache::GenerateSymbols(const CompiledGrammar<Data>& grammar, RuleId rule, unsigned long long seed, int maxDepth, std::vector<unsigned int>& symbols) {
+
+	const ResultKey key{ grammar.GetVersion(), seed, rule.index, maxDepth };
+	if (Find(key, symbols)) {
+		return;
+	}
+
+	symbols.clear();
+	Xoshiro128 engine{ seed };
+	grammar.GenerateSymbols(rule, symbols, engine, maxDepth);
+	Insert(key, symbols);
+}
+
+template<typename Data>
+std::vector<Data> ResultCache::GenerateSequence(const CompiledGrammar<Data>& grammar, RuleId rule, unsigned long long seed, int maxDepth) {
+
+	std::vector<unsigned int> symbols{};
+	GenerateSymbols(grammar, rule, seed, maxDepth, symbols);
+
+	std::vector<Data> result{};
+	result.reserve(symbols.size());
+	for (unsigned int symbol : symbols) {
+		result.push_back(grammar.GetSymbol(symbol));
+	}
+	return result;
+}
+
+inline CacheMetrics ResultCache::GetMetrics() const {
+
+	CacheMetrics metrics{};
+	for (const std::unique_ptr<Shard>& pShard : m_pShards) {
+		std::lock_guard<std::mutex> lock{ pShard->mutex };
+		metrics.hits += pShard->hits;
+		metrics.misses += pShard->misses;
+		metrics.evictions += pShard->evictions;
+		metrics.entries += pShard->entries.size();
+		metrics.bytes += pShard->bytes;
+	}
+	return metrics;
+}
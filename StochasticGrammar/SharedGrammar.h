@@ -0,0 +1,438 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <cstring>
+#include <algorithm>
+#include "CompiledGrammar.h"
+
+#if defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#define SHARED_GRAMMAR_MAGIC 0x53474d31 // "SGM1"
+
+class SharedMemoryException {};
+
+// Layout of a compiled grammar in shared memory, every table is an offset from the start
+struct SharedGrammarHeader {
+	unsigned int magic;
+	unsigned int nodeSize;
+	unsigned long long size;
+	int maxDepth;
+	unsigned int ruleCount;
+	unsigned int nameCount;
+	unsigned int nodeCount;
+	unsigned int childCount;
+	unsigned int symbolCount;
+	unsigned long long roots;
+	unsigned long long nodes;
+	unsigned long long children;
+	unsigned long long weights;
+	unsigned long long heights;
+	unsigned long long expectedSizes;
+	unsigned long long names;
+	unsigned long long symbols;
+	unsigned long long text;
+};
+
+// Names are sorted, so attached processes can resolve rules with a binary search
+struct SharedName {
+	unsigned int offset;
+	unsigned int length;
+	unsigned int rule;
+};
+
+struct SharedSymbol {
+	unsigned int offset;
+	unsigned int length;
+};
+
+//*** SHAREDGRAMMAR ***
+//
+//
+
+// Compiled string grammar placed in a named shared memory segment.
+// One process creates it, worker processes attach read-only and generate
+// straight from the mapped tables without building a node graph of their own.
+class SharedGrammar
+{
+	public:
+		static std::shared_ptr<SharedGrammar> Create(const std::string& name, const CompiledGrammar<std::string>& compiled);
+		static std::shared_ptr<SharedGrammar> Attach(const std::string& name);
+		virtual ~SharedGrammar();
+
+		SharedGrammar(const SharedGrammar&) = delete;
+		SharedGrammar(SharedGrammar&&) = delete;
+		SharedGrammar& operator=(const SharedGrammar&) = delete;
+		SharedGrammar& operator=(SharedGrammar&&) = delete;
+
+		RuleId Resolve(const std::string& name) const;
+		int GetDepth() const { return m_pHeader->maxDepth; }
+		size_t GetSize() const { return m_Size; }
+
+		std::string GetSymbol(unsigned int symbol) const;
+		size_t GetSymbolCount() const { return m_pHeader->symbolCount; }
+
+		template<typename Engine>
+		void GenerateSymbols(RuleId rule, std::vector<unsigned int>& symbols, Engine& engine) const;
+		template<typename Engine>
+		void GenerateSymbols(RuleId rule, std::vector<unsigned int>& symbols, Engine& engine, int maxDepth) const;
+		template<typename Engine>
+		void GenerateSequence(RuleId rule, std::vector<std::string>& result, Engine& engine) const;
+
+	private:
+		SharedGrammar(const std::string& name, bool owner);
+
+		std::string m_Name;
+		bool m_Owner;
+		void* m_pMemory{ nullptr };
+		size_t m_Size{ 0 };
+		const SharedGrammarHeader* m_pHeader{ nullptr };
+		CompiledTables m_Tables{};
+#if defined(_WIN32)
+		HANDLE m_hMapping{ nullptr };
+#else
+		// Identity of the mapped segment, the name may be taken over by a newer one
+		dev_t m_Device{ 0 };
+		ino_t m_Inode{ 0 };
+#endif
+
+		void Map(size_t size, bool writable);
+#if !defined(_WIN32)
+		bool IsNameOwner() const;
+#endif
+		void Validate();
+		bool Fits(unsigned long long offset, unsigned long long count, size_t elementSize) const;
+
+		template<typename T>
+		const T* At(unsigned long long offset) const { return reinterpret_cast<const T*>(static_cast<const char*>(m_pMemory) + offset); }
+		static unsigned long long Align(unsigned long long offset) { return (offset + 7) & ~7ull; }
+};
+
+inline SharedGrammar::SharedGrammar(const std::string& name, bool owner)
+#if defined(_WIN32)
+	: m_Name{ name }
+#else
+	: m_Name{ name[0] == '/' ? name : "/" + name }
+#endif
+	, m_Owner{ owner }
+{}
+
+inline SharedGrammar::~SharedGrammar() {
+#if defined(_WIN32)
+	if (m_pMemory) {
+		UnmapViewOfFile(m_pMemory);
+	}
+	if (m_hMapping) {
+		CloseHandle(m_hMapping);
+	}
+#else
+	if (m_pMemory) {
+		munmap(m_pMemory, m_Size);
+	}
+	if (m_Owner && IsNameOwner()) {
+		shm_unlink(m_Name.c_str());
+	}
+#endif
+}
+
+inline std::shared_ptr<SharedGrammar> SharedGrammar::Create(const std::string& name, const CompiledGrammar<std::string>& compiled) {
+
+	std::vector<std::pair<std::string, RuleId>> names(compiled.m_RuleIds.begin(), compiled.m_RuleIds.end());
+	std::sort(names.begin(), names.end(), [](const std::pair<std::string, RuleId>& a, const std::pair<std::string, RuleId>& b) {
+		return a.first < b.first;
+	});
+
+	// Lay out the tables
+	SharedGrammarHeader header{};
+	header.magic = SHARED_GRAMMAR_MAGIC;
+	header.nodeSize = sizeof(CompiledNode);
+	header.maxDepth = compiled.m_MaxDepth;
+	header.ruleCount = static_cast<unsigned int>(compiled.m_Roots.size());
+	header.nameCount = static_cast<unsigned int>(names.size());
+	header.nodeCount = static_cast<unsigned int>(compiled.m_Nodes.size());
+	header.childCount = static_cast<unsigned int>(compiled.m_Children.size());
+	header.symbolCount = static_cast<unsigned int>(compiled.m_Payloads.size());
+
+	header.roots = Align(sizeof(SharedGrammarHeader));
+	header.nodes = Align(header.roots + header.ruleCount * sizeof(unsigned int));
+	header.children = Align(header.nodes + header.nodeCount * sizeof(CompiledNode));
+	header.weights = Align(header.children + header.childCount * sizeof(unsigned int));
+	header.heights = Align(header.weights + header.childCount * sizeof(float));
+	header.expectedSizes = Align(header.heights + header.nodeCount * sizeof(unsigned int));
+	header.names = Align(header.expectedSizes + header.nodeCount * sizeof(float));
+	header.symbols = Align(header.names + header.nameCount * sizeof(SharedName));
+	header.text = Align(header.symbols + header.symbolCount * sizeof(SharedSymbol));
+
+	unsigned long long textSize{ 0 };
+	for (auto& rule : names) {
+		textSize += rule.first.size();
+	}
+	for (auto& payload : compiled.m_Payloads) {
+		textSize += payload.size();
+	}
+	header.size = header.text + textSize;
+
+	std::shared_ptr<SharedGrammar> shared{ new SharedGrammar(name, true) };
+	shared->Map(size_t(header.size), true);
+
+	// Fill the tables, the magic is written last so attaching processes never see a half written grammar
+	char* pMemory{ static_cast<char*>(shared->m_pMemory) };
+	header.magic = 0;
+	std::memcpy(pMemory, &header, sizeof(SharedGrammarHeader));
+	std::memcpy(pMemory + header.roots, compiled.m_Roots.data(), header.ruleCount * sizeof(unsigned int));
+	std::memcpy(pMemory + header.nodes, compiled.m_Nodes.data(), header.nodeCount * sizeof(CompiledNode));
+	std::memcpy(pMemory + header.children, compiled.m_Children.data(), header.childCount * sizeof(unsigned int));
+	std::memcpy(pMemory + header.weights, compiled.m_Weights.data(), header.childCount * sizeof(float));
+	std::memcpy(pMemory + header.heights, compiled.m_Heights.data(), header.nodeCount * sizeof(unsigned int));
+	std::memcpy(pMemory + header.expectedSizes, compiled.m_ExpectedSizes.data(), header.nodeCount * sizeof(float));
+
+	unsigned long long textOffset{ 0 };
+	SharedName* pNames{ reinterpret_cast<SharedName*>(pMemory + header.names) };
+	for (auto& rule : names) {
+		*pNames++ = SharedName{ static_cast<unsigned int>(textOffset), static_cast<unsigned int>(rule.first.size()), rule.second.index };
+		std::memcpy(pMemory + header.text + textOffset, rule.first.data(), rule.first.size());
+		textOffset += rule.first.size();
+	}
+
+	SharedSymbol* pSymbols{ reinterpret_cast<SharedSymbol*>(pMemory + header.symbols) };
+	for (auto& payload : compiled.m_Payloads) {
+		*pSymbols++ = SharedSymbol{ static_cast<unsigned int>(textOffset), static_cast<unsigned int>(payload.size()) };
+		std::memcpy(pMemory + header.text + textOffset, payload.data(), payload.size());
+		textOffset += payload.size();
+	}
+
+	std::atomic_thread_fence(std::memory_order_release);
+	reinterpret_cast<volatile SharedGrammarHeader*>(pMemory)->magic = SHARED_GRAMMAR_MAGIC;
+
+	shared->Validate();
+	return shared;
+}
+
+inline std::shared_ptr<SharedGrammar> SharedGrammar::Attach(const std::string& name) {
+
+	std::shared_ptr<SharedGrammar> shared{ new SharedGrammar(name, false) };
+	shared->Map(0, false);
+	shared->Validate();
+	return shared;
+}
+
+inline void SharedGrammar::Map(size_t size, bool writable) {
+#if defined(_WIN32)
+	if (writable) {
+		m_hMapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, DWORD(size >> 32), DWORD(size & 0xFFFFFFFF), m_Name.c_str());
+	}
+	else {
+		m_hMapping = OpenFileMappingA(FILE_MAP_READ, FALSE, m_Name.c_str());
+	}
+	if (!m_hMapping) {
+		throw SharedMemoryException{};
+	}
+	// Writing into a mapping other processes still use would change it under them
+	if (writable && GetLastError() == ERROR_ALREADY_EXISTS) {
+		CloseHandle(m_hMapping);
+		m_hMapping = nullptr;
+		throw SharedMemoryException{};
+	}
+
+	m_pMemory = MapViewOfFile(m_hMapping, writable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, size);
+	if (!m_pMemory) {
+		throw SharedMemoryException{};
+	}
+
+	MEMORY_BASIC_INFORMATION info{};
+	VirtualQuery(m_pMemory, &info, sizeof(info));
+	m_Size = writable ? size : size_t(info.RegionSize);
+#else
+	// Processes attached to an older grammar of the same name keep their unlinked copy
+	if (writable) {
+		shm_unlink(m_Name.c_str());
+	}
+	int file{ shm_open(m_Name.c_str(), writable ? (O_CREAT | O_EXCL | O_RDWR) : O_RDONLY, 0644) };
+	if (file < 0) {
+		throw SharedMemoryException{};
+	}
+
+	if (writable && ftruncate(file, off_t(size)) != 0) {
+		close(file);
+		throw SharedMemoryException{};
+	}
+	struct stat info {};
+	if (fstat(file, &info) != 0) {
+		close(file);
+		throw SharedMemoryException{};
+	}
+	if (!writable) {
+		size = size_t(info.st_size);
+	}
+	m_Device = info.st_dev;
+	m_Inode = info.st_ino;
+
+	void* pMemory{ mmap(nullptr, size, writable ? (PROT_READ | PROT_WRITE) : PROT_READ, MAP_SHARED, file, 0) };
+	close(file);
+	if (pMemory == MAP_FAILED) {
+		throw SharedMemoryException{};
+	}
+
+	m_pMemory = pMemory;
+	m_Size = size;
+#endif
+}
+
+#if !defined(_WIN32)
+inline bool SharedGrammar::IsNameOwner() const {
+
+	// A newer Create unlinks this segment and reuses the name, that segment isn't ours to remove
+	int file{ shm_open(m_Name.c_str(), O_RDONLY, 0) };
+	if (file < 0) {
+		return false;
+	}
+
+	struct stat info {};
+	const bool isSame{ fstat(file, &info) == 0 && info.st_dev == m_Device && info.st_ino == m_Inode };
+	close(file);
+	return isSame;
+}
+#endif
+
+inline void SharedGrammar::Validate() {
+
+	m_pHeader = At<SharedGrammarHeader>(0);
+	if (m_Size < sizeof(SharedGrammarHeader) || reinterpret_cast<const volatile SharedGrammarHeader*>(m_pHeader)->magic != SHARED_GRAMMAR_MAGIC) {
+		throw SharedMemoryException{};
+	}
+	std::atomic_thread_fence(std::memory_order_acquire);
+
+	// Every table and every index in them has to stay inside the mapping
+	const SharedGrammarHeader& header{ *m_pHeader };
+	if (header.nodeSize != sizeof(CompiledNode) || header.size > m_Size
+		|| !Fits(header.roots, header.ruleCount, sizeof(unsigned int))
+		|| !Fits(header.nodes, header.nodeCount, sizeof(CompiledNode))
+		|| !Fits(header.children, header.childCount, sizeof(unsigned int))
+		|| !Fits(header.weights, header.childCount, sizeof(float))
+		|| !Fits(header.heights, header.nodeCount, sizeof(unsigned int))
+		|| !Fits(header.expectedSizes, header.nodeCount, sizeof(float))
+		|| !Fits(header.names, header.nameCount, sizeof(SharedName))
+		|| !Fits(header.symbols, header.symbolCount, sizeof(SharedSymbol))
+		|| !Fits(header.text, 0, 1)) {
+		throw SharedMemoryException{};
+	}
+
+	const unsigned long long textSize{ header.size - header.text };
+	const SharedName* pNames{ At<SharedName>(header.names) };
+	for (unsigned int index{ 0 }; index < header.nameCount; ++index) {
+		if (pNames[index].rule >= header.ruleCount || pNames[index].offset + static_cast<unsigned long long>(pNames[index].length) > textSize) {
+			throw SharedMemoryException{};
+		}
+	}
+	const SharedSymbol* pSymbols{ At<SharedSymbol>(header.symbols) };
+	for (unsigned int index{ 0 }; index < header.symbolCount; ++index) {
+		if (pSymbols[index].offset + static_cast<unsigned long long>(pSymbols[index].length) > textSize) {
+			throw SharedMemoryException{};
+		}
+	}
+	const unsigned int* pRoots{ At<unsigned int>(header.roots) };
+	for (unsigned int index{ 0 }; index < header.ruleCount; ++index) {
+		if (pRoots[index] >= header.nodeCount) {
+			throw SharedMemoryException{};
+		}
+	}
+	const unsigned int* pChildren{ At<unsigned int>(header.children) };
+	for (unsigned int index{ 0 }; index < header.childCount; ++index) {
+		if (pChildren[index] >= header.nodeCount) {
+			throw SharedMemoryException{};
+		}
+	}
+	const CompiledNode* pNodes{ At<CompiledNode>(header.nodes) };
+	for (unsigned int index{ 0 }; index < header.nodeCount; ++index) {
+		const CompiledNode& node{ pNodes[index] };
+		bool isValid{ false };
+		switch (node.type) {
+			case CompiledType::Leaf:
+				isValid = node.first < header.symbolCount;
+				break;
+			case CompiledType::Select:
+			case CompiledType::Sequence:
+				isValid = node.first + static_cast<unsigned long long>(node.second) <= header.childCount;
+				break;
+			case CompiledType::Repetition:
+				isValid = node.first < header.nodeCount;
+				break;
+			case CompiledType::LNode:
+				isValid = node.first < header.nodeCount && node.second < header.nodeCount;
+				break;
+		}
+		if (!isValid) {
+			throw SharedMemoryException{};
+		}
+	}
+
+	m_Tables.pNodes = At<CompiledNode>(m_pHeader->nodes);
+	m_Tables.pChildren = At<unsigned int>(m_pHeader->children);
+	m_Tables.pWeights = At<float>(m_pHeader->weights);
+}
+
+inline bool SharedGrammar::Fits(unsigned long long offset, unsigned long long count, size_t elementSize) const {
+
+	// Tables start aligned and end inside the grammar, written so nothing can overflow
+	const unsigned long long size{ m_pHeader->size };
+	return offset % 4 == 0 && offset >= sizeof(SharedGrammarHeader) && offset <= size && count <= (size - offset) / elementSize;
+}
+
+inline RuleId SharedGrammar::Resolve(const std::string& name) const {
+
+	const char* pText{ At<char>(m_pHeader->text) };
+	const SharedName* pBegin{ At<SharedName>(m_pHeader->names) };
+	const SharedName* pEnd{ pBegin + m_pHeader->nameCount };
+
+	auto compare = [&](const SharedName& entry, const std::string& value) {
+		return value.compare(0, std::string::npos, pText + entry.offset, entry.length) > 0;
+	};
+	const SharedName* pFound{ std::lower_bound(pBegin, pEnd, name, compare) };
+	if (pFound == pEnd || name.compare(0, std::string::npos, pText + pFound->offset, pFound->length) != 0) {
+		throw Rule404Exception{};
+	}
+	return RuleId{ pFound->rule };
+}
+
+inline std::string SharedGrammar::GetSymbol(unsigned int symbol) const {
+	const SharedSymbol& entry{ At<SharedSymbol>(m_pHeader->symbols)[symbol] };
+	return std::string(At<char>(m_pHeader->text) + entry.offset, entry.length);
+}
+
+template<typename Engine>
+void SharedGrammar::GenerateSymbols(RuleId rule, std::vector<unsigned int>& symbols, Engine& engine) const {
+	GenerateSymbols(rule, symbols, engine, m_pHeader->maxDepth);
+}
+
+template<typename Engine>
+void SharedGrammar::GenerateSymbols(RuleId rule, std::vector<unsigned int>& symbols, Engine& engine, int maxDepth) const {
+
+	if (rule.index >= m_pHeader->ruleCount) {
+		throw Rule404Exception{};
+	}
+
+	auto emit = [&](unsigned int payload) { symbols.push_back(payload); };
+	WalkCompiled(m_Tables, At<unsigned int>(m_pHeader->roots)[rule.index], emit, 0, maxDepth, engine, nullptr);
+}
+
+template<typename Engine>
+void SharedGrammar::GenerateSequence(RuleId rule, std::vector<std::string>& result, Engine& engine) const {
+
+	if (rule.index >= m_pHeader->ruleCount) {
+		throw Rule404Exception{};
+	}
+
+	auto emit = [&](unsigned int payload) { result.push_back(GetSymbol(payload)); };
+	WalkCompiled(m_Tables, At<unsigned int>(m_pHeader->roots)[rule.index], emit, 0, m_pHeader->maxDepth, engine, nullptr);
+}
@@ -29,7 +29,8 @@ int main()
     shop->ParseRule("Shop", "Item # 0.9");
 
 
-    auto result{ shop->GenerateSequence("Shop") };
+    RuleId shopRule{ shop->Resolve("Shop") };
+    auto result{ shop->GenerateSequence(shopRule) };
     
     std::cout << "\n-- Shop generated with Grammar --\n";
 
@@ -0,0 +1,91 @@
+#pragma once
+#include <vector>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <future>
+#include <functional>
+#include <condition_variable>
+
+//*** THREADPOOL ***
+//
+//
+
+// Fixed set of worker threads that run submitted tasks in order of submission
+class ThreadPool
+{
+	public:
+		ThreadPool(unsigned int threadCount = std::thread::hardware_concurrency());
+		virtual ~ThreadPool();
+
+		ThreadPool(const ThreadPool&) = delete;
+		ThreadPool(ThreadPool&&) = delete;
+		ThreadPool& operator=(const ThreadPool&) = delete;
+		ThreadPool& operator=(ThreadPool&&) = delete;
+
+		unsigned int GetThreadCount() const { return static_cast<unsigned int>(m_Workers.size()); }
+		std::future<void> Submit(std::function<void()> task);
+
+	private:
+		std::vector<std::thread> m_Workers;
+		std::queue<std::packaged_task<void()>> m_Tasks;
+		std::mutex m_Mutex;
+		std::condition_variable m_Condition;
+		bool m_IsStopping{ false };
+
+		void Work();
+};
+
+inline ThreadPool::ThreadPool(unsigned int threadCount) {
+
+	if (threadCount == 0) {
+		threadCount = 1;
+	}
+
+	for (unsigned int index{ 0 }; index < threadCount; ++index) {
+		m_Workers.emplace_back(&ThreadPool::Work, this);
+	}
+}
+
+inline ThreadPool::~ThreadPool() {
+
+	{
+		std::lock_guard<std::mutex> lock{ m_Mutex };
+		m_IsStopping = true;
+	}
+	m_Condition.notify_all();
+
+	for (std::thread& worker : m_Workers) {
+		worker.join();
+	}
+}
+
+inline std::future<void> ThreadPool::Submit(std::function<void()> task) {
+
+	std::packaged_task<void()> packagedTask{ task };
+	std::future<void> future{ packagedTask.get_future() };
+	{
+		std::lock_guard<std::mutex> lock{ m_Mutex };
+		m_Tasks.push(std::move(packagedTask));
+	}
+	m_Condition.notify_one();
+	return future;
+}
+
+inline void ThreadPool::Work() {
+
+	while (true) {
+		std::packaged_task<void()> task;
+		{
+			std::unique_lock<std::mutex> lock{ m_Mutex };
+			m_Condition.wait(lock, [this]() { return m_IsStopping || !m_Tasks.empty(); });
+			if (m_Tasks.empty()) {
+				return;
+			}
+
+			task = std::move(m_Tasks.front());
+			m_Tasks.pop();
+		}
+		task();
+	}
+}
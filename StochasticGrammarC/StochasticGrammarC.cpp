@@ -0,0 +1,177 @@
+// StochasticGrammarC.cpp : C interface over CompiledGrammar<std::string> in symbol mode.
+
+#include <fstream>
+#include <sstream>
+#include <cstring>
+#include "Grammar.h"
+#include "StochasticGrammarC.h"
+
+struct sg_grammar {
+	std::shared_ptr<const CompiledGrammar<std::string>> pCompiled;
+	std::unique_ptr<ThreadPool> pPool;
+	// Per handle, the LNode default is shared by the whole process
+	int maxDepth;
+};
+
+namespace
+{
+	// Exceptions never cross the C boundary, they are turned into status codes here
+	template<typename Function>
+	sg_status Guard(Function function) {
+		try {
+			return function();
+		}
+		catch (RuleSyntaxException) {
+			return SG_ERROR_SYNTAX;
+		}
+		catch (Rule404Exception) {
+			return SG_ERROR_UNKNOWN_RULE;
+		}
+		catch (...) {
+			return SG_ERROR_INTERNAL;
+		}
+	}
+
+	sg_status Load(std::istream& stream, int maxDepth, sg_grammar** outGrammar) {
+
+		Grammar<std::string> grammar{};
+		grammar.ParseRules(stream);
+
+		std::unique_ptr<sg_grammar> pGrammar{ std::make_unique<sg_grammar>() };
+		pGrammar->maxDepth = maxDepth > 0 ? maxDepth : LNode<std::string>::GetDepth();
+		pGrammar->pCompiled = grammar.Freeze(pGrammar->maxDepth);
+		*outGrammar = pGrammar.release();
+		return SG_OK;
+	}
+}
+
+sg_status sg_grammar_load(const char* path, int max_depth, sg_grammar** out_grammar) {
+
+	if (!path || !out_grammar) {
+		return SG_ERROR_ARGUMENT;
+	}
+
+	return Guard([&]() {
+		std::ifstream stream{ path };
+		if (!stream) {
+			return SG_ERROR_IO;
+		}
+		return Load(stream, max_depth, out_grammar);
+	});
+}
+
+sg_status sg_grammar_parse(const char* text, size_t length, int max_depth, sg_grammar** out_grammar) {
+
+	if (!text || !out_grammar) {
+		return SG_ERROR_ARGUMENT;
+	}
+
+	return Guard([&]() {
+		std::istringstream stream{ std::string{ text, length } };
+		return Load(stream, max_depth, out_grammar);
+	});
+}
+
+void sg_grammar_free(sg_grammar* grammar) {
+	delete grammar;
+}
+
+sg_status sg_grammar_set_threads(sg_grammar* grammar, unsigned int thread_count) {
+
+	if (!grammar) {
+		return SG_ERROR_ARGUMENT;
+	}
+
+	return Guard([&]() {
+		grammar->pPool = thread_count > 1 ? std::make_unique<ThreadPool>(thread_count) : nullptr;
+		return SG_OK;
+	});
+}
+
+sg_status sg_rule_resolve(const sg_grammar* grammar, const char* name, uint32_t* out_rule) {
+
+	if (!grammar || !name || !out_rule) {
+		return SG_ERROR_ARGUMENT;
+	}
+
+	return Guard([&]() {
+		*out_rule = grammar->pCompiled->Resolve(name).index;
+		return SG_OK;
+	});
+}
+
+uint32_t sg_symbol_count(const sg_grammar* grammar) {
+	return grammar ? static_cast<uint32_t>(grammar->pCompiled->GetSymbolCount()) : 0;
+}
+
+const char* sg_symbol_text(const sg_grammar* grammar, uint32_t symbol, size_t* out_length) {
+
+	if (!grammar || symbol >= grammar->pCompiled->GetSymbolCount()) {
+		return nullptr;
+	}
+
+	const std::string& text{ grammar->pCompiled->GetSymbol(symbol) };
+	if (out_length) {
+		*out_length = text.size();
+	}
+	return text.c_str();
+}
+
+sg_status sg_generate_batch(const sg_grammar* grammar, uint32_t rule, const uint64_t* seeds, size_t count, int max_depth,
+	uint32_t* symbols, size_t symbol_capacity, uint32_t* offsets, size_t* out_symbol_count) {
+
+	if (!grammar || (count > 0 && !seeds) || !offsets || !out_symbol_count || (symbol_capacity > 0 && !symbols)) {
+		return SG_ERROR_ARGUMENT;
+	}
+
+	return Guard([&]() {
+		const CompiledGrammar<std::string>& compiled{ *grammar->pCompiled };
+		const int maxDepth{ max_depth > 0 ? max_depth : grammar->maxDepth };
+		const unsigned long long* pSeeds{ reinterpret_cast<const unsigned long long*>(seeds) };
+
+		// Reused per calling thread, so steady batches do not allocate
+		thread_local SymbolBatch batch{};
+		batch.symbols.clear();
+		batch.offsets.clear();
+
+		if (grammar->pPool) {
+			compiled.GenerateBatch(*grammar->pPool, RuleId{ rule }, pSeeds, count, batch, maxDepth);
+		}
+		else {
+			compiled.GenerateBatch(RuleId{ rule }, pSeeds, count, batch, maxDepth);
+		}
+
+		*out_symbol_count = batch.symbols.size();
+		if (batch.symbols.size() > symbol_capacity) {
+			return SG_ERROR_BUFFER_TOO_SMALL;
+		}
+
+		if (!batch.symbols.empty()) {
+			std::memcpy(symbols, batch.symbols.data(), batch.symbols.size() * sizeof(uint32_t));
+		}
+		for (size_t index{ 0 }; index <= count; ++index) {
+			offsets[index] = index < batch.offsets.size() ? static_cast<uint32_t>(batch.offsets[index]) : 0;
+		}
+		return SG_OK;
+	});
+}
+
+const char* sg_status_string(sg_status status) {
+
+	switch (status) {
+		case SG_OK:
+			return "ok";
+		case SG_ERROR_ARGUMENT:
+			return "invalid argument";
+		case SG_ERROR_IO:
+			return "cannot read grammar file";
+		case SG_ERROR_SYNTAX:
+			return "rule syntax error";
+		case SG_ERROR_UNKNOWN_RULE:
+			return "unknown rule";
+		case SG_ERROR_BUFFER_TOO_SMALL:
+			return "symbol buffer too small";
+		default:
+			return "internal error";
+	}
+}
@@ -0,0 +1,69 @@
+#ifndef STOCHASTIC_GRAMMAR_C_H
+#define STOCHASTIC_GRAMMAR_C_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * C interface over compiled string grammars in symbol mode.
+ *
+ * Generations are returned as symbol IDs, sg_symbol_text maps an ID back to its text.
+ * A batch of generations fills caller owned buffers in one call: generation i is
+ * symbols[offsets[i]] up to symbols[offsets[i + 1]].
+ *
+ * A loaded grammar is immutable, every function taking a const sg_grammar* is thread safe.
+ */
+
+#if defined(_WIN32)
+	#if defined(SG_EXPORTS)
+		#define SG_API __declspec(dllexport)
+	#else
+		#define SG_API __declspec(dllimport)
+	#endif
+#else
+	#define SG_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct sg_grammar sg_grammar;
+
+typedef enum sg_status {
+	SG_OK = 0,
+	SG_ERROR_ARGUMENT = 1,
+	SG_ERROR_IO = 2,
+	SG_ERROR_SYNTAX = 3,
+	SG_ERROR_UNKNOWN_RULE = 4,
+	SG_ERROR_BUFFER_TOO_SMALL = 5,
+	SG_ERROR_INTERNAL = 6
+} sg_status;
+
+/* Rules in the 'Name = rule' file format. The depth is kept per grammar, max_depth 0 uses the library default */
+SG_API sg_status sg_grammar_load(const char* path, int max_depth, sg_grammar** out_grammar);
+SG_API sg_status sg_grammar_parse(const char* text, size_t length, int max_depth, sg_grammar** out_grammar);
+SG_API void sg_grammar_free(sg_grammar* grammar);
+
+/* Batches are split over thread_count threads, 0 or 1 generates on the calling thread */
+SG_API sg_status sg_grammar_set_threads(sg_grammar* grammar, unsigned int thread_count);
+
+SG_API sg_status sg_rule_resolve(const sg_grammar* grammar, const char* name, uint32_t* out_rule);
+SG_API uint32_t sg_symbol_count(const sg_grammar* grammar);
+SG_API const char* sg_symbol_text(const sg_grammar* grammar, uint32_t symbol, size_t* out_length);
+
+/*
+ * Runs one generation per seed, offsets needs room for count + 1 entries.
+ * When symbol_capacity is too small SG_ERROR_BUFFER_TOO_SMALL is returned and
+ * out_symbol_count holds the capacity needed, the buffers are left untouched.
+ */
+SG_API sg_status sg_generate_batch(const sg_grammar* grammar, uint32_t rule, const uint64_t* seeds, size_t count, int max_depth,
+	uint32_t* symbols, size_t symbol_capacity, uint32_t* offsets, size_t* out_symbol_count);
+
+SG_API const char* sg_status_string(sg_status status);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif